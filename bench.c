@@ -0,0 +1,966 @@
+/*
+ *  OpenVPN -- An application to securely tunnel IP networks
+ *             over a single TCP/UDP port, with support for SSL/TLS-based
+ *             session authentication and key exchange,
+ *             packet encryption, packet authentication, and
+ *             packet compression.
+ *
+ *  Copyright (C) 2002-2010 OpenVPN Technologies, Inc. <sales@openvpn.net>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2
+ *  as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program (see the file COPYING included with this
+ *  distribution); if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "syshead.h"
+
+#include "bench.h"
+
+#ifdef BENCH_TEST
+
+#include "buffer.h"
+#include "error.h"
+#include "otime.h"
+#include "mtu.h"
+#include "proto.h"
+#include "list.h"
+#include "schedule.h"
+#include "mbuf.h"
+#include "mroute.h"
+#include "packet_id.h"
+#include "fragment.h"
+#include "lzo.h"
+#include "openvpn.h"
+#include "forward.h"
+#include "init.h"
+#include "slab.h"
+#include "multi.h"
+#include "clinat.h"
+
+#include "memdbg.h"
+
+/*
+ * Results of side-effect free loops are accumulated
+ * here so that the compiler cannot discard them.
+ */
+static volatile unsigned int bench_sink;
+
+/*
+ * Bytes moved between buffers by the buf_copy family
+ * or by the cipher, see BUF_COPY_ACCOUNT in buffer.h.
+ */
+unsigned long bench_buf_copy_bytes;
+
+static bool bench_first;
+
+/*
+ * Deterministic pseudo-random sequence, so that every
+ * run of the suite exercises identical workloads.
+ */
+static uint32_t bench_seed;
+
+static inline uint32_t
+bench_random (void)
+{
+  bench_seed = bench_seed * 1103515245 + 12345;
+  return bench_seed >> 8;
+}
+
+static void
+bench_begin (struct timeval *start)
+{
+  openvpn_gettimeofday (start, NULL);
+}
+
+/*
+ * Emit one result record.  extra, if defined, is a
+ * fragment of pre-formatted JSON members which will be
+ * appended to the record.
+ */
+static void
+bench_report (const char *name,
+	      const int iterations,
+	      const struct timeval *start,
+	      const char *extra)
+{
+  struct timeval end, delta;
+  double usec;
+
+  openvpn_gettimeofday (&end, NULL);
+  tv_delta (&delta, start, &end);
+  usec = (double)delta.tv_sec * 1000000.0 + (double)delta.tv_usec;
+  if (usec < 1.0)
+    usec = 1.0;
+
+  printf ("%s\n    {\"name\": \"%s\", \"iterations\": %d, \"usec\": %.0f, \"ns_per_op\": %.2f, \"ops_per_sec\": %.0f%s%s}",
+	  bench_first ? "" : ",",
+	  name,
+	  iterations,
+	  usec,
+	  usec * 1000.0 / iterations,
+	  (double)iterations * 1000000.0 / usec,
+	  extra ? ", " : "",
+	  extra ? extra : "");
+  bench_first = false;
+}
+
+/*
+ * Benchmarks which are not compiled into this build are
+ * still listed, so that diffs between builds are explicit.
+ */
+static void
+bench_skip (const char *name, const char *reason)
+{
+  printf ("%s\n    {\"name\": \"%s\", \"skipped\": \"%s\"}",
+	  bench_first ? "" : ",",
+	  name,
+	  reason);
+  bench_first = false;
+}
+
+#if P2MP_SERVER
+
+#define BENCH_HASH_ELEMENTS   16384
+#define BENCH_HASH_BUCKETS    256
+#define BENCH_HASH_LOOKUPS    (BENCH_HASH_ELEMENTS * 16)
+
+static void
+bench_hash (void)
+{
+  struct mroute_addr *keys;
+  struct hash *hash;
+  struct timeval start;
+  int i;
+
+  ALLOC_ARRAY_CLEAR (keys, struct mroute_addr, BENCH_HASH_ELEMENTS);
+  for (i = 0; i < BENCH_HASH_ELEMENTS; ++i)
+    mroute_extract_in_addr_t (&keys[i], 0x0A000000 + i);
+
+  hash = hash_init (BENCH_HASH_BUCKETS,
+		    bench_random (),
+		    mroute_addr_hash_function,
+		    mroute_addr_compare_function);
+
+  bench_begin (&start);
+  for (i = 0; i < BENCH_HASH_ELEMENTS; ++i)
+    hash_add (hash, &keys[i], &keys[i], false);
+  bench_report ("hash_add", BENCH_HASH_ELEMENTS, &start, NULL);
+
+  bench_begin (&start);
+  for (i = 0; i < BENCH_HASH_LOOKUPS; ++i)
+    {
+      const struct mroute_addr *key = &keys[bench_random () % BENCH_HASH_ELEMENTS];
+      if (hash_lookup (hash, key))
+	++bench_sink;
+    }
+  bench_report ("hash_lookup_hit", BENCH_HASH_LOOKUPS, &start, NULL);
+
+  bench_begin (&start);
+  for (i = 0; i < BENCH_HASH_LOOKUPS; ++i)
+    {
+      struct mroute_addr key;
+      mroute_extract_in_addr_t (&key, 0x0B000000 + (bench_random () % BENCH_HASH_ELEMENTS));
+      if (hash_lookup (hash, &key))
+	++bench_sink;
+    }
+  bench_report ("hash_lookup_miss", BENCH_HASH_LOOKUPS, &start, NULL);
+
+  hash_free (hash);
+  free (keys);
+}
+
+#define BENCH_SCHEDULE_ENTRIES  10000
+#define BENCH_SCHEDULE_CYCLES   200000
+
+static void
+bench_schedule (void)
+{
+  struct schedule *s = schedule_init ();
+  struct schedule_entry *entries;
+  struct timeval start, tv, base;
+  int i;
+
+  ALLOC_ARRAY_CLEAR (entries, struct schedule_entry, BENCH_SCHEDULE_ENTRIES);
+  base.tv_sec = now;
+  base.tv_usec = 0;
+
+  bench_begin (&start);
+  for (i = 0; i < BENCH_SCHEDULE_CYCLES; ++i)
+    {
+      tv.tv_sec = base.tv_sec + (bench_random () % 60);
+      tv.tv_usec = bench_random () % 1000000;
+      schedule_add_entry (s, &entries[i % BENCH_SCHEDULE_ENTRIES], &tv, 0);
+    }
+  bench_report ("schedule_add_modify", BENCH_SCHEDULE_CYCLES, &start, NULL);
+
+  /*
+   * Mimic the server loop: pop the earliest wakeup
+   * and reschedule it somewhere in the future.
+   */
+  bench_begin (&start);
+  for (i = 0; i < BENCH_SCHEDULE_CYCLES; ++i)
+    {
+      struct schedule_entry *e = schedule_get_earliest_wakeup (s, &tv);
+      ASSERT (e);
+      tv.tv_sec += 1 + (bench_random () % 60);
+      schedule_add_entry (s, e, &tv, 0);
+    }
+  bench_report ("schedule_get_earliest_wakeup", BENCH_SCHEDULE_CYCLES, &start, NULL);
+
+  schedule_free (s);
+  free (entries);
+}
+
+#endif /* P2MP_SERVER */
+
+#if P2MP
+
+#define BENCH_MBUF_SIZE      1024
+#define BENCH_MBUF_BURST     32
+#define BENCH_MBUF_PACKETS   1000000
+
+static void
+bench_mbuf (void)
+{
+  struct mbuf_set *ms = mbuf_init (BENCH_MBUF_SIZE);
+  struct buffer buf = alloc_buf (1500);
+  struct timeval start;
+  int i;
+
+  ASSERT (buf_write_alloc (&buf, 1200));
+
+  bench_begin (&start);
+  for (i = 0; i < BENCH_MBUF_PACKETS; i += BENCH_MBUF_BURST)
+    {
+      struct mbuf_item item;
+      int j;
+
+      /* the instance pointer is only compared against NULL */
+      item.instance = (struct multi_instance *) &buf;
+      for (j = 0; j < BENCH_MBUF_BURST; ++j)
+	{
+	  item.buffer = mbuf_alloc_buf (&buf);
+	  mbuf_add_item (ms, &item);
+	  mbuf_free_buf (item.buffer);
+	}
+      while (mbuf_extract_item (ms, &item))
+	mbuf_free_buf (item.buffer);
+    }
+  bench_report ("mbuf_add_extract_item", BENCH_MBUF_PACKETS, &start, NULL);
+
+  free_buf (&buf);
+  mbuf_free (ms);
+}
+
+#endif /* P2MP */
+
+#ifdef USE_CRYPTO
+
+#define BENCH_PID_PACKETS    2000000
+#define BENCH_PID_BACKTRACK  64
+
+static void
+bench_packet_id (void)
+{
+  struct packet_id pid;
+  struct timeval start;
+  int i;
+
+  packet_id_init (&pid, false, BENCH_PID_BACKTRACK, 15, "bench", 0);
+
+  /*
+   * Mostly in-order sequence with every eighth pair of
+   * packets swapped, as seen on a slightly lossy UDP path.
+   */
+  bench_begin (&start);
+  for (i = 0; i < BENCH_PID_PACKETS; ++i)
+    {
+      struct packet_id_net pin;
+      pin.time = now;
+      pin.id = (packet_id_type) (i + 1);
+      if ((i & 7) == 6)
+	++pin.id;
+      else if ((i & 7) == 7)
+	--pin.id;
+      if (packet_id_test (&pid.rec, &pin))
+	packet_id_add (&pid.rec, &pin);
+      else
+	++bench_sink;
+    }
+  bench_report ("packet_id_test", BENCH_PID_PACKETS, &start, NULL);
+
+  packet_id_free (&pid);
+}
+
+#endif /* USE_CRYPTO */
+
+#ifdef ENABLE_CLIENT_NAT
+
+#define BENCH_CLIENT_NAT_PACKETS  256
+#define BENCH_CLIENT_NAT_ROUNDS   2000000
+
+/*
+ * A full --client-nat table of 31 snat and 31 dnat rules,
+ * plus two rules which match none of the packets.  If linear,
+ * those two have non-contiguous netmasks, which keeps the
+ * tables from being compiled into ranges.
+ */
+static void
+bench_client_nat_run (const char *name, const bool linear)
+{
+  struct gc_arena gc = gc_new ();
+  struct client_nat_option_list *list = new_client_nat_list (&gc);
+  struct buffer buf = alloc_buf (256);
+  struct openvpn_iphdr *ip;
+  in_addr_t saddr[BENCH_CLIENT_NAT_PACKETS];
+  in_addr_t daddr[BENCH_CLIENT_NAT_PACKETS];
+  struct timeval start;
+  char net[32], foreign[32];
+  int i;
+
+  for (i = 0; i < 31; ++i)
+    {
+      openvpn_snprintf (net, sizeof (net), "10.%d.0.0", i);
+      openvpn_snprintf (foreign, sizeof (foreign), "172.%d.0.0", i);
+      add_client_nat_to_option_list (list, "snat", net, "255.255.0.0", foreign, M_FATAL);
+      openvpn_snprintf (net, sizeof (net), "192.168.%d.0", i);
+      openvpn_snprintf (foreign, sizeof (foreign), "10.200.%d.0", i);
+      add_client_nat_to_option_list (list, "dnat", net, "255.255.255.0", foreign, M_FATAL);
+    }
+  add_client_nat_to_option_list (list, "snat", "127.0.0.1", linear ? "255.0.0.255" : "255.255.255.255", "127.0.0.2", M_FATAL);
+  add_client_nat_to_option_list (list, "dnat", "127.0.0.1", linear ? "255.0.0.255" : "255.255.255.255", "127.0.0.2", M_FATAL);
+
+  /* about half of the addresses are translated */
+  for (i = 0; i < BENCH_CLIENT_NAT_PACKETS; ++i)
+    {
+      const uint32_t r = bench_random ();
+      saddr[i] = htonl (0x0A000000 | ((r % 62) << 16) | (r & 0xFFFF));
+      daddr[i] = htonl (0xC0A80000 | (((r >> 8) % 62) << 8) | (r & 0xFF));
+    }
+
+  ip = (struct openvpn_iphdr *) buf_write_alloc (&buf, sizeof (struct openvpn_iphdr) + sizeof (struct openvpn_udphdr));
+  CLEAR (*ip);
+  ip->version_len = 0x45;
+  ip->protocol = OPENVPN_IPPROTO_UDP;
+
+  bench_begin (&start);
+  for (i = 0; i < BENCH_CLIENT_NAT_ROUNDS; ++i)
+    {
+      const int k = i & (BENCH_CLIENT_NAT_PACKETS - 1);
+      ip->saddr = saddr[k];
+      ip->daddr = daddr[k];
+      client_nat_transform (list, &buf, CN_OUTGOING);
+      bench_sink += ip->check;
+    }
+  bench_report (name, BENCH_CLIENT_NAT_ROUNDS, &start, NULL);
+
+  free_buf (&buf);
+  gc_free (&gc);
+}
+
+static void
+bench_client_nat (void)
+{
+  bench_client_nat_run ("client_nat_64_rules", false);
+  bench_client_nat_run ("client_nat_64_rules_linear", true);
+}
+
+#endif /* ENABLE_CLIENT_NAT */
+
+#if P2MP_SERVER
+
+#define BENCH_MROUTE_PACKETS 2000000
+
+static void
+bench_mroute_extract (void)
+{
+  struct buffer buf = alloc_buf (256);
+  struct mroute_addr src, dest, esrc, edest;
+  struct timeval start;
+  int i;
+
+  /* IPv4 TUN packet */
+  {
+    struct openvpn_iphdr *ip;
+    buf_init (&buf, 0);
+    ip = (struct openvpn_iphdr *) buf_write_alloc (&buf, 64);
+    CLEAR (*ip);
+    ip->version_len = 0x45;
+    ip->protocol = OPENVPN_IPPROTO_UDP;
+    ip->saddr = htonl (0x0A080001);
+    ip->daddr = htonl (0x0A080002);
+  }
+  bench_begin (&start);
+  for (i = 0; i < BENCH_MROUTE_PACKETS; ++i)
+    bench_sink += mroute_extract_addr_from_packet (&src, &dest, NULL, NULL, &buf, DEV_TYPE_TUN);
+  bench_report ("mroute_extract_addr_ipv4", BENCH_MROUTE_PACKETS, &start, NULL);
+
+  /* IPv6 TUN packet */
+  {
+    struct openvpn_ipv6hdr *ipv6;
+    buf_init (&buf, 0);
+    ipv6 = (struct openvpn_ipv6hdr *) buf_write_alloc (&buf, 64);
+    CLEAR (*ipv6);
+    ipv6->version_prio = 0x60;
+    ipv6->nexthdr = OPENVPN_IPPROTO_UDP;
+    ipv6->saddr.s6_addr[0] = 0x20;
+    ipv6->saddr.s6_addr[15] = 1;
+    ipv6->daddr.s6_addr[0] = 0x20;
+    ipv6->daddr.s6_addr[15] = 2;
+  }
+  bench_begin (&start);
+  for (i = 0; i < BENCH_MROUTE_PACKETS; ++i)
+    bench_sink += mroute_extract_addr_from_packet (&src, &dest, NULL, NULL, &buf, DEV_TYPE_TUN);
+  bench_report ("mroute_extract_addr_ipv6", BENCH_MROUTE_PACKETS, &start, NULL);
+
+  /* Ethernet TAP frame carrying IPv4 */
+  {
+    struct openvpn_ethhdr *eth;
+    struct openvpn_iphdr *ip;
+    buf_init (&buf, 0);
+    eth = (struct openvpn_ethhdr *) buf_write_alloc (&buf, sizeof (struct openvpn_ethhdr));
+    memset (eth->dest, 0x02, OPENVPN_ETH_ALEN);
+    memset (eth->source, 0x04, OPENVPN_ETH_ALEN);
+    eth->proto = htons (OPENVPN_ETH_P_IPV4);
+    ip = (struct openvpn_iphdr *) buf_write_alloc (&buf, 64);
+    CLEAR (*ip);
+    ip->version_len = 0x45;
+    ip->protocol = OPENVPN_IPPROTO_UDP;
+    ip->saddr = htonl (0x0A080001);
+    ip->daddr = htonl (0x0A080002);
+  }
+  bench_begin (&start);
+  for (i = 0; i < BENCH_MROUTE_PACKETS; ++i)
+    bench_sink += mroute_extract_addr_from_packet (&src, &dest, &esrc, &edest, &buf, DEV_TYPE_TAP);
+  bench_report ("mroute_extract_addr_ether", BENCH_MROUTE_PACKETS, &start, NULL);
+
+  free_buf (&buf);
+}
+
+#endif /* P2MP_SERVER */
+
+#if P2MP_SERVER
+
+#define BENCH_INSTANCES        8192
+#define BENCH_INSTANCE_ROUNDS  16
+
+/*
+ * Members of struct context_2 which are read or
+ * written for every data channel packet of a client.
+ */
+struct bench_field
+{
+  size_t offset;
+  size_t size;
+};
+
+#define BENCH_C2_FIELD(f) { offsetof (struct context_2, f), sizeof (((struct context_2 *) 0)->f) }
+
+static const struct bench_field bench_hot_fields[] = {
+  BENCH_C2_FIELD (buffers),
+  BENCH_C2_FIELD (buf),
+  BENCH_C2_FIELD (to_tun),
+  BENCH_C2_FIELD (to_link),
+  BENCH_C2_FIELD (buf_info),
+  BENCH_C2_FIELD (to_tun_info),
+  BENCH_C2_FIELD (data_path),
+  BENCH_C2_FIELD (burst_flags),
+  BENCH_C2_FIELD (to_tun_retry),
+  BENCH_C2_FIELD (link_socket),
+  BENCH_C2_FIELD (link_socket_info),
+  BENCH_C2_FIELD (to_link_addr),
+  BENCH_C2_FIELD (from),
+  BENCH_C2_FIELD (frame),
+#ifdef ENABLE_FRAGMENT
+  BENCH_C2_FIELD (fragment),
+#endif
+  BENCH_C2_FIELD (tun_read_bytes),
+  BENCH_C2_FIELD (tun_write_bytes),
+  BENCH_C2_FIELD (link_read_bytes),
+  BENCH_C2_FIELD (link_read_bytes_auth),
+  BENCH_C2_FIELD (link_write_bytes),
+  BENCH_C2_FIELD (ping_send_interval),
+  BENCH_C2_FIELD (ping_rec_interval),
+  BENCH_C2_FIELD (inactivity_bytes),
+  BENCH_C2_FIELD (original_recv_size),
+  BENCH_C2_FIELD (max_recv_size_local),
+  BENCH_C2_FIELD (max_send_size_local),
+#ifdef USE_SSL
+  BENCH_C2_FIELD (tls_multi),
+#endif
+#ifdef USE_CRYPTO
+  BENCH_C2_FIELD (crypto_options),
+#endif
+  BENCH_C2_FIELD (ipv4_tun),
+  BENCH_C2_FIELD (log_rw),
+  BENCH_C2_FIELD (fast_io),
+};
+
+/*
+ * Number of distinct cache lines covered by the hot
+ * fields of a slab-allocated (and therefore cache line
+ * aligned) multi_instance.  This depends on the build:
+ * on x86-64 with crypto, SSL and fragmentation enabled
+ * the fields span 440 bytes starting 8 bytes into a
+ * line, which makes 8 lines.
+ */
+static int
+bench_hot_cache_lines (void)
+{
+  const size_t base = offsetof (struct multi_instance, context) + offsetof (struct context, c2);
+  const int n_lines = (int) (sizeof (struct multi_instance) / SLAB_ALIGN) + 1;
+  bool *touched = (bool *) calloc (n_lines, sizeof (bool));
+  int i, line, ret = 0;
+
+  check_malloc_return (touched);
+  for (i = 0; i < (int) SIZE (bench_hot_fields); ++i)
+    {
+      const size_t first = base + bench_hot_fields[i].offset;
+      const size_t last = first + bench_hot_fields[i].size - 1;
+      for (line = (int) (first / SLAB_ALIGN); line <= (int) (last / SLAB_ALIGN); ++line)
+	touched[line] = true;
+    }
+  for (line = 0; line < n_lines; ++line)
+    ret += touched[line];
+  free (touched);
+  return ret;
+}
+
+static void
+bench_instance (void)
+{
+  struct slab *slab = slab_init (sizeof (struct multi_instance), MULTI_INSTANCE_SLAB_BLOCK);
+  struct multi_instance **mi;
+  int *order;
+  struct timeval start;
+  char extra[128];
+  int i, j, k;
+
+  ALLOC_ARRAY (mi, struct multi_instance *, BENCH_INSTANCES);
+  ALLOC_ARRAY (order, int, BENCH_INSTANCES);
+
+  bench_begin (&start);
+  for (i = 0; i < BENCH_INSTANCES; ++i)
+    mi[i] = (struct multi_instance *) slab_alloc (slab);
+  bench_report ("instance_alloc", BENCH_INSTANCES, &start, NULL);
+
+  /* visit instances in random order, as packets from many clients would */
+  for (i = 0; i < BENCH_INSTANCES; ++i)
+    order[i] = i;
+  for (i = BENCH_INSTANCES - 1; i > 0; --i)
+    {
+      const int r = bench_random () % (i + 1);
+      const int tmp = order[i];
+      order[i] = order[r];
+      order[r] = tmp;
+    }
+
+  bench_begin (&start);
+  for (k = 0; k < BENCH_INSTANCE_ROUNDS; ++k)
+    for (i = 0; i < BENCH_INSTANCES; ++i)
+      {
+	uint8_t *c2 = (uint8_t *) &mi[order[i]]->context.c2;
+	for (j = 0; j < (int) SIZE (bench_hot_fields); ++j)
+	  {
+	    uint8_t *f = c2 + bench_hot_fields[j].offset;
+	    bench_sink += f[0] + f[bench_hot_fields[j].size - 1];
+	    ++f[0];
+	  }
+      }
+  openvpn_snprintf (extra, sizeof (extra), "\"instance_bytes\": %d, \"bytes_per_instance\": %d, \"hot_cache_lines\": %d",
+		    (int) sizeof (struct multi_instance),
+		    (int) (slab_footprint (slab) / BENCH_INSTANCES),
+		    bench_hot_cache_lines ());
+  bench_report ("instance_hot_touch", BENCH_INSTANCES * BENCH_INSTANCE_ROUNDS, &start, extra);
+
+  bench_begin (&start);
+  for (i = 0; i < BENCH_INSTANCES; ++i)
+    slab_release (slab, mi[i]);
+  for (i = 0; i < BENCH_INSTANCES; ++i)
+    mi[i] = (struct multi_instance *) slab_alloc (slab);
+  for (i = 0; i < BENCH_INSTANCES; ++i)
+    slab_release (slab, mi[i]);
+  bench_report ("instance_release_realloc", BENCH_INSTANCES * 2, &start, NULL);
+
+  free (order);
+  free (mi);
+  slab_free (slab);
+}
+
+#endif /* P2MP_SERVER */
+
+/*
+ * Frame geometry equivalent to --tun-mtu 1500
+ * with only the data channel add-ons being
+ * benchmarked enabled.
+ */
+static void
+bench_frame_init (struct frame *frame)
+{
+  frame_finalize (frame, false, 0, true, TUN_MTU_DEFAULT);
+}
+
+/*
+ * Fill buf with payload bytes, either compressible (repeated
+ * short runs, typical of text protocols) or random.
+ */
+static void
+bench_fill_payload (struct buffer *buf, const int len, const bool compressible)
+{
+  uint8_t *p = buf_write_alloc (buf, len);
+  int i;
+  ASSERT (p);
+  for (i = 0; i < len; ++i)
+    p[i] = compressible ? (uint8_t)("GET /index.html HTTP/1.1\r\n"[(i / 4) % 26]) : (uint8_t)bench_random ();
+}
+
+#ifdef ENABLE_FRAGMENT
+
+#define BENCH_FRAG_PACKETS   500000
+#define BENCH_FRAG_MTU       576
+
+static void
+bench_fragment_run (const char *name, const int payload_len)
+{
+  struct frame frame;
+  struct fragment_master *out, *in;
+  struct buffer payload, buf;
+  struct timeval start;
+  int i, n_frags = 0;
+  char extra[64];
+
+  CLEAR (frame);
+  out = fragment_init (&frame);
+  in = fragment_init (&frame);
+  bench_frame_init (&frame);
+  frame_set_mtu_dynamic (&frame, BENCH_FRAG_MTU, SET_MTU_UPPER_BOUND);
+  fragment_frame_init (out, &frame);
+  fragment_frame_init (in, &frame);
+
+  payload = alloc_buf (BUF_SIZE (&frame));
+  ASSERT (buf_init (&payload, FRAME_HEADROOM (&frame)));
+  bench_fill_payload (&payload, payload_len, false);
+
+  buf = alloc_buf (BUF_SIZE (&frame));
+
+  bench_begin (&start);
+  for (i = 0; i < BENCH_FRAG_PACKETS; ++i)
+    {
+      struct buffer b = buf;
+      ASSERT (buf_init (&b, FRAME_HEADROOM (&frame)));
+      ASSERT (buf_copy (&b, &payload));
+
+      fragment_outgoing (out, &b, &frame);
+      do {
+	struct buffer rx = b;
+	++n_frags;
+	fragment_incoming (in, &rx, &frame);
+	if (BLEN (&rx))
+	  bench_sink += BLEN (&rx);
+      } while (fragment_ready_to_send (out, &b, &frame));
+    }
+  openvpn_snprintf (extra, sizeof (extra), "\"fragments_per_packet\": %.2f",
+		    (double)n_frags / BENCH_FRAG_PACKETS);
+  bench_report (name, BENCH_FRAG_PACKETS, &start, extra);
+
+  free_buf (&buf);
+  free_buf (&payload);
+  fragment_free (out);
+  fragment_free (in);
+}
+
+static void
+bench_fragment (void)
+{
+  bench_fragment_run ("fragment_outgoing_incoming_whole", 400);
+  bench_fragment_run ("fragment_outgoing_incoming_split", 1400);
+}
+
+#endif /* ENABLE_FRAGMENT */
+
+#if defined(USE_LZO) && !defined(LZO_STUB)
+
+#define BENCH_LZO_PACKETS    200000
+
+static void
+bench_lzo_run (const char *name, const bool compressible)
+{
+  struct lzo_compress_workspace lzowork;
+  struct frame frame;
+  struct buffer payload, buf, work, dwork;
+  struct timeval start;
+  counter_type out_bytes = 0;
+  int i;
+  char extra[64];
+
+  CLEAR (frame);
+  CLEAR (lzowork);
+  lzo_adjust_frame_parameters (&frame);
+  bench_frame_init (&frame);
+  lzo_compress_init (&lzowork, LZO_SELECTED|LZO_ON);
+
+  payload = alloc_buf (BUF_SIZE (&frame));
+  ASSERT (buf_init (&payload, FRAME_HEADROOM (&frame)));
+  bench_fill_payload (&payload, 1400, compressible);
+
+  buf = alloc_buf (BUF_SIZE (&frame));
+  work = alloc_buf (BUF_SIZE (&frame));
+  dwork = alloc_buf (BUF_SIZE (&frame));
+
+  bench_begin (&start);
+  for (i = 0; i < BENCH_LZO_PACKETS; ++i)
+    {
+      struct buffer b = buf;
+      ASSERT (buf_init (&b, FRAME_HEADROOM (&frame)));
+      ASSERT (buf_copy (&b, &payload));
+      lzo_compress (&b, work, &lzowork, &frame);
+      out_bytes += BLEN (&b);
+      lzo_decompress (&b, dwork, &lzowork, &frame);
+      ASSERT (BLEN (&b) == BLEN (&payload));
+    }
+  openvpn_snprintf (extra, sizeof (extra), "\"ratio\": %.3f",
+		    (double)out_bytes / ((double)BLEN (&payload) * BENCH_LZO_PACKETS));
+  bench_report (name, BENCH_LZO_PACKETS, &start, extra);
+
+  free_buf (&dwork);
+  free_buf (&work);
+  free_buf (&buf);
+  free_buf (&payload);
+  lzo_compress_uninit (&lzowork);
+}
+
+static void
+bench_lzo (void)
+{
+  bench_lzo_run ("lzo_compress_decompress_text", true);
+  bench_lzo_run ("lzo_compress_decompress_random", false);
+}
+
+#endif /* USE_LZO && !LZO_STUB */
+
+#define BENCH_DATAPATH_PACKETS  500000
+#define BENCH_DATAPATH_PAYLOAD  1400
+
+#define BDP_LZO      (1<<0)
+#define BDP_FRAGMENT (1<<1)
+
+/* data channel cipher and HMAC of the datapath runs */
+#define BENCH_DATAPATH_CIPHER   "AES-128-CBC"
+#define BENCH_DATAPATH_AUTH     "SHA1"
+
+/*
+ * Push packets through encrypt_sign the way the tun -> link
+ * path of the event loop does, including the trickle of
+ * further fragments from check_fragment, and report how
+ * many bytes are copied from one buffer to another for each
+ * payload byte.  Packets are encrypted and signed as with a
+ * static key, so that a cipher pass which writes its output
+ * to another buffer is counted as a copy.
+ */
+static void
+bench_datapath_run (const char *name, const unsigned int flags)
+{
+  struct context *c;
+  struct link_socket_info info;
+  struct link_socket_addr lsa;
+  struct buffer payload;
+  struct timeval start;
+  counter_type in_bytes = 0;
+  int i;
+  char extra[64];
+#ifdef USE_CRYPTO
+  struct key_type kt;
+  struct key key;
+  struct key_ctx_bi kbi;
+  struct packet_id pid;
+#endif
+
+  ALLOC_OBJ_CLEAR (c, struct context);
+  CLEAR (info);
+  CLEAR (lsa);
+
+#ifdef USE_CRYPTO
+  init_key_type (&kt, BENCH_DATAPATH_CIPHER, true, BENCH_DATAPATH_AUTH, true, 0, false, false);
+  generate_key_random (&key, &kt);
+  CLEAR (kbi);
+  init_key_ctx (&kbi.encrypt, &key, &kt, DO_ENCRYPT, "Bench Encrypt");
+  CLEAR (key);
+  packet_id_init (&pid, false, BENCH_PID_BACKTRACK, 15, "bench", 0);
+  c->c2.crypto_options.key_ctx_bi = &kbi;
+  c->c2.crypto_options.packet_id = &pid;
+  c->c2.crypto_options.flags = CO_USE_IV;
+  crypto_adjust_frame_parameters (&c->c2.frame, &kt, true, true, true, false);
+#endif
+#if defined(USE_LZO) && !defined(LZO_STUB)
+  if (flags & BDP_LZO)
+    {
+      lzo_adjust_frame_parameters (&c->c2.frame);
+      lzo_compress_init (&c->c2.lzo_compwork, LZO_SELECTED|LZO_ON);
+    }
+#endif
+#ifdef ENABLE_FRAGMENT
+  if (flags & BDP_FRAGMENT)
+    c->c2.fragment = fragment_init (&c->c2.frame);
+#endif
+  bench_frame_init (&c->c2.frame);
+  c->c2.frame_fragment = c->c2.frame;
+#ifdef ENABLE_FRAGMENT
+  if (c->c2.fragment)
+    {
+      frame_set_mtu_dynamic (&c->c2.frame_fragment, BENCH_FRAG_MTU, SET_MTU_UPPER_BOUND);
+      fragment_frame_init (c->c2.fragment, &c->c2.frame_fragment);
+    }
+#endif
+  c->c2.buffers = init_context_buffers (&c->c2.frame);
+  c->c2.buffers_owned = true;
+
+  lsa.actual.dest.addr.in4.sin_family = AF_INET;
+  lsa.actual.dest.addr.in4.sin_addr.s_addr = htonl (0x7F000001);
+  info.lsa = &lsa;
+  c->c2.link_socket_info = &info;
+  data_path_init (c);
+
+  payload = alloc_buf (BUF_SIZE (&c->c2.frame));
+  ASSERT (buf_init (&payload, FRAME_HEADROOM (&c->c2.frame)));
+  bench_fill_payload (&payload, BENCH_DATAPATH_PAYLOAD, true);
+
+  bench_buf_copy_bytes = 0;
+  bench_begin (&start);
+  for (i = 0; i < BENCH_DATAPATH_PACKETS; ++i)
+    {
+      /* stands in for read_tun */
+      c->c2.buf = c->c2.buffers->read_tun_buf;
+      ASSERT (buf_init (&c->c2.buf, FRAME_HEADROOM (&c->c2.frame)));
+      memcpy (buf_write_alloc (&c->c2.buf, BLEN (&payload)), BPTR (&payload), BLEN (&payload));
+      in_bytes += BLEN (&payload);
+
+      encrypt_sign (c, true);
+      bench_sink += BLEN (&c->c2.to_link);
+      c->c2.to_link.len = 0;
+
+#ifdef ENABLE_FRAGMENT
+      while (c->c2.fragment && fragment_ready_to_send (c->c2.fragment, &c->c2.buf, &c->c2.frame_fragment))
+	{
+	  encrypt_sign (c, false);
+	  bench_sink += BLEN (&c->c2.to_link);
+	  c->c2.to_link.len = 0;
+	}
+#endif
+    }
+  openvpn_snprintf (extra, sizeof (extra), "\"bytes_copied_per_payload_byte\": %.2f",
+		    (double)bench_buf_copy_bytes / (double)in_bytes);
+  bench_report (name, BENCH_DATAPATH_PACKETS, &start, extra);
+
+  free_buf (&payload);
+  free_context_buffers (c->c2.buffers);
+#ifdef USE_CRYPTO
+  free_key_ctx_bi (&kbi);
+  packet_id_free (&pid);
+#endif
+#ifdef ENABLE_FRAGMENT
+  if (c->c2.fragment)
+    fragment_free (c->c2.fragment);
+#endif
+#if defined(USE_LZO) && !defined(LZO_STUB)
+  if (lzo_defined (&c->c2.lzo_compwork))
+    lzo_compress_uninit (&c->c2.lzo_compwork);
+#endif
+  free (c);
+}
+
+static void
+bench_datapath (void)
+{
+  bench_datapath_run ("datapath_tun_to_link", 0);
+#if defined(USE_LZO) && !defined(LZO_STUB)
+  bench_datapath_run ("datapath_tun_to_link_lzo", BDP_LZO);
+#else
+  bench_skip ("datapath_tun_to_link_lzo", "USE_LZO not enabled");
+#endif
+#ifdef ENABLE_FRAGMENT
+  bench_datapath_run ("datapath_tun_to_link_fragment", BDP_FRAGMENT);
+#else
+  bench_skip ("datapath_tun_to_link_fragment", "ENABLE_FRAGMENT not enabled");
+#endif
+}
+
+void
+bench_run (void)
+{
+  bench_first = true;
+  bench_seed = 0x0B5E55ED;
+  update_time ();
+
+  printf ("{\n  \"suite\": \"openvpn-bench\",\n  \"suite_version\": %d,\n  \"package\": \"%s\",\n  \"results\": [",
+	  BENCH_SUITE_VERSION,
+	  PACKAGE_STRING);
+
+#if P2MP_SERVER
+  bench_hash ();
+  bench_schedule ();
+#else
+  bench_skip ("hash", "P2MP_SERVER not enabled");
+  bench_skip ("schedule", "P2MP_SERVER not enabled");
+#endif
+
+#if P2MP
+  bench_mbuf ();
+#else
+  bench_skip ("mbuf", "P2MP not enabled");
+#endif
+
+#ifdef USE_CRYPTO
+  bench_packet_id ();
+#else
+  bench_skip ("packet_id_test", "USE_CRYPTO not enabled");
+#endif
+
+#if P2MP_SERVER
+  bench_mroute_extract ();
+#else
+  bench_skip ("mroute_extract_addr", "P2MP_SERVER not enabled");
+#endif
+
+#ifdef ENABLE_CLIENT_NAT
+  bench_client_nat ();
+#else
+  bench_skip ("client_nat", "ENABLE_CLIENT_NAT not enabled");
+#endif
+
+#if P2MP_SERVER
+  bench_instance ();
+#else
+  bench_skip ("instance", "P2MP_SERVER not enabled");
+#endif
+
+#ifdef ENABLE_FRAGMENT
+  bench_fragment ();
+#else
+  bench_skip ("fragment", "ENABLE_FRAGMENT not enabled");
+#endif
+
+#if defined(USE_LZO) && !defined(LZO_STUB)
+  bench_lzo ();
+#else
+  bench_skip ("lzo", "USE_LZO not enabled");
+#endif
+
+  bench_datapath ();
+
+  printf ("\n  ]\n}\n");
+  fflush (stdout);
+}
+
+#else
+static void dummy(void) {}
+#endif /* BENCH_TEST */
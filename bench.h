@@ -0,0 +1,54 @@
+/*
+ *  OpenVPN -- An application to securely tunnel IP networks
+ *             over a single TCP/UDP port, with support for SSL/TLS-based
+ *             session authentication and key exchange,
+ *             packet encryption, packet authentication, and
+ *             packet compression.
+ *
+ *  Copyright (C) 2002-2010 OpenVPN Technologies, Inc. <sales@openvpn.net>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2
+ *  as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program (see the file COPYING included with this
+ *  distribution); if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * Microbenchmarks for the core data structures and
+ * data channel building blocks.
+ *
+ * The suite is compiled in when BENCH_TEST is defined,
+ * which is what the "make bench" target does when it
+ * builds the openvpn-bench binary.  Results are written
+ * to stdout as a single JSON object so that runs from
+ * different builds can be compared mechanically.
+ */
+
+#ifndef BENCH_H
+#define BENCH_H
+
+/* define this to enable the microbenchmark suite */
+/*#define BENCH_TEST*/
+
+#ifdef BENCH_TEST
+
+/*
+ * Bump when the set of benchmarks or their
+ * workloads change, so that results from
+ * incompatible suites are not compared.
+ */
+#define BENCH_SUITE_VERSION 6
+
+void bench_run (void);
+
+#endif
+#endif
@@ -148,6 +148,7 @@ buf_assign (struct buffer *dest, const struct buffer *src)
 {
   if (!buf_init (dest, src->offset))
     return false;
+  BUF_COPY_ACCOUNT (BLEN (src));
   return buf_write (dest, BPTR (src), BLEN (src));
 }
 
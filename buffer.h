@@ -42,6 +42,19 @@
 #define BUF_INIT_TRACKING
 #endif
 
+/*
+ * In the benchmark build, count the bytes moved
+ * between buffers by the buf_copy family, or by a
+ * cipher writing to a buffer other than its input,
+ * so that copies per payload byte can be reported.
+ */
+#ifdef BENCH_TEST
+extern unsigned long bench_buf_copy_bytes;
+#define BUF_COPY_ACCOUNT(n) (bench_buf_copy_bytes += (unsigned long)(n))
+#else
+#define BUF_COPY_ACCOUNT(n)
+#endif
+
 /**************************************************************************/
 /**
  * Wrapper structure for dynamically allocated memory.
@@ -558,6 +571,7 @@ buf_write_u32 (struct buffer *dest, int data)
 static inline bool
 buf_copy (struct buffer *dest, const struct buffer *src)
 {
+  BUF_COPY_ACCOUNT (BLEN (src));
   return buf_write (dest, BPTR (src), BLEN (src));
 }
 
@@ -567,6 +581,7 @@ buf_copy_n (struct buffer *dest, struct buffer *src, int n)
   uint8_t *cp = buf_read_alloc (src, n);
   if (!cp)
     return false;
+  BUF_COPY_ACCOUNT (n);
   return buf_write (dest, cp, n);
 }
 
@@ -583,6 +598,7 @@ buf_copy_range (struct buffer *dest,
       || dest_index < 0
       || dest->offset + dest_index + src_len > dest->capacity)
     return false;
+  BUF_COPY_ACCOUNT (src_len);
   memcpy (dest->data + dest->offset + dest_index, src->data + src->offset + src_index, src_len);
   if (dest_index + src_len > dest->len)
     dest->len = dest_index + src_len;
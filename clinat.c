@@ -31,6 +31,147 @@
 #include "socket.h"
 #include "memdbg.h"
 
+/*
+ * A rule translates the destination address if its type
+ * differs from the direction, otherwise the source address.
+ */
+static inline bool
+rule_applies (const struct client_nat_entry *e, const int direction, const int side)
+{
+  return (e->type ^ direction) == side;
+}
+
+static inline in_addr_t
+rule_from (const struct client_nat_entry *e, const int direction)
+{
+  return direction ? e->foreign_network : e->network;
+}
+
+static inline in_addr_t
+rule_to (const struct client_nat_entry *e, const int direction)
+{
+  return direction ? e->network : e->foreign_network;
+}
+
+static int
+in_addr_t_compare (const void *a, const void *b)
+{
+  const in_addr_t x = *(const in_addr_t *)a;
+  const in_addr_t y = *(const in_addr_t *)b;
+  return x < y ? -1 : x > y;
+}
+
+static void
+compile_table (struct client_nat_option_list *list, const int direction, const int side)
+{
+  struct client_nat_table *t = &list->tables[direction][side];
+  in_addr_t bounds[MAX_CLIENT_NAT*2+1];
+  int n_bounds = 0;
+  int i, j;
+
+  t->linear = false;
+  t->n = 0;
+
+  /* every address where the set of matching rules may change */
+  bounds[n_bounds++] = 0;
+  for (i = 0; i < list->n; ++i)
+    {
+      const struct client_nat_entry *e = &list->entries[i];
+      const in_addr_t mask = ntohl (e->netmask);
+      const in_addr_t lo = ntohl (rule_from (e, direction));
+
+      if (!rule_applies (e, direction, side))
+	continue;
+      if (~mask & (~mask + 1))
+	{
+	  t->linear = true;
+	  return;
+	}
+      if (lo & ~mask)
+	continue; /* can never match */
+      bounds[n_bounds++] = lo;
+      if ((lo | ~mask) != 0xFFFFFFFF)
+	bounds[n_bounds++] = (lo | ~mask) + 1;
+    }
+  qsort (bounds, n_bounds, sizeof (bounds[0]), in_addr_t_compare);
+
+  for (i = 0; i < n_bounds; ++i)
+    {
+      int rule = -1;
+
+      if (i && bounds[i] == bounds[i-1])
+	continue;
+      for (j = 0; j < list->n; ++j)
+	{
+	  const struct client_nat_entry *e = &list->entries[j];
+	  if (rule_applies (e, direction, side)
+	      && (bounds[i] & ntohl (e->netmask)) == ntohl (rule_from (e, direction)))
+	    {
+	      rule = j;
+	      break;
+	    }
+	}
+      if (t->n && t->rule[t->n-1] == rule)
+	continue;
+      t->start[t->n] = bounds[i];
+      t->rule[t->n] = (signed char) rule;
+      ++t->n;
+    }
+}
+
+static void
+compile_tables (struct client_nat_option_list *list)
+{
+  compile_table (list, CN_OUTGOING, CN_SADDR);
+  compile_table (list, CN_OUTGOING, CN_DADDR);
+  compile_table (list, CN_INCOMING, CN_SADDR);
+  compile_table (list, CN_INCOMING, CN_DADDR);
+}
+
+/*
+ * Return the index of the first rule which translates
+ * addr, or -1 if there is none.
+ */
+static inline int
+lookup_rule (const struct client_nat_option_list *list,
+	     const int direction,
+	     const int side,
+	     const in_addr_t addr)
+{
+  const struct client_nat_table *t = &list->tables[direction][side];
+
+  if (t->linear)
+    {
+      int i;
+      for (i = 0; i < list->n; ++i)
+	{
+	  const struct client_nat_entry *e = &list->entries[i];
+	  if (rule_applies (e, direction, side) && (addr & e->netmask) == rule_from (e, direction))
+	    return i;
+	}
+      return -1;
+    }
+  else if (t->n)
+    {
+      const in_addr_t a = ntohl (addr);
+      int lo = 0;
+      int hi = t->n - 1;
+
+      /* last range starting at or below a, start[0] is 0 */
+      while (lo < hi)
+	{
+	  const int mid = (lo + hi + 1) >> 1;
+	  if (t->start[mid] <= a)
+	    lo = mid;
+	  else
+	    hi = mid - 1;
+	}
+      return t->rule[lo];
+    }
+  else
+    return -1;
+}
+
 static bool
 add_entry(struct client_nat_option_list *dest,
 	  const struct client_nat_entry *e)
@@ -43,6 +184,7 @@ add_entry(struct client_nat_option_list *dest,
   else
     {
       dest->entries[dest->n++] = *e;
+      compile_tables (dest);
       return true;
     }
 }
@@ -184,77 +326,67 @@ client_nat_transform (const struct client_nat_option_list *list,
 		      const int direction)
 {
   struct ip_tcp_udp_hdr *h = (struct ip_tcp_udp_hdr *) BPTR (ipbuf);
-  int i;
-  uint32_t addr, *addr_ptr;
-  const uint32_t *from, *to;
   int accumulate = 0;
-  unsigned int amask;
-  unsigned int alog = 0;
+  bool modified = false;
+  int side;
 
   if (check_debug_level (D_CLIENT_NAT))
     print_pkt (&h->ip, "BEFORE", direction, D_CLIENT_NAT);
 
-  for (i = 0; i < list->n; ++i)
+  for (side = CN_SADDR; side <= CN_DADDR; ++side)
     {
-      const struct client_nat_entry *e = &list->entries[i]; /* current NAT rule */
-      if (e->type ^ direction)
-	{
-	  addr = *(addr_ptr = &h->ip.daddr);
-	  amask = 2;
-	}
-      else
-	{
-	  addr = *(addr_ptr = &h->ip.saddr);
-	  amask = 1;
-	}
-      if (direction)
-	{
-	  from = &e->foreign_network;
-	  to = &e->network;
-	}
-      else
-	{
-	  from = &e->network;
-	  to = &e->foreign_network;
-	}
+      uint32_t *addr_ptr = (side == CN_DADDR) ? &h->ip.daddr : &h->ip.saddr;
+      const int i = lookup_rule (list, direction, side, *addr_ptr);
 
-      if (((addr & e->netmask) == *from) && !(amask & alog))
+      if (i >= 0)
 	{
+	  const struct client_nat_entry *e = &list->entries[i]; /* matching NAT rule */
+	  uint32_t addr = *addr_ptr;
+
 	  /* pre-adjust IP checksum */
 	  ADD_CHECKSUM_32(accumulate, addr);
 
 	  /* do NAT transform */
-	  addr = (addr & ~e->netmask) | *to;
+	  addr = (addr & ~e->netmask) | rule_to (e, direction);
 
 	  /* post-adjust IP checksum */
 	  SUB_CHECKSUM_32(accumulate, addr);
 
 	  /* write the modified address to packet */
 	  *addr_ptr = addr;
-
-	  /* mark as modified */
-	  alog |= amask;
+	  modified = true;
 	}
     }
-  if (alog)
+  if (modified)
     {
+      const int ip_hdr_len = OPENVPN_IPH_GET_LEN (h->ip.version_len);
+
       if (check_debug_level (D_CLIENT_NAT))
 	print_pkt (&h->ip, "AFTER", direction, D_CLIENT_NAT);
 
       ADJUST_CHECKSUM(accumulate, h->ip.check);
 
-      if (h->ip.protocol == OPENVPN_IPPROTO_TCP)
+      /* only the first fragment carries the transport header */
+      if (!(ntohs (h->ip.frag_off) & OPENVPN_IP_OFFMASK))
 	{
-	  if (BLEN(ipbuf) >= sizeof(struct openvpn_iphdr) + sizeof(struct openvpn_tcphdr))
+	  if (h->ip.protocol == OPENVPN_IPPROTO_TCP)
 	    {
-	      ADJUST_CHECKSUM(accumulate, h->u.tcp.check);
+	      if (BLEN(ipbuf) >= ip_hdr_len + (int) sizeof(struct openvpn_tcphdr))
+		{
+		  struct openvpn_tcphdr *tcp = (struct openvpn_tcphdr *) (BPTR (ipbuf) + ip_hdr_len);
+		  ADJUST_CHECKSUM(accumulate, tcp->check);
+		}
 	    }
-	}
-      else if (h->ip.protocol == OPENVPN_IPPROTO_UDP)
-	{
-	  if (BLEN(ipbuf) >= sizeof(struct openvpn_iphdr) + sizeof(struct openvpn_udphdr))
+	  else if (h->ip.protocol == OPENVPN_IPPROTO_UDP)
 	    {
-	      ADJUST_CHECKSUM(accumulate, h->u.udp.check);
+	      if (BLEN(ipbuf) >= ip_hdr_len + (int) sizeof(struct openvpn_udphdr))
+		{
+		  struct openvpn_udphdr *udp = (struct openvpn_udphdr *) (BPTR (ipbuf) + ip_hdr_len);
+
+		  /* a zero UDP checksum means none was computed */
+		  if (udp->check)
+		    ADJUST_CHECKSUM(accumulate, udp->check);
+		}
 	    }
 	}
     }
@@ -41,9 +41,28 @@ struct client_nat_entry {
   in_addr_t foreign_network;
 };
 
+/*
+ * The rules which apply to one address of a packet in one
+ * direction, compiled into sorted, non-overlapping ranges of
+ * host order addresses.  Each range maps to the first rule,
+ * in list order, which matches it.
+ */
+#define CN_SADDR 0
+#define CN_DADDR 1
+
+struct client_nat_table {
+  bool linear;                              /* a rule has a non-contiguous netmask, walk the list */
+  int n;                                    /* number of ranges */
+  in_addr_t start[MAX_CLIENT_NAT*2+1];      /* first address of each range */
+  signed char rule[MAX_CLIENT_NAT*2+1];     /* index into entries, -1 if no rule matches */
+};
+
 struct client_nat_option_list {
   int n;
   struct client_nat_entry entries[MAX_CLIENT_NAT];
+
+  /* indexed by direction and CN_SADDR/CN_DADDR, rebuilt on each add */
+  struct client_nat_table tables[2][2];
 };
 
 struct client_nat_option_list *new_client_nat_list (struct gc_arena *gc);
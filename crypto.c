@@ -82,9 +82,10 @@ openvpn_encrypt (struct buffer *buf, struct buffer work,
     {
       struct key_ctx *ctx = &opt->key_ctx_bi->encrypt;
 
-      /* Do Encrypt from buf -> work */
+      /* Do Encrypt from buf -> work, or in place if work is buf's storage */
       if (ctx->cipher)
 	{
+	  const bool in_place = (work.data == buf->data);
 	  uint8_t iv_buf[EVP_MAX_IV_LENGTH];
 	  const int iv_size = EVP_CIPHER_CTX_iv_length (ctx->cipher);
 	  const unsigned int mode = EVP_CIPHER_CTX_mode (ctx->cipher);  
@@ -124,8 +125,18 @@ openvpn_encrypt (struct buffer *buf, struct buffer work,
 	      ASSERT (0);
 	    }
 
-	  /* initialize work buffer with FRAME_HEADROOM bytes of prepend capacity */
-	  ASSERT (buf_init (&work, FRAME_HEADROOM (frame)));
+	  if (in_place)
+	    {
+	      /* ciphertext overwrites plaintext, the IV goes into buf's headroom */
+	      work.offset = buf->offset;
+	      work.len = 0;
+	    }
+	  else
+	    {
+	      /* initialize work buffer with FRAME_HEADROOM bytes of prepend capacity */
+	      ASSERT (buf_init (&work, FRAME_HEADROOM (frame)));
+	      BUF_COPY_ACCOUNT (BLEN (buf));
+	    }
 
 	  /* set the IV pseudo-randomly */
 	  if (opt->flags & CO_USE_IV)
@@ -388,7 +388,10 @@ void free_key_ctx_bi (struct key_ctx_bi *ctx);
  *
  * @param buf          - The %buffer containing the packet on which to
  *                       perform security operations.
- * @param work         - A working %buffer.
+ * @param work         - A working %buffer.  If it refers to the same
+ *                       storage as \a buf, the packet is encrypted in
+ *                       place, using the headroom and tailroom of \a buf
+ *                       for the IV, HMAC and cipher padding.
  * @param opt          - The security parameter state for this VPN tunnel.
  * @param frame        - The packet geometry parameters for this VPN
  *                       tunnel.
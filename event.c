@@ -27,6 +27,7 @@
 #include "buffer.h"
 #include "error.h"
 #include "integer.h"
+#include "misc.h"
 #include "event.h"
 
 #include "memdbg.h"
@@ -459,6 +460,27 @@ we_init (int *maxevents, unsigned int flags)
 
 #if EPOLL
 
+/*
+ * What we last told the kernel about a descriptor, so that
+ * the event loop re-asserting unchanged interest on every
+ * iteration doesn't cost an epoll_ctl call each time.
+ *
+ * Only trusted in scalable mode, where descriptors must be
+ * removed with event_del before they are closed.  Fast mode
+ * callers need not delete, so a closed descriptor may be silently
+ * dropped by the kernel while its entry here stays behind,
+ * and a new descriptor with the same number and identical
+ * interest would never be registered.  There every ep_ctl
+ * goes to the kernel, and EPOLL_CTL_MOD failing with ENOENT
+ * falls back to EPOLL_CTL_ADD.
+ */
+struct ep_fd
+{
+  void *arg;
+  unsigned int events;
+  bool registered;
+};
+
 struct ep_set
 {
   struct event_set_functions func;
@@ -466,17 +488,58 @@ struct ep_set
   int epfd;
   int maxevents;
   struct epoll_event *events;
+
+  /* registered interest, indexed by fd */
+  struct ep_fd *fds;
+  int capacity;
+
+  struct event_set_stats stats;
 };
 
+/*
+ * Make sure that the fd table can be indexed by fd.
+ */
+static bool
+ep_reserve (struct ep_set *eps, int fd)
+{
+  if (fd < 0)
+    return false;
+  if (fd >= eps->capacity)
+    {
+      const int capacity = (int) adjust_power_of_2 (fd + 1);
+      struct ep_fd *fds;
+
+      ALLOC_ARRAY_CLEAR (fds, struct ep_fd, capacity);
+      if (eps->fds)
+	{
+	  memcpy (fds, eps->fds, sizeof (struct ep_fd) * eps->capacity);
+	  free (eps->fds);
+	}
+      eps->fds = fds;
+      eps->capacity = capacity;
+    }
+  return true;
+}
+
 static void
 ep_free (struct event_set *es)
 {
   struct ep_set *eps = (struct ep_set *) es;
+  dmsg (D_EVENT_WAIT, "EP_FREE ctl=" counter_format " epoll_ctl=" counter_format,
+	eps->stats.ctl, eps->stats.ctl_kernel);
   close (eps->epfd);
   free (eps->events);
+  free (eps->fds);
   free (eps);
 }
 
+static void
+ep_stats (const struct event_set *es, struct event_set_stats *stats)
+{
+  const struct ep_set *eps = (const struct ep_set *) es;
+  *stats = eps->stats;
+}
+
 static void
 ep_reset (struct event_set *es)
 {
@@ -492,7 +555,17 @@ ep_del (struct event_set *es, event_t event)
 
   dmsg (D_EVENT_WAIT, "EP_DEL ev=%d", (int)event);
 
-  ASSERT (!eps->fast);
+  ++eps->stats.ctl;
+  if (event >= 0 && event < eps->capacity)
+    {
+      struct ep_fd *f = &eps->fds[event];
+      if (!f->registered)
+	return;
+      f->registered = false;
+      f->events = 0;
+      f->arg = NULL;
+    }
+  ++eps->stats.ctl_kernel;
   CLEAR (ev);
   epoll_ctl (eps->epfd, EPOLL_CTL_DEL, event, &ev);
 }
@@ -502,6 +575,7 @@ ep_ctl (struct event_set *es, event_t event, unsigned int rwflags, void *arg)
 {
   struct ep_set *eps = (struct ep_set *) es;
   struct epoll_event ev;
+  struct ep_fd *f = NULL;
 
   CLEAR (ev);
 
@@ -511,21 +585,42 @@ ep_ctl (struct event_set *es, event_t event, unsigned int rwflags, void *arg)
   if (rwflags & EVENT_WRITE)
     ev.events |= EPOLLOUT;
 
+  ++eps->stats.ctl;
+  if (ep_reserve (eps, event))
+    {
+      f = &eps->fds[event];
+      if (!eps->fast && f->registered && f->events == ev.events && f->arg == arg)
+	return;
+    }
+
   dmsg (D_EVENT_WAIT, "EP_CTL fd=%d rwflags=0x%04x ev=0x%08x arg=" ptr_format,
        (int)event,
        rwflags,
        (unsigned int)ev.events,
        (ptr_type)ev.data.ptr);
 
-  if (epoll_ctl (eps->epfd, EPOLL_CTL_MOD, event, &ev) < 0)
+  ++eps->stats.ctl_kernel;
+  if (epoll_ctl (eps->epfd, (f && !f->registered) ? EPOLL_CTL_ADD : EPOLL_CTL_MOD, event, &ev) < 0)
     {
       if (errno == ENOENT)
 	{
 	  if (epoll_ctl (eps->epfd, EPOLL_CTL_ADD, event, &ev) < 0)
 	    msg (M_ERR, "EVENT: epoll_ctl EPOLL_CTL_ADD failed, sd=%d", (int)event);
 	}
+      else if (errno == EEXIST)
+	{
+	  if (epoll_ctl (eps->epfd, EPOLL_CTL_MOD, event, &ev) < 0)
+	    msg (M_ERR, "EVENT: epoll_ctl EPOLL_CTL_MOD failed, sd=%d", (int)event);
+	}
       else
-	msg (M_ERR, "EVENT: epoll_ctl EPOLL_CTL_MOD failed, sd=%d", (int)event);
+	msg (M_ERR, "EVENT: epoll_ctl failed, sd=%d", (int)event);
+    }
+
+  if (f)
+    {
+      f->registered = true;
+      f->events = ev.events;
+      f->arg = arg;
     }
 }
 
@@ -584,6 +679,7 @@ ep_init (int *maxevents, unsigned int flags)
   eps->func.del = ep_del;
   eps->func.ctl = ep_ctl;
   eps->func.wait = ep_wait;
+  eps->func.stats = ep_stats;
 
   /* fast method ("sort of") corresponds to epoll one-shot */
   if (flags & EVENT_METHOD_FAST)
@@ -601,6 +697,503 @@ ep_init (int *maxevents, unsigned int flags)
 }
 #endif /* EPOLL */
 
+#if IO_URING
+
+/*
+ * io_uring backend, selected by --io-uring-poll.
+ *
+ * Only the readiness wait goes through io_uring: the event
+ * loop still reads and writes with ordinary system calls, so
+ * each registered descriptor gets a one-shot IORING_OP_POLL_ADD.
+ * The difference from epoll is that interest changes are only
+ * queued in the submission ring, and submitted together with
+ * the wait in a single io_uring_enter() call, so a loop
+ * iteration costs one system call regardless of how many
+ * descriptors changed their read/write interest.  Descriptors
+ * whose interest did not change keep their pending poll and
+ * cost nothing at all.
+ *
+ * Level-triggered semantics are emulated by re-arming a poll
+ * on the next wait after it has fired.
+ */
+
+/* user_data tags for requests which are not per-descriptor polls */
+#define UR_DATA_TIMEOUT  (~(uint64_t)0)
+#define UR_DATA_REMOVE   (~(uint64_t)1)
+
+#define UR_MAX_ENTRIES   4096
+
+struct ur_fd
+{
+  void *arg;
+  unsigned int rwflags;  /* desired interest */
+  unsigned int armed;    /* poll mask of pending POLL_ADD, 0 if none */
+  unsigned int gen;      /* generation, to discard stale completions */
+  bool dirty;            /* on dirty list */
+};
+
+struct ur_set
+{
+  struct event_set_functions func;
+  bool fast;
+  int ring_fd;
+
+  /* submission ring */
+  void *sq_ptr;
+  size_t sq_size;
+  unsigned int *sq_head;
+  unsigned int *sq_tail;
+  unsigned int *sq_mask;
+  unsigned int *sq_entries;
+  unsigned int *sq_array;
+  struct io_uring_sqe *sqes;
+  size_t sqes_size;
+
+  /* completion ring */
+  void *cq_ptr;
+  size_t cq_size;
+  unsigned int *cq_head;
+  unsigned int *cq_tail;
+  unsigned int *cq_mask;
+  struct io_uring_cqe *cqes;
+
+  struct __kernel_timespec timeout;
+
+  /* per-descriptor state, indexed by fd */
+  struct ur_fd *fds;
+  int maxfd;
+  int capacity;
+
+  /* descriptors whose interest may differ from their pending poll */
+  int *dirty;
+  int n_dirty;
+
+  struct event_set_stats stats;
+};
+
+static inline int
+ur_setup (unsigned int entries, struct io_uring_params *p)
+{
+  return (int) syscall (__NR_io_uring_setup, entries, p);
+}
+
+static inline int
+ur_enter (int fd, unsigned int to_submit, unsigned int min_complete, unsigned int flags)
+{
+  return (int) syscall (__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static inline unsigned int
+ur_sq_pending (const struct ur_set *urs)
+{
+  return *urs->sq_tail - __atomic_load_n (urs->sq_head, __ATOMIC_ACQUIRE);
+}
+
+static inline uint64_t
+ur_user_data (int fd, unsigned int gen)
+{
+  return ((uint64_t)gen << 32) | (uint32_t)fd;
+}
+
+static inline unsigned int
+ur_poll_mask (unsigned int rwflags)
+{
+  unsigned int mask = 0;
+  if (rwflags & EVENT_READ)
+    mask |= (POLLIN|POLLPRI);
+  if (rwflags & EVENT_WRITE)
+    mask |= POLLOUT;
+  return mask;
+}
+
+/*
+ * Get a free submission queue entry, flushing the
+ * ring to the kernel first if it is full.
+ */
+static struct io_uring_sqe *
+ur_get_sqe (struct ur_set *urs)
+{
+  struct io_uring_sqe *sqe;
+  unsigned int tail = *urs->sq_tail;
+
+  if (ur_sq_pending (urs) >= *urs->sq_entries)
+    {
+      if (ur_enter (urs->ring_fd, ur_sq_pending (urs), 0, 0) < 0)
+	msg (M_ERR, "EVENT: io_uring_enter submit failed");
+    }
+
+  sqe = &urs->sqes[tail & *urs->sq_mask];
+  CLEAR (*sqe);
+  urs->sq_array[tail & *urs->sq_mask] = tail & *urs->sq_mask;
+  __atomic_store_n (urs->sq_tail, tail + 1, __ATOMIC_RELEASE);
+  return sqe;
+}
+
+static void
+ur_queue_poll_add (struct ur_set *urs, int fd, unsigned int mask, uint64_t user_data)
+{
+  struct io_uring_sqe *sqe = ur_get_sqe (urs);
+  sqe->opcode = IORING_OP_POLL_ADD;
+  sqe->fd = fd;
+#if __BYTE_ORDER == __BIG_ENDIAN
+  mask = (mask << 16) | (mask >> 16);
+#endif
+  sqe->poll32_events = mask;
+  sqe->user_data = user_data;
+}
+
+static void
+ur_queue_poll_remove (struct ur_set *urs, uint64_t user_data)
+{
+  struct io_uring_sqe *sqe = ur_get_sqe (urs);
+  sqe->opcode = IORING_OP_POLL_REMOVE;
+  sqe->fd = -1;
+  sqe->addr = user_data;
+  sqe->user_data = UR_DATA_REMOVE;
+}
+
+static void
+ur_mark_dirty (struct ur_set *urs, int fd)
+{
+  struct ur_fd *f = &urs->fds[fd];
+  if (!f->dirty)
+    {
+      f->dirty = true;
+      urs->dirty[urs->n_dirty++] = fd;
+    }
+}
+
+/*
+ * Make sure that the fd table can be indexed by fd.
+ */
+static bool
+ur_reserve (struct ur_set *urs, int fd)
+{
+  if (fd < 0)
+    return false;
+  if (fd >= urs->capacity)
+    {
+      const int capacity = (int) adjust_power_of_2 (fd + 1);
+      struct ur_fd *fds;
+      int *dirty;
+
+      ALLOC_ARRAY_CLEAR (fds, struct ur_fd, capacity);
+      ALLOC_ARRAY (dirty, int, capacity);
+      if (urs->fds)
+	{
+	  memcpy (fds, urs->fds, sizeof (struct ur_fd) * urs->capacity);
+	  memcpy (dirty, urs->dirty, sizeof (int) * urs->n_dirty);
+	  free (urs->fds);
+	  free (urs->dirty);
+	}
+      urs->fds = fds;
+      urs->dirty = dirty;
+      urs->capacity = capacity;
+    }
+  urs->maxfd = max_int (fd, urs->maxfd);
+  return true;
+}
+
+static void
+ur_free (struct event_set *es)
+{
+  struct ur_set *urs = (struct ur_set *) es;
+  munmap (urs->sqes, urs->sqes_size);
+  munmap (urs->cq_ptr, urs->cq_size);
+  munmap (urs->sq_ptr, urs->sq_size);
+  close (urs->ring_fd);
+  free (urs->fds);
+  free (urs->dirty);
+  free (urs);
+}
+
+static void
+ur_stats (const struct event_set *es, struct event_set_stats *stats)
+{
+  const struct ur_set *urs = (const struct ur_set *) es;
+  *stats = urs->stats;
+}
+
+static void
+ur_reset (struct event_set *es)
+{
+  struct ur_set *urs = (struct ur_set *) es;
+  int i;
+
+  ASSERT (urs->fast);
+
+  dmsg (D_EVENT_WAIT, "UR_RESET");
+
+  /*
+   * Pending polls are left alone here, the following
+   * ur_ctl calls will usually restore the same interest.
+   */
+  for (i = 0; i <= urs->maxfd; ++i)
+    {
+      struct ur_fd *f = &urs->fds[i];
+      if (f->rwflags)
+	{
+	  f->rwflags = 0;
+	  f->arg = NULL;
+	  ur_mark_dirty (urs, i);
+	}
+    }
+}
+
+static void
+ur_del (struct event_set *es, event_t event)
+{
+  struct ur_set *urs = (struct ur_set *) es;
+
+  dmsg (D_EVENT_WAIT, "UR_DEL ev=%d", (int)event);
+
+  ++urs->stats.ctl;
+  if (event >= 0 && event < urs->capacity)
+    {
+      struct ur_fd *f = &urs->fds[event];
+
+      /*
+       * The kernel holds a reference on the file while a
+       * poll is pending, and resolved the descriptor when
+       * the poll was submitted.  Submit its removal now,
+       * before the caller closes the descriptor, so that
+       * the file is released and a new file given the same
+       * number gets a poll of its own.
+       */
+      if (f->armed)
+	{
+	  ur_queue_poll_remove (urs, ur_user_data (event, f->gen));
+	  f->armed = 0;
+	  ++urs->stats.ctl_kernel;
+	  if (ur_enter (urs->ring_fd, ur_sq_pending (urs), 0, 0) < 0)
+	    msg (D_EVENT_ERRORS|M_ERRNO, "EVENT: io_uring_enter submit failed");
+	}
+      ++f->gen;
+      f->rwflags = 0;
+      f->arg = NULL;
+    }
+}
+
+static void
+ur_ctl (struct event_set *es, event_t event, unsigned int rwflags, void *arg)
+{
+  struct ur_set *urs = (struct ur_set *) es;
+
+  dmsg (D_EVENT_WAIT, "UR_CTL fd=%d rwflags=0x%04x arg=" ptr_format,
+       (int)event,
+       rwflags,
+       (ptr_type)arg);
+
+  ++urs->stats.ctl;
+  if (ur_reserve (urs, event))
+    {
+      struct ur_fd *f = &urs->fds[event];
+      if (urs->fast)
+	f->rwflags |= rwflags;
+      else
+	f->rwflags = rwflags;
+      f->arg = arg;
+      if (ur_poll_mask (f->rwflags) != f->armed)
+	ur_mark_dirty (urs, event);
+    }
+  else
+    msg (D_EVENT_ERRORS, "Error: io_uring: bad descriptor %d", (int)event);
+}
+
+/*
+ * Bring the pending polls in line with the
+ * interest registered through ur_ctl.
+ */
+static void
+ur_update (struct ur_set *urs)
+{
+  int i;
+  for (i = 0; i < urs->n_dirty; ++i)
+    {
+      const int fd = urs->dirty[i];
+      struct ur_fd *f = &urs->fds[fd];
+      const unsigned int mask = ur_poll_mask (f->rwflags);
+
+      f->dirty = false;
+      if (mask != f->armed)
+	{
+	  ++urs->stats.ctl_kernel;
+	  if (f->armed)
+	    ur_queue_poll_remove (urs, ur_user_data (fd, f->gen));
+	  ++f->gen;
+	  f->armed = mask;
+	  if (mask)
+	    ur_queue_poll_add (urs, fd, mask, ur_user_data (fd, f->gen));
+	}
+    }
+  urs->n_dirty = 0;
+}
+
+static int
+ur_wait (struct event_set *es, const struct timeval *tv, struct event_set_return *out, int outlen)
+{
+  struct ur_set *urs = (struct ur_set *) es;
+  unsigned int head;
+  int j = 0;
+
+  ur_update (urs);
+
+  /* wait only if no completions are already queued */
+  head = *urs->cq_head;
+  if (head == __atomic_load_n (urs->cq_tail, __ATOMIC_ACQUIRE)
+      && (tv->tv_sec || tv->tv_usec))
+    {
+      struct io_uring_sqe *sqe = ur_get_sqe (urs);
+      urs->timeout.tv_sec = tv->tv_sec;
+      urs->timeout.tv_nsec = tv->tv_usec * 1000;
+      sqe->opcode = IORING_OP_TIMEOUT;
+      sqe->fd = -1;
+      sqe->addr = (uint64_t)(uintptr_t) &urs->timeout;
+      sqe->len = 1;
+      sqe->off = 1; /* also complete on the first other completion */
+      sqe->user_data = UR_DATA_TIMEOUT;
+
+      if (ur_enter (urs->ring_fd, ur_sq_pending (urs), 1, IORING_ENTER_GETEVENTS) < 0)
+	return -1;
+    }
+  else if (ur_sq_pending (urs))
+    {
+      if (ur_enter (urs->ring_fd, ur_sq_pending (urs), 0, 0) < 0)
+	return -1;
+    }
+
+  /*
+   * Drain the completion ring completely.  Events which
+   * don't fit into out are not lost, since their
+   * descriptors are re-armed and will fire again.
+   */
+  head = *urs->cq_head;
+  while (head != __atomic_load_n (urs->cq_tail, __ATOMIC_ACQUIRE))
+    {
+      const struct io_uring_cqe *cqe = &urs->cqes[head & *urs->cq_mask];
+      const uint64_t user_data = cqe->user_data;
+
+      if (user_data != UR_DATA_TIMEOUT && user_data != UR_DATA_REMOVE)
+	{
+	  const int fd = (int)(uint32_t)user_data;
+	  const unsigned int gen = (unsigned int)(user_data >> 32);
+
+	  if (fd >= 0 && fd < urs->capacity && urs->fds[fd].gen == gen && urs->fds[fd].armed)
+	    {
+	      struct ur_fd *f = &urs->fds[fd];
+	      const unsigned int revents = cqe->res < 0 ? POLLERR : (unsigned int)cqe->res;
+
+	      f->armed = 0;
+	      if (f->rwflags)
+		{
+		  ur_mark_dirty (urs, fd);
+		  if (j < outlen)
+		    {
+		      out->rwflags = 0;
+		      if (revents & (POLLIN|POLLPRI|POLLERR|POLLHUP))
+			out->rwflags |= EVENT_READ;
+		      if (revents & POLLOUT)
+			out->rwflags |= EVENT_WRITE;
+		      out->arg = f->arg;
+		      dmsg (D_EVENT_WAIT, "UR_WAIT[%d] fd=%d rev=0x%08x rwflags=0x%04x arg=" ptr_format,
+			   j, fd, revents, out->rwflags, (ptr_type)out->arg);
+		      ++out;
+		      ++j;
+		    }
+		}
+	    }
+	}
+      ++head;
+    }
+  __atomic_store_n (urs->cq_head, head, __ATOMIC_RELEASE);
+
+  return j;
+}
+
+static struct event_set *
+ur_init (int *maxevents, unsigned int flags)
+{
+  struct io_uring_params p;
+  struct ur_set *urs;
+  unsigned int entries;
+  int fd;
+
+  dmsg (D_EVENT_WAIT, "UR_INIT maxevents=%d flags=0x%08x", *maxevents, flags);
+
+  /*
+   * Between two waits a descriptor can complete its pending
+   * poll, or have it cancelled, which completes both the poll
+   * and the POLL_REMOVE, and then complete the poll armed in
+   * its place: three completions, plus one for our timeout.
+   */
+  ASSERT (*maxevents > 0);
+  entries = adjust_power_of_2 (min_int (*maxevents + 1, UR_MAX_ENTRIES));
+  CLEAR (p);
+  p.flags = IORING_SETUP_CQSIZE;
+  p.cq_entries = adjust_power_of_2 (*maxevents * 3 + 1);
+
+  fd = ur_setup (entries, &p);
+  if (fd < 0)
+    return NULL;
+
+  ALLOC_OBJ_CLEAR (urs, struct ur_set);
+  urs->ring_fd = fd;
+
+  urs->sq_size = p.sq_off.array + p.sq_entries * sizeof (unsigned int);
+  urs->cq_size = p.cq_off.cqes + p.cq_entries * sizeof (struct io_uring_cqe);
+  urs->sqes_size = p.sq_entries * sizeof (struct io_uring_sqe);
+
+  urs->sq_ptr = mmap (NULL, urs->sq_size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE,
+		      fd, IORING_OFF_SQ_RING);
+  urs->cq_ptr = mmap (NULL, urs->cq_size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE,
+		      fd, IORING_OFF_CQ_RING);
+  urs->sqes = mmap (NULL, urs->sqes_size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE,
+		    fd, IORING_OFF_SQES);
+  if (urs->sq_ptr == MAP_FAILED || urs->cq_ptr == MAP_FAILED || urs->sqes == MAP_FAILED)
+    {
+      msg (M_WARN|M_ERRNO, "EVENT: io_uring ring mmap failed");
+      if (urs->sq_ptr != MAP_FAILED)
+	munmap (urs->sq_ptr, urs->sq_size);
+      if (urs->cq_ptr != MAP_FAILED)
+	munmap (urs->cq_ptr, urs->cq_size);
+      if (urs->sqes != MAP_FAILED)
+	munmap (urs->sqes, urs->sqes_size);
+      close (fd);
+      free (urs);
+      return NULL;
+    }
+
+  urs->sq_head = (unsigned int *) ((uint8_t *)urs->sq_ptr + p.sq_off.head);
+  urs->sq_tail = (unsigned int *) ((uint8_t *)urs->sq_ptr + p.sq_off.tail);
+  urs->sq_mask = (unsigned int *) ((uint8_t *)urs->sq_ptr + p.sq_off.ring_mask);
+  urs->sq_entries = (unsigned int *) ((uint8_t *)urs->sq_ptr + p.sq_off.ring_entries);
+  urs->sq_array = (unsigned int *) ((uint8_t *)urs->sq_ptr + p.sq_off.array);
+  urs->cq_head = (unsigned int *) ((uint8_t *)urs->cq_ptr + p.cq_off.head);
+  urs->cq_tail = (unsigned int *) ((uint8_t *)urs->cq_ptr + p.cq_off.tail);
+  urs->cq_mask = (unsigned int *) ((uint8_t *)urs->cq_ptr + p.cq_off.ring_mask);
+  urs->cqes = (struct io_uring_cqe *) ((uint8_t *)urs->cq_ptr + p.cq_off.cqes);
+
+  /* set dispatch functions */
+  urs->func.free = ur_free;
+  urs->func.reset = ur_reset;
+  urs->func.del = ur_del;
+  urs->func.ctl = ur_ctl;
+  urs->func.wait = ur_wait;
+  urs->func.stats = ur_stats;
+
+  if (flags & EVENT_METHOD_FAST)
+    urs->fast = true;
+
+  /* descriptor table grows on demand in ur_reserve */
+  urs->maxfd = -1;
+  urs->capacity = 64;
+  ALLOC_ARRAY_CLEAR (urs->fds, struct ur_fd, urs->capacity);
+  ALLOC_ARRAY (urs->dirty, int, urs->capacity);
+
+  return (struct event_set *) urs;
+}
+#endif /* IO_URING */
+
 #if POLL
 
 struct po_set
@@ -638,7 +1231,6 @@ po_del (struct event_set *es, event_t event)
 
   dmsg (D_EVENT_WAIT, "PO_DEL ev=%d", (int)event);
 
-  ASSERT (!pos->fast);
   for (i = 0; i < pos->n_events; ++i)
     {
       if (pos->events[i].fd == event)
@@ -834,7 +1426,6 @@ static void
 se_del (struct event_set *es, event_t event)
 {
   struct se_set *ses = (struct se_set *) es;
-  ASSERT (!ses->fast);
 
   dmsg (D_EVENT_WAIT, "SE_DEL ev=%d", (int)event);
 
@@ -1048,6 +1639,18 @@ event_set_init_scalable (int *maxevents, unsigned int flags)
 struct event_set *
 event_set_init (int *maxevents, unsigned int flags)
 {
+  if (flags & EVENT_METHOD_IO_URING_POLL)
+    {
+#if IO_URING
+      struct event_set *ret = ur_init (maxevents, flags);
+      if (ret)
+	return ret;
+      msg (M_WARN|M_ERRNO, "Note: io_uring API is unavailable, falling back to epoll/poll/select API");
+#else
+      msg (M_WARN, "Note: io_uring support was not compiled in, falling back to epoll/poll/select API");
+#endif
+    }
+
   if (flags & EVENT_METHOD_FAST)
     return event_set_init_simple (maxevents, flags);
   else
@@ -25,6 +25,7 @@
 #ifndef EVENT_H
 #define EVENT_H
 
+#include "common.h"
 #include "win32.h"
 #include "sig.h"
 #include "perf.h"
@@ -41,6 +42,7 @@
  */
 #define EVENT_METHOD_US_TIMEOUT   (1<<0)
 #define EVENT_METHOD_FAST         (1<<1)
+#define EVENT_METHOD_IO_URING_POLL (1<<2) /* prefer io_uring polls where available */
 
 #ifdef WIN32
 
@@ -59,12 +61,23 @@ typedef int event_t;
 struct event_set;
 struct event_set_return;
 
+/*
+ * Interest set statistics, kept by implementations which
+ * register interest with the kernel (epoll, io_uring).
+ */
+struct event_set_stats
+{
+  counter_type ctl;         /* event_ctl/event_del calls */
+  counter_type ctl_kernel;  /* ... which had to be passed to the kernel */
+};
+
 struct event_set_functions
 {
   void (*free)(struct event_set *es);
   void (*reset)(struct event_set *es);
   void (*del)(struct event_set *es, event_t event);
   void (*ctl)(struct event_set *es, event_t event, unsigned int rwflags, void *arg);
+  void (*stats)(const struct event_set *es, struct event_set_stats *stats); /* optional */
 
   /*
    * Return status for wait:
@@ -130,6 +143,17 @@ event_wait (struct event_set *es, const struct timeval *tv, struct event_set_ret
   return ret;
 }
 
+static inline bool
+event_get_stats (const struct event_set *es, struct event_set_stats *stats)
+{
+  if (es && es->func.stats)
+    {
+      (*es->func.stats)(es, stats);
+      return true;
+    }
+  return false;
+}
+
 static inline void
 event_set_return_init (struct event_set_return *esr)
 {
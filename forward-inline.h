@@ -118,6 +118,19 @@ check_inactivity_timeout (struct context *c)
     check_inactivity_timeout_dowork (c);
 }
 
+/*
+ * Should a server instance free its idle buffers?
+ */
+static inline void
+check_idle_release (struct context *c)
+{
+  void check_idle_release_dowork (struct context *c);
+
+  if (event_timeout_defined (&c->c2.idle_release_interval)
+      && event_timeout_trigger (&c->c2.idle_release_interval, &c->c2.timeval, ETT_DEFAULT))
+    check_idle_release_dowork (c);
+}
+
 #if P2MP
 
 static inline void
@@ -248,6 +261,21 @@ register_activity (struct context *c, const int size)
     }
 }
 
+/*
+ * Tunnel data for a hibernated client, rebuild its TLS session.
+ */
+static inline void
+check_hibernate_wake (struct context *c)
+{
+#if P2MP_SERVER
+  if (c->c2.tls_multi && tls_multi_hibernated (c->c2.tls_multi))
+    {
+      tls_multi_wake (c->c2.tls_multi);
+      interval_action (&c->c2.tmp_int);
+    }
+#endif
+}
+
 /*
  * Return the io_wait() flags appropriate for
  * a point-to-point tunnel.
@@ -256,9 +284,9 @@ static inline unsigned int
 p2p_iow_flags (const struct context *c)
 {
   unsigned int flags = (IOW_SHAPER|IOW_CHECK_RESIDUAL|IOW_FRAG|IOW_READ|IOW_WAIT_SIGNAL);
-  if (c->c2.to_link.len > 0)
+  if (c->c2.to_link.len > 0 || (c->c2.burst_flags & BURST_TO_LINK))
     flags |= IOW_TO_LINK;
-  if (c->c2.to_tun.len > 0)
+  if (c->c2.to_tun.len > 0 || (c->c2.burst_flags & BURST_TO_TUN))
     flags |= IOW_TO_TUN;
   return flags;
 }
@@ -272,7 +300,7 @@ io_wait (struct context *c, const unsigned int flags)
 {
   void io_wait_dowork (struct context *c, const unsigned int flags);
 
-  if (c->c2.fast_io && (flags & (IOW_TO_TUN|IOW_TO_LINK|IOW_MBUF)))
+  if (c->c2.fast_io && !c->c2.burst_flags && (flags & (IOW_TO_TUN|IOW_TO_LINK|IOW_MBUF)))
     {
       /* fast path -- only for TUN/TAP/UDP writes */
       unsigned int ret = 0;
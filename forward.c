@@ -318,6 +318,31 @@ check_inactivity_timeout_dowork (struct context *c)
   register_signal (c, SIGTERM, "inactive");
 }
 
+/*
+ * Release per-client buffers if no tun/tap traffic
+ * passed since the last check.
+ */
+void
+check_idle_release_dowork (struct context *c)
+{
+  const counter_type bytes = c->c2.tun_read_bytes + c->c2.tun_write_bytes;
+
+  if (bytes == c->c2.idle_release_bytes)
+    {
+      context_release_idle (c);
+#if P2MP_SERVER
+      if (c->options.hibernate_seconds
+	  && c->c2.tls_multi
+	  && now >= c->c2.idle_since + c->options.hibernate_seconds
+	  && !tls_multi_hibernated (c->c2.tls_multi))
+	tls_multi_hibernate (c->c2.tls_multi);
+#endif
+    }
+  else
+    c->c2.idle_since = now;
+  c->c2.idle_release_bytes = bytes;
+}
+
 #if P2MP
 
 void
@@ -400,11 +425,13 @@ check_fragment_dowork (struct context *c)
 
 /*
  * Buffer reallocation, for use with null encryption.
+ * orig_buf may be NULL if the packet already lives in
+ * storage which is kept intact until it has been sent.
  */
 static inline void
 buffer_turnover (const uint8_t *orig_buf, struct buffer *dest_stub, struct buffer *src_stub, struct buffer *storage)
 {
-  if (orig_buf == src_stub->data && src_stub->data != storage->data)
+  if (orig_buf && orig_buf == src_stub->data && src_stub->data != storage->data)
     {
       buf_assign (storage, src_stub);
       *dest_stub = *storage;
@@ -417,14 +444,19 @@ buffer_turnover (const uint8_t *orig_buf, struct buffer *dest_stub, struct buffe
 
 /*
  * Compress, fragment, encrypt and HMAC-sign an outgoing packet.
+ * features is a constant in each of the variants generated
+ * below, letting the compiler drop the stages not configured.
  * Input: c->c2.buf
  * Output: c->c2.to_link
  */
-void
-encrypt_sign (struct context *c, bool comp_frag)
+static inline void
+encrypt_sign_dowork (struct context *c, bool comp_frag, const unsigned int features)
 {
-  struct context_buffers *b = c->c2.buffers;
+  struct context_buffers *b = get_context_buffers (c);
   const uint8_t *orig_buf = c->c2.buf.data;
+#ifdef USE_CRYPTO
+  struct buffer work;
+#endif
 
 #if P2MP_SERVER
   /*
@@ -439,14 +471,21 @@ encrypt_sign (struct context *c, bool comp_frag)
     {
 #ifdef USE_LZO
       /* Compress the packet. */
-      if (lzo_defined (&c->c2.lzo_compwork))
+      if (features & DP_LZO)
 	lzo_compress (&c->c2.buf, b->lzo_compress_buf, &c->c2.lzo_compwork, &c->c2.frame);
 #endif
 #ifdef ENABLE_FRAGMENT
-      if (c->c2.fragment)
+      if (features & DP_FRAGMENT)
 	fragment_outgoing (c->c2.fragment, &c->c2.buf, &c->c2.frame_fragment);
 #endif
     }
+#ifdef ENABLE_FRAGMENT
+  else if ((features & DP_FRAGMENT) && c->c2.buf.data == c->c2.fragment->outgoing.data)
+    {
+      /* the fragment buffer is left alone until this part has been sent */
+      orig_buf = NULL;
+    }
+#endif
 
 #ifdef USE_CRYPTO
 #ifdef USE_SSL
@@ -454,7 +493,7 @@ encrypt_sign (struct context *c, bool comp_frag)
    * If TLS mode, get the key we will use to encrypt
    * the packet.
    */
-  if (c->c2.tls_multi)
+  if (features & DP_TLS)
     {
       tls_pre_encrypt (c->c2.tls_multi, &c->c2.buf, &c->c2.crypto_options);
     }
@@ -462,9 +501,21 @@ encrypt_sign (struct context *c, bool comp_frag)
 
   /*
    * Encrypt the packet and write an optional
-   * HMAC signature.
+   * HMAC signature.  Packets in our own read_tun_buf
+   * or lzo_compress_buf are encrypted in place, since
+   * those buffers are laid out with enough headroom and
+   * tailroom for the whole frame.  Everything else,
+   * including fragments which are followed by the
+   * next part, goes through encrypt_buf.
    */
-  openvpn_encrypt (&c->c2.buf, b->encrypt_buf, &c->c2.crypto_options, &c->c2.frame);
+  work = b->encrypt_buf;
+  if (c->c2.buf.data == b->read_tun_buf.data)
+    work = c->c2.buf;
+#ifdef USE_LZO
+  else if ((features & DP_LZO) && c->c2.buf.data == b->lzo_compress_buf.data)
+    work = c->c2.buf;
+#endif
+  openvpn_encrypt (&c->c2.buf, work, &c->c2.crypto_options, &c->c2.frame);
 #endif
   /*
    * Get the address we will be sending the packet to.
@@ -480,7 +531,7 @@ encrypt_sign (struct context *c, bool comp_frag)
    * the key-id to the recipient so it knows which
    * decrypt key to use.
    */
-  if (c->c2.tls_multi)
+  if (features & DP_TLS)
     {
       tls_post_encrypt (c->c2.tls_multi, &c->c2.buf);
     }
@@ -526,6 +577,9 @@ process_coarse_timers (struct context *c)
   if (c->sig->signal_received)
     return;
 
+  /* free buffers of an idle server instance */
+  check_idle_release (c);
+
   /* restart if ping not received */
   check_ping_restart (c);
   if (c->sig->signal_received)
@@ -661,7 +715,7 @@ read_incoming_link (struct context *c)
 
   perf_push (PERF_READ_IN_LINK);
 
-  c->c2.buf = c->c2.buffers->read_link_buf;
+  c->c2.buf = get_context_buffers (c)->read_link_buf;
   ASSERT (buf_init (&c->c2.buf, FRAME_HEADROOM_ADJ (&c->c2.frame, FRAME_HEADROOM_MARKER_READ_LINK)));
 
   status = link_socket_read (c->c2.link_socket,
@@ -720,29 +774,28 @@ read_incoming_link (struct context *c)
 }
 
 /*
- * Input:  c->c2.buf
- * Output: c->c2.to_tun
+ * First half of process_incoming_link: account for, authenticate,
+ * decrypt and replay-check the packet in buf.  work is the decrypt
+ * buffer to use, NULL for the context's own.  Returns false if there
+ * is nothing for process_incoming_link_part2 to do.
  */
-
-void
-process_incoming_link (struct context *c)
+static inline bool
+process_incoming_link_part1 (struct context *c, struct link_socket_info *lsi, struct buffer *buf, struct buffer *work,
+			     const unsigned int features)
 {
   struct gc_arena gc = gc_new ();
   bool decrypt_status;
-  struct link_socket_info *lsi = get_link_socket_info (c);
-  const uint8_t *orig_buf = c->c2.buf.data;
-
-  perf_push (PERF_PROC_IN_LINK);
+  bool ret = false;
 
-  if (c->c2.buf.len > 0)
+  if (buf->len > 0)
     {
-      c->c2.link_read_bytes += c->c2.buf.len;
-      link_read_bytes_global += c->c2.buf.len;
-      c->c2.original_recv_size = c->c2.buf.len;
+      c->c2.link_read_bytes += buf->len;
+      link_read_bytes_global += buf->len;
+      c->c2.original_recv_size = buf->len;
 #ifdef ENABLE_MANAGEMENT
       if (management)
 	{
-	  management_bytes_in (management, c->c2.buf.len);
+	  management_bytes_in (management, buf->len);
 #ifdef MANAGEMENT_DEF_AUTH
 	  management_bytes_server (management, &c->c2.link_read_bytes, &c->c2.link_write_bytes, &c->c2.mda_context);
 #endif
@@ -756,21 +809,21 @@ process_incoming_link (struct context *c)
   /* take action to corrupt packet if we are in gremlin test mode */
   if (c->options.gremlin) {
     if (!ask_gremlin (c->options.gremlin))
-      c->c2.buf.len = 0;
-    corrupt_gremlin (&c->c2.buf, c->options.gremlin);
+      buf->len = 0;
+    corrupt_gremlin (buf, c->options.gremlin);
   }
 #endif
 
   /* log incoming packet */
 #ifdef LOG_RW
-  if (c->c2.log_rw && c->c2.buf.len > 0)
+  if (c->c2.log_rw && buf->len > 0)
     fprintf (stderr, "R");
 #endif
   msg (D_LINK_RW, "%s READ [%d] from %s: %s",
        proto2ascii (lsi->proto, true),
-       BLEN (&c->c2.buf),
+       BLEN (buf),
        print_link_socket_actual (&c->c2.from, &gc),
-       PROTO_DUMP (&c->c2.buf, &gc));
+       PROTO_DUMP (buf, &gc));
 
   /*
    * Good, non-zero length packet received.
@@ -779,14 +832,14 @@ process_incoming_link (struct context *c)
    * If any stage fails, it sets buf.len to 0 or -1,
    * telling downstream stages to ignore the packet.
    */
-  if (c->c2.buf.len > 0)
+  if (buf->len > 0)
     {
-      if (!link_socket_verify_incoming_addr (&c->c2.buf, lsi, &c->c2.from))
-	link_socket_bad_incoming_addr (&c->c2.buf, lsi, &c->c2.from);
+      if (!link_socket_verify_incoming_addr (buf, lsi, &c->c2.from))
+	link_socket_bad_incoming_addr (buf, lsi, &c->c2.from);
 
 #ifdef USE_CRYPTO
 #ifdef USE_SSL
-      if (c->c2.tls_multi)
+      if (features & DP_TLS)
 	{
 	  /*
 	   * If tls_pre_decrypt returns true, it means the incoming
@@ -798,7 +851,7 @@ process_incoming_link (struct context *c)
 	   * will load crypto_options with the correct encryption key
 	   * and return false.
 	   */
-	  if (tls_pre_decrypt (c->c2.tls_multi, &c->c2.from, &c->c2.buf, &c->c2.crypto_options))
+	  if (tls_pre_decrypt (c->c2.tls_multi, &c->c2.from, buf, &c->c2.crypto_options))
 	    {
 	      interval_action (&c->c2.tmp_int);
 
@@ -813,12 +866,12 @@ process_incoming_link (struct context *c)
        * yet succeeded.
        */
       if (c->c2.context_auth != CAS_SUCCEEDED)
-	c->c2.buf.len = 0;
+	buf->len = 0;
 #endif
 #endif /* USE_SSL */
 
       /* authenticate and decrypt the incoming packet */
-      decrypt_status = openvpn_decrypt (&c->c2.buf, c->c2.buffers->decrypt_buf, &c->c2.crypto_options, &c->c2.frame);
+      decrypt_status = openvpn_decrypt (buf, work ? *work : get_context_buffers (c)->decrypt_buf, &c->c2.crypto_options, &c->c2.frame);
 
       if (!decrypt_status && link_socket_connection_oriented (c->c2.link_socket))
 	{
@@ -829,229 +882,601 @@ process_incoming_link (struct context *c)
 	}
 
 #endif /* USE_CRYPTO */
+      ret = true;
+    }
+  else
+    {
+      buf_reset (&c->c2.to_tun);
+    }
+ done:
+  gc_free (&gc);
+  return ret;
+}
 
+/*
+ * Second half of process_incoming_link: reassemble and decompress
+ * the decrypted packet in c->c2.buf and move it to c->c2.to_tun.
+ * orig_buf is the storage the packet was read into, NULL if it
+ * will not be reused before c->c2.to_tun has been written.
+ */
+static inline void
+process_incoming_link_part2 (struct context *c, struct link_socket_info *lsi, const uint8_t *orig_buf,
+			     const unsigned int features)
+{
 #ifdef ENABLE_FRAGMENT
-      if (c->c2.fragment)
-	fragment_incoming (c->c2.fragment, &c->c2.buf, &c->c2.frame_fragment);
+  if (features & DP_FRAGMENT)
+    fragment_incoming (c->c2.fragment, &c->c2.buf, &c->c2.frame_fragment);
 #endif
 
 #ifdef USE_LZO
-      /* decompress the incoming packet */
-      if (lzo_defined (&c->c2.lzo_compwork))
-	lzo_decompress (&c->c2.buf, c->c2.buffers->lzo_decompress_buf, &c->c2.lzo_compwork, &c->c2.frame);
+  /* decompress the incoming packet */
+  if (features & DP_LZO)
+    lzo_decompress (&c->c2.buf, get_context_buffers (c)->lzo_decompress_buf, &c->c2.lzo_compwork, &c->c2.frame);
 #endif
 
 #ifdef PACKET_TRUNCATION_CHECK
-      /* if (c->c2.buf.len > 1) --c->c2.buf.len; */
-      ipv4_packet_size_verify (BPTR (&c->c2.buf),
-			       BLEN (&c->c2.buf),
-			       TUNNEL_TYPE (c->c1.tuntap),
-			       "POST_DECRYPT",
-			       &c->c2.n_trunc_post_decrypt);
+  /* if (c->c2.buf.len > 1) --c->c2.buf.len; */
+  ipv4_packet_size_verify (BPTR (&c->c2.buf),
+			   BLEN (&c->c2.buf),
+			   TUNNEL_TYPE (c->c1.tuntap),
+			   "POST_DECRYPT",
+			   &c->c2.n_trunc_post_decrypt);
 #endif
 
-      /*
-       * Set our "official" outgoing address, since
-       * if buf.len is non-zero, we know the packet
-       * authenticated.  In TLS mode we do nothing
-       * because TLS mode takes care of source address
-       * authentication.
-       *
-       * Also, update the persisted version of our packet-id.
-       */
-      if (!TLS_MODE (c))
-	link_socket_set_outgoing_addr (&c->c2.buf, lsi, &c->c2.from, NULL, c->c2.es);
+  /*
+   * Set our "official" outgoing address, since
+   * if buf.len is non-zero, we know the packet
+   * authenticated.  In TLS mode we do nothing
+   * because TLS mode takes care of source address
+   * authentication.
+   *
+   * Also, update the persisted version of our packet-id.
+   */
+  if (!(features & DP_TLS))
+    link_socket_set_outgoing_addr (&c->c2.buf, lsi, &c->c2.from, NULL, c->c2.es);
 
-      /* reset packet received timer */
-      if (c->options.ping_rec_timeout && c->c2.buf.len > 0)
-	event_timeout_reset (&c->c2.ping_rec_interval);
+  /* reset packet received timer */
+  if (c->options.ping_rec_timeout && c->c2.buf.len > 0)
+    event_timeout_reset (&c->c2.ping_rec_interval);
 
-      /* increment authenticated receive byte count */
-      if (c->c2.buf.len > 0)
-	{
-	  c->c2.link_read_bytes_auth += c->c2.buf.len;
-	  c->c2.max_recv_size_local = max_int (c->c2.original_recv_size, c->c2.max_recv_size_local);
-	}
+  /* increment authenticated receive byte count */
+  if (c->c2.buf.len > 0)
+    {
+      c->c2.link_read_bytes_auth += c->c2.buf.len;
+      c->c2.max_recv_size_local = max_int (c->c2.original_recv_size, c->c2.max_recv_size_local);
+    }
 
-      /* Did we just receive an openvpn ping packet? */
-      if (is_ping_msg (&c->c2.buf))
-	{
-	  dmsg (D_PING, "RECEIVED PING PACKET");
-	  c->c2.buf.len = 0; /* drop packet */
-	}
+  /* Did we just receive an openvpn ping packet? */
+  if (is_ping_msg (&c->c2.buf))
+    {
+      dmsg (D_PING, "RECEIVED PING PACKET");
+      c->c2.buf.len = 0; /* drop packet */
+    }
 
 #ifdef ENABLE_OCC
-      /* Did we just receive an OCC packet? */
-      if (is_occ_msg (&c->c2.buf))
-	process_received_occ_msg (c);
+  /* Did we just receive an OCC packet? */
+  if (is_occ_msg (&c->c2.buf))
+    process_received_occ_msg (c);
 #endif
 
-      buffer_turnover (orig_buf, &c->c2.to_tun, &c->c2.buf, &c->c2.buffers->read_link_buf);
+  buffer_turnover (orig_buf, &c->c2.to_tun, &c->c2.buf, &get_context_buffers (c)->read_link_buf);
 
-      /* to_tun defined + unopened tuntap can cause deadlock */
-      if (!tuntap_defined (c->c1.tuntap))
-	c->c2.to_tun.len = 0;
+  /* to_tun defined + unopened tuntap can cause deadlock */
+  if (!tuntap_defined (c->c1.tuntap))
+    c->c2.to_tun.len = 0;
+}
+
+/*
+ * One copy of the data channel stages for each combination
+ * of DP_x features, selected by data_path_init.
+ */
+#define DATA_PATH_VARIANT(f)						\
+  static void								\
+  encrypt_sign_##f (struct context *c, bool comp_frag)			\
+  {									\
+    encrypt_sign_dowork (c, comp_frag, f);				\
+  }									\
+  static bool								\
+  link_in_decrypt_##f (struct context *c, struct link_socket_info *lsi,	\
+		       struct buffer *buf, struct buffer *work)		\
+  {									\
+    return process_incoming_link_part1 (c, lsi, buf, work, f);		\
+  }									\
+  static void								\
+  link_in_finish_##f (struct context *c, struct link_socket_info *lsi,	\
+		      const uint8_t *orig_buf)				\
+  {									\
+    process_incoming_link_part2 (c, lsi, orig_buf, f);			\
+  }
+
+DATA_PATH_VARIANT(0)
+DATA_PATH_VARIANT(1)
+DATA_PATH_VARIANT(2)
+DATA_PATH_VARIANT(3)
+DATA_PATH_VARIANT(4)
+DATA_PATH_VARIANT(5)
+DATA_PATH_VARIANT(6)
+DATA_PATH_VARIANT(7)
+
+#define DATA_PATH_ENTRY(f) { f, 0, encrypt_sign_##f, link_in_decrypt_##f, link_in_finish_##f }
+
+static const struct data_path data_path_variants[DP_N_VARIANTS] = {
+  DATA_PATH_ENTRY(0),
+  DATA_PATH_ENTRY(1),
+  DATA_PATH_ENTRY(2),
+  DATA_PATH_ENTRY(3),
+  DATA_PATH_ENTRY(4),
+  DATA_PATH_ENTRY(5),
+  DATA_PATH_ENTRY(6),
+  DATA_PATH_ENTRY(7)
+};
+
+void
+data_path_init (struct context *c)
+{
+  struct data_path *dp = &c->c2.data_path;
+  unsigned int features = 0;
+
+#ifdef USE_SSL
+  if (c->c2.tls_multi)
+    features |= DP_TLS;
+#endif
+#ifdef USE_LZO
+  if (lzo_defined (&c->c2.lzo_compwork))
+    features |= DP_LZO;
+#endif
+#ifdef ENABLE_FRAGMENT
+  if (c->c2.fragment)
+    features |= DP_FRAGMENT;
+#endif
+  *dp = data_path_variants[features];
+
+  dp->ipv4_flags = PIPV4_OUTGOING;
+  if (c->options.route_gateway_via_dhcp)
+    dp->ipv4_flags |= PIPV4_EXTRACT_DHCP_ROUTER;
+  if (c->options.mssfix)
+    dp->ipv4_flags |= PIPV4_MSSFIX;
+#if PASSTOS_CAPABILITY
+  if (c->options.passtos)
+    dp->ipv4_flags |= PIPV4_PASSTOS;
+#endif
+#ifdef ENABLE_CLIENT_NAT
+  if (c->options.client_nat)
+    dp->ipv4_flags |= PIPV4_CLIENT_NAT;
+#endif
+}
+
+void
+encrypt_sign (struct context *c, bool comp_frag)
+{
+  (*c->c2.data_path.encrypt_sign) (c, comp_frag);
+}
+
+/*
+ * Input:  c->c2.buf
+ * Output: c->c2.to_tun
+ */
+
+void
+process_incoming_link (struct context *c)
+{
+  const struct data_path *dp = &c->c2.data_path;
+  struct link_socket_info *lsi = get_link_socket_info (c);
+  const uint8_t *orig_buf = c->c2.buf.data;
+
+  perf_push (PERF_PROC_IN_LINK);
+
+  if ((*dp->link_in_decrypt) (c, lsi, &c->c2.buf, NULL))
+    (*dp->link_in_finish) (c, lsi, orig_buf);
+
+  perf_pop ();
+}
+
+/*
+ * Reassemble, decompress and write to the TUN/TAP device the
+ * decrypted packets bufs[0..n-1], in order.  If a write stops
+ * the burst, the packets after it are kept in burst_to_tun for
+ * process_io to resume.
+ */
+static void
+process_incoming_link_burst (struct context *c, struct buffer *bufs, int *recv_size, const int n)
+{
+  const struct data_path *dp = &c->c2.data_path;
+  struct link_socket_info *lsi = get_link_socket_info (c);
+  struct data_burst *rest = get_context_buffers (c)->burst_to_tun;
+  int i;
+
+  c->c2.burst_flags |= BURST_TO_TUN;
+  for (i = 0; i < n && !IS_SIG (c); ++i)
+    {
+      c->c2.buf = bufs[i];
+      c->c2.original_recv_size = recv_size[i];
+      (*dp->link_in_finish) (c, lsi, NULL);
+      if (TUN_OUT (c))
+	process_outgoing_tun (c);
+      if (c->c2.burst_flags & BURST_STOP)
+	{
+	  c->c2.burst_flags &= ~BURST_STOP;
+	  rest->n = n - i - 1;
+	  memmove (rest->bufs, bufs + i + 1, rest->n * sizeof (bufs[0]));
+	  memmove (rest->recv_size, recv_size + i + 1, rest->n * sizeof (recv_size[0]));
+	  return;
+	}
     }
-  else
+  rest->n = 0;
+  c->c2.burst_flags &= ~BURST_TO_TUN;
+}
+
+/*
+ * The write to the TUN/TAP device which stopped a burst from
+ * the peer has been retried.  Unless it is still pending,
+ * carry on with the rest of the burst.
+ */
+static void
+resume_incoming_link_burst (struct context *c)
+{
+  struct data_burst *rest = get_context_buffers (c)->burst_to_tun;
+
+  c->c2.burst_flags &= ~BURST_STOP;
+  if (!TUN_OUT (c) && !IS_SIG (c))
     {
-      buf_reset (&c->c2.to_tun);
+      const int n = rest->n;
+      rest->n = 0;
+      perf_push (PERF_PROC_IN_LINK);
+      process_incoming_link_burst (c, rest->bufs, rest->recv_size, n);
+      perf_pop ();
     }
- done:
-  perf_pop ();
-  gc_free (&gc);
 }
 
 /*
- * Output: c->c2.buf
+ * Input:  bufs[0..n-1], read from the peer at c->c2.from
+ * Output: the packets written to the TUN/TAP device
  */
 
 void
-read_incoming_tun (struct context *c)
+process_incoming_link_batch (struct context *c, struct buffer *bufs, const int n)
+{
+  const struct data_path *dp = &c->c2.data_path;
+  struct link_socket_info *lsi = get_link_socket_info (c);
+  struct context_buffers *b = get_context_buffers (c);
+  int recv_size[DATA_BATCH_MAX];
+  int i, n_ok = 0;
+
+  ASSERT (n <= DATA_BATCH_MAX);
+  if (!b->batch_tun_bufs)
+    init_context_buffers_batch (b, &c->c2.frame);
+
+  perf_push (PERF_PROC_IN_LINK);
+
+  /* authenticate, decrypt and replay-check the whole burst */
+  for (i = 0; i < n; ++i)
+    {
+#ifdef USE_CRYPTO
+      const bool ok = (*dp->link_in_decrypt) (c, lsi, &bufs[i], &b->batch_decrypt_bufs[i]);
+#else
+      const bool ok = (*dp->link_in_decrypt) (c, lsi, &bufs[i], NULL);
+#endif
+      if (IS_SIG (c))
+	goto done;
+      if (ok)
+	{
+	  bufs[n_ok] = bufs[i];
+	  recv_size[n_ok] = c->c2.original_recv_size;
+	  ++n_ok;
+	}
+    }
+
+  /* then reassemble, decompress and write them out in order */
+  process_incoming_link_burst (c, bufs, recv_size, n_ok);
+
+ done:
+  perf_pop ();
+}
+
+/*
+ * Read a packet from the TUN/TAP device into buf, which
+ * is set up to hold it.
+ */
+static void
+read_incoming_tun_buf (struct context *c, struct buffer *buf)
 {
   /*
    * Setup for read() call on TUN/TAP device.
    */
-  /*ASSERT (!c->c2.to_link.len);*/
-
-  perf_push (PERF_READ_IN_TUN);
-
-  c->c2.buf = c->c2.buffers->read_tun_buf;
 #ifdef TUN_PASS_BUFFER
-  read_tun_buffered (c->c1.tuntap, &c->c2.buf, MAX_RW_SIZE_TUN (&c->c2.frame));
+  read_tun_buffered (c->c1.tuntap, buf, MAX_RW_SIZE_TUN (&c->c2.frame));
 #else
-  ASSERT (buf_init (&c->c2.buf, FRAME_HEADROOM (&c->c2.frame)));
-  ASSERT (buf_safe (&c->c2.buf, MAX_RW_SIZE_TUN (&c->c2.frame)));
-  c->c2.buf.len = read_tun (c->c1.tuntap, BPTR (&c->c2.buf), MAX_RW_SIZE_TUN (&c->c2.frame));
+  ASSERT (buf_init (buf, FRAME_HEADROOM (&c->c2.frame)));
+  ASSERT (buf_safe (buf, MAX_RW_SIZE_TUN (&c->c2.frame)));
+  buf->len = read_tun (c->c1.tuntap, BPTR (buf), MAX_RW_SIZE_TUN (&c->c2.frame));
 #endif
 
 #ifdef PACKET_TRUNCATION_CHECK
-  ipv4_packet_size_verify (BPTR (&c->c2.buf),
-			   BLEN (&c->c2.buf),
+  ipv4_packet_size_verify (BPTR (buf),
+			   BLEN (buf),
 			   TUNNEL_TYPE (c->c1.tuntap),
 			   "READ_TUN",
 			   &c->c2.n_trunc_tun_read);
 #endif
 
   /* Was TUN/TAP interface stopped? */
-  if (tuntap_stop (c->c2.buf.len))
+  if (tuntap_stop (buf->len))
     {
       register_signal (c, SIGTERM, "tun-stop");
       msg (M_INFO, "TUN/TAP interface has been stopped, exiting");
-      perf_pop ();
       return;		  
     }
 
   /* Check the status return from read() */
-  check_status (c->c2.buf.len, "read from TUN/TAP", NULL, c->c1.tuntap);
-
-  perf_pop ();
+  check_status (buf->len, "read from TUN/TAP", NULL, c->c1.tuntap);
 }
 
 /*
- * Input:  c->c2.buf
- * Output: c->c2.to_link
+ * Output: c->c2.buf
  */
 
 void
-process_incoming_tun (struct context *c)
+read_incoming_tun (struct context *c)
 {
-  struct gc_arena gc = gc_new ();
+  /*ASSERT (!c->c2.to_link.len);*/
 
-  perf_push (PERF_PROC_IN_TUN);
+  perf_push (PERF_READ_IN_TUN);
 
-  if (c->c2.buf.len > 0)
-    c->c2.tun_read_bytes += c->c2.buf.len;
+  c->c2.buf = get_context_buffers (c)->read_tun_buf;
+  read_incoming_tun_buf (c, &c->c2.buf);
+
+  perf_pop ();
+}
+
+/*
+ * First half of process_incoming_tun: account for the packet
+ * in buf and examine its IP header.
+ */
+static void
+process_incoming_tun_part1 (struct context *c, struct buffer *buf)
+{
+  if (buf->len > 0)
+    {
+      c->c2.tun_read_bytes += buf->len;
+      check_hibernate_wake (c);
+    }
 
 #ifdef LOG_RW
-  if (c->c2.log_rw && c->c2.buf.len > 0)
+  if (c->c2.log_rw && buf->len > 0)
     fprintf (stderr, "r");
 #endif
 
   /* Show packet content */
-  dmsg (D_TUN_RW, "TUN READ [%d]", BLEN (&c->c2.buf));
+  dmsg (D_TUN_RW, "TUN READ [%d]", BLEN (buf));
 
-  if (c->c2.buf.len > 0)
+  if (buf->len > 0)
     {
       /*
        * The --passtos and --mssfix options require
        * us to examine the IPv4 header.
        */
-      process_ipv4_header (c, PIPV4_PASSTOS|PIPV4_MSSFIX|PIPV4_CLIENT_NAT, &c->c2.buf);
+      process_ipv4_header (c, PIPV4_PASSTOS|PIPV4_MSSFIX|PIPV4_CLIENT_NAT, buf, &c->c2.buf_info);
 
 #ifdef PACKET_TRUNCATION_CHECK
       /* if (c->c2.buf.len > 1) --c->c2.buf.len; */
-      ipv4_packet_size_verify (BPTR (&c->c2.buf),
-			       BLEN (&c->c2.buf),
+      ipv4_packet_size_verify (BPTR (buf),
+			       BLEN (buf),
 			       TUNNEL_TYPE (c->c1.tuntap),
 			       "PRE_ENCRYPT",
 			       &c->c2.n_trunc_pre_encrypt);
 #endif
-
-      encrypt_sign (c, true);
     }
+}
+
+/*
+ * Second half of process_incoming_tun: compress, fragment
+ * and encrypt the packet in c->c2.buf into c->c2.to_link.
+ */
+static inline void
+process_incoming_tun_part2 (struct context *c)
+{
+  if (c->c2.buf.len > 0)
+    encrypt_sign (c, true);
   else
+    buf_reset (&c->c2.to_link);
+}
+
+/*
+ * Input:  c->c2.buf
+ * Output: c->c2.to_link
+ */
+
+void
+process_incoming_tun (struct context *c)
+{
+  perf_push (PERF_PROC_IN_TUN);
+
+  process_incoming_tun_part1 (c, &c->c2.buf);
+  process_incoming_tun_part2 (c);
+
+  perf_pop ();
+}
+
+/*
+ * Send c->c2.to_link and any further fragments of the same
+ * packet to the peer.  False if a write stopped the burst.
+ */
+static bool
+process_incoming_tun_burst_send (struct context *c)
+{
+  while (!IS_SIG (c))
     {
-      buf_reset (&c->c2.to_link);
+      if (LINK_OUT (c))
+	{
+	  process_outgoing_link (c);
+	  if (c->c2.burst_flags & BURST_STOP)
+	    {
+	      c->c2.burst_flags &= ~BURST_STOP;
+	      return false;
+	    }
+	}
+#ifdef ENABLE_FRAGMENT
+      else if (TO_LINK_FRAG (c))
+	{
+	  ASSERT (fragment_ready_to_send (c->c2.fragment, &c->c2.buf, &c->c2.frame_fragment));
+	  encrypt_sign (c, false);
+	}
+#endif
+      else
+	break;
     }
+  return true;
+}
+
+/*
+ * Encrypt and send to the peer the packets bufs[0..n-1], in
+ * order.  If a write stops the burst, the packets after it are
+ * kept in burst_to_link for process_io to resume.
+ */
+static void
+process_incoming_tun_burst (struct context *c, struct buffer *bufs, const int n)
+{
+  struct data_burst *rest = get_context_buffers (c)->burst_to_link;
+  int i;
+
+  c->c2.burst_flags |= BURST_TO_LINK;
+  for (i = 0; i < n && !IS_SIG (c); ++i)
+    {
+      c->c2.buf = bufs[i];
+      process_incoming_tun_part2 (c);
+      if (!process_incoming_tun_burst_send (c))
+	{
+	  rest->n = n - i - 1;
+	  memmove (rest->bufs, bufs + i + 1, rest->n * sizeof (bufs[0]));
+	  return;
+	}
+    }
+  rest->n = 0;
+  c->c2.burst_flags &= ~BURST_TO_LINK;
+}
+
+/*
+ * The write to the peer which stopped a burst from the TUN/TAP
+ * device has been retried.  Unless it is still pending, finish
+ * its packet and carry on with the rest of the burst.
+ */
+static void
+resume_incoming_tun_burst (struct context *c)
+{
+  struct data_burst *rest = get_context_buffers (c)->burst_to_link;
+
+  c->c2.burst_flags &= ~BURST_STOP;
+  if (!LINK_OUT (c) && !IS_SIG (c))
+    {
+      perf_push (PERF_PROC_IN_TUN);
+      if (process_incoming_tun_burst_send (c))
+	{
+	  const int n = rest->n;
+	  rest->n = 0;
+	  process_incoming_tun_burst (c, rest->bufs, n);
+	}
+      perf_pop ();
+    }
+}
+
+/*
+ * Input:  bufs[0..n-1], read from the TUN/TAP device
+ * Output: the packets written to the peer
+ */
+
+void
+process_incoming_tun_batch (struct context *c, struct buffer *bufs, const int n)
+{
+  int i;
+
+  ASSERT (n <= DATA_BATCH_MAX);
+
+  perf_push (PERF_PROC_IN_TUN);
+
+  /* examine the IP headers of the whole burst */
+  for (i = 0; i < n; ++i)
+    process_incoming_tun_part1 (c, &bufs[i]);
+
+  /* then encrypt and send them out in order */
+  process_incoming_tun_burst (c, bufs, n);
+
   perf_pop ();
-  gc_free (&gc);
 }
 
 void
-process_ipv4_header (struct context *c, unsigned int flags, struct buffer *buf)
+process_ipv4_header (struct context *c, unsigned int flags, struct buffer *buf, struct packet_info *info)
 {
-  if (!c->options.mssfix)
-    flags &= ~PIPV4_MSSFIX;
-#if PASSTOS_CAPABILITY
-  if (!c->options.passtos)
-    flags &= ~PIPV4_PASSTOS;
-#endif
-  if (!c->options.route_gateway_via_dhcp || !route_list_vpn_gateway_needed (c->c1.route_list))
+  flags &= c->c2.data_path.ipv4_flags;
+  if ((flags & PIPV4_EXTRACT_DHCP_ROUTER) && !route_list_vpn_gateway_needed (c->c1.route_list))
     flags &= ~PIPV4_EXTRACT_DHCP_ROUTER;
 
-  if (buf->len > 0)
+  /*
+   * The --passtos, --mssfix and --client-nat options
+   * require us to examine the IPv4 header.
+   */
+  if (buf->len > 0 && (flags & (PIPV4_PASSTOS|PIPV4_MSSFIX|PIPV4_CLIENT_NAT|PIPV4_EXTRACT_DHCP_ROUTER)))
     {
-      /*
-       * The --passtos and --mssfix options require
-       * us to examine the IPv4 header.
-       */
-#if PASSTOS_CAPABILITY
-      if (flags & (PIPV4_PASSTOS|PIPV4_MSSFIX))
-#else
-      if (flags & PIPV4_MSSFIX)
-#endif
+      const struct packet_info *pi = packet_info_get (info, buf, TUNNEL_TYPE (c->c1.tuntap));
+
+      if (pi->flags & PI_IPV4)
 	{
 	  struct buffer ipbuf = *buf;
-	  if (is_ipv4 (TUNNEL_TYPE (c->c1.tuntap), &ipbuf))
-	    {
+	  buf_advance (&ipbuf, pi->l3);
+
 #if PASSTOS_CAPABILITY
-	      /* extract TOS from IP header */
-	      if (flags & PIPV4_PASSTOS)
-		link_socket_extract_tos (c->c2.link_socket, &ipbuf);
+	  /* extract TOS from IP header */
+	  if (flags & PIPV4_PASSTOS)
+	    link_socket_extract_tos (c->c2.link_socket, &ipbuf);
 #endif
 			  
-	      /* possibly alter the TCP MSS */
-	      if (flags & PIPV4_MSSFIX)
-		mss_fixup (&ipbuf, MTU_TO_MSS (TUN_MTU_SIZE_DYNAMIC (&c->c2.frame)));
+	  /* possibly alter the TCP MSS */
+	  if ((flags & PIPV4_MSSFIX) && (pi->flags & PI_TCP_SYN))
+	    {
+	      struct buffer tcpbuf = *buf;
+	      buf_advance (&tcpbuf, pi->l4);
+	      tcpbuf.len = pi->l4_len;
+	      mss_fixup_dowork (&tcpbuf, (uint16_t) MTU_TO_MSS (TUN_MTU_SIZE_DYNAMIC (&c->c2.frame)));
+	    }
 
 #ifdef ENABLE_CLIENT_NAT
-	      /* possibly do NAT on packet */
-	      if ((flags & PIPV4_CLIENT_NAT) && c->options.client_nat)
-		{
-		  const int direction = (flags & PIPV4_OUTGOING) ? CN_INCOMING : CN_OUTGOING;
-		  client_nat_transform (c->options.client_nat, &ipbuf, direction);
-		}
+	  /* possibly do NAT on packet */
+	  if (flags & PIPV4_CLIENT_NAT)
+	    {
+	      const int direction = (flags & PIPV4_OUTGOING) ? CN_INCOMING : CN_OUTGOING;
+	      client_nat_transform (c->options.client_nat, &ipbuf, direction);
+	    }
 #endif
-	      /* possibly extract a DHCP router message */
-	      if (flags & PIPV4_EXTRACT_DHCP_ROUTER)
-		{
-		  const in_addr_t dhcp_router = dhcp_extract_router_msg (&ipbuf);
-		  if (dhcp_router)
-		    route_list_add_vpn_gateway (c->c1.route_list, c->c2.es, dhcp_router);
-		}
+	  /* possibly extract a DHCP router message */
+	  if ((flags & PIPV4_EXTRACT_DHCP_ROUTER) && (pi->flags & PI_UDP))
+	    {
+	      const in_addr_t dhcp_router = dhcp_extract_router_msg (&ipbuf);
+	      if (dhcp_router)
+		route_list_add_vpn_gateway (c->c1.route_list, c->c2.es, dhcp_router);
 	    }
 	}
     }
+
+  /* the packet is on its way out, don't let a later one match */
+  packet_info_reset (info);
+}
+
+/*
+ * A write belonging to a burst returned size for a packet of
+ * len bytes.  Unless the packet was written in full, or dropped
+ * on purpose, stop the burst.  True if the write would block,
+ * so that the packet should be kept and retried.
+ */
+static bool
+burst_write_stop (struct context *c, const int size, const int len)
+{
+  if (size == 0 || size >= len)
+    return false;
+  c->c2.burst_flags |= BURST_STOP;
+#ifdef WIN32
+  return false;
+#else
+  return size < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+#endif
 }
 
 /*
@@ -1062,6 +1487,7 @@ void
 process_outgoing_link (struct context *c)
 {
   struct gc_arena gc = gc_new ();
+  bool keep = false;
 
   perf_push (PERF_PROC_OUT_LINK);
 
@@ -1130,6 +1556,9 @@ process_outgoing_link (struct context *c)
 	    /* Undo effect of prepend */
 	    link_socket_write_post_size_adjust (&size, size_delta, &c->c2.to_link);
 #endif
+
+	    if (c->c2.burst_flags & BURST_TO_LINK)
+	      keep = burst_write_stop (c, size, BLEN (&c->c2.to_link));
 	  }
 
 	  if (size > 0)
@@ -1176,7 +1605,9 @@ process_outgoing_link (struct context *c)
 	     EXPANDED_SIZE (&c->c2.frame));
     }
 
-  buf_reset (&c->c2.to_link);
+  /* keep a packet which would block for process_io to retry */
+  if (!keep)
+    buf_reset (&c->c2.to_link);
 
   perf_pop ();
   gc_free (&gc);
@@ -1190,6 +1621,7 @@ void
 process_outgoing_tun (struct context *c)
 {
   struct gc_arena gc = gc_new ();
+  bool keep = false;
 
   /*
    * Set up for write() call to TUN/TAP
@@ -1202,9 +1634,11 @@ process_outgoing_tun (struct context *c)
 
   /*
    * The --mssfix option requires
-   * us to examine the IPv4 header.
+   * us to examine the IPv4 header,
+   * once only for a packet being retried.
    */
-  process_ipv4_header (c, PIPV4_MSSFIX|PIPV4_EXTRACT_DHCP_ROUTER|PIPV4_CLIENT_NAT|PIPV4_OUTGOING, &c->c2.to_tun);
+  if (!c->c2.to_tun_retry)
+    process_ipv4_header (c, PIPV4_MSSFIX|PIPV4_EXTRACT_DHCP_ROUTER|PIPV4_CLIENT_NAT|PIPV4_OUTGOING, &c->c2.to_tun, &c->c2.to_tun_info);
 
   if (c->c2.to_tun.len <= MAX_RW_SIZE_TUN (&c->c2.frame))
     {
@@ -1233,8 +1667,14 @@ process_outgoing_tun (struct context *c)
       size = write_tun (c->c1.tuntap, BPTR (&c->c2.to_tun), BLEN (&c->c2.to_tun));
 #endif
 
+      if (c->c2.burst_flags & BURST_TO_TUN)
+	keep = burst_write_stop (c, size, BLEN (&c->c2.to_tun));
+
       if (size > 0)
-	c->c2.tun_write_bytes += size;
+	{
+	  c->c2.tun_write_bytes += size;
+	  check_hibernate_wake (c);
+	}
       check_status (size, "write to TUN/TAP", NULL, c->c1.tuntap);
 
       /* check written packet size */
@@ -1263,7 +1703,10 @@ process_outgoing_tun (struct context *c)
 	   MAX_RW_SIZE_TUN (&c->c2.frame));
     }
 
-  buf_reset (&c->c2.to_tun);
+  /* keep a packet which would block for process_io to retry */
+  c->c2.to_tun_retry = keep;
+  if (!keep)
+    buf_reset (&c->c2.to_tun);
 
   perf_pop ();
   gc_free (&gc);
@@ -1332,6 +1775,7 @@ io_wait_dowork (struct context *c, const unsigned int flags)
 {
   unsigned int socket = 0;
   unsigned int tuntap = 0;
+  bool flush_only = false;
   struct event_set_return esr[4];
 
   /* These shifts all depend on EVENT_READ and EVENT_WRITE */
@@ -1424,6 +1868,17 @@ io_wait_dowork (struct context *c, const unsigned int flags)
   if (flags & IOW_READ_TUN_FORCE)
     tuntap |= EVENT_READ;
 
+  /*
+   * Held UDP output which found the socket buffer
+   * full waits for the socket to become writable.
+   */
+  if (link_socket_write_blocked (c->c2.link_socket))
+    {
+      if (!(socket & EVENT_WRITE))
+	flush_only = true;
+      socket |= EVENT_WRITE;
+    }
+
   /*
    * Configure event wait based on socket, tuntap flags.
    */
@@ -1449,10 +1904,37 @@ io_wait_dowork (struct context *c, const unsigned int flags)
 
   if (!c->sig->signal_received)
     {
-      if (!(flags & IOW_CHECK_RESIDUAL) || !socket_read_residual (c->c2.link_socket))
+      if ((flags & IOW_CHECK_RESIDUAL) && socket_read_residual (c->c2.link_socket))
+	{
+	  c->c2.event_set_status = SOCKET_READ;
+	}
+      else if ((socket & EVENT_READ) && socket_read_gro_residual (c->c2.link_socket))
+	{
+	  c->c2.event_set_status = SOCKET_READ;
+	}
+      else if ((tuntap & EVENT_READ) && tun_read_residual (c->c1.tuntap))
+	{
+	  c->c2.event_set_status = TUN_READ;
+	}
+      else
 	{
 	  int status;
 
+	  /*
+	   * Coalesced TUN/TAP output is held back only while more
+	   * input is immediately available; write it out now
+	   * rather than polling until the next packet arrives.
+	   * Batched UDP output is still flushed after a zero-timeout
+	   * poll so that it can pick up the rest of a burst.
+	   */
+	  tun_write_flush (c->c1.tuntap);
+	  if (link_socket_write_pending (c->c2.link_socket)
+	      && !link_socket_write_blocked (c->c2.link_socket))
+	    {
+	      c->c2.timeval.tv_sec = 0;
+	      c->c2.timeval.tv_usec = 0;
+	    }
+
 #ifdef ENABLE_DEBUG
 	  if (check_debug_level (D_EVENT_WAIT))
 	    show_wait_status (c);
@@ -1479,10 +1961,20 @@ io_wait_dowork (struct context *c, const unsigned int flags)
 	    {
 	      c->c2.event_set_status = ES_TIMEOUT;
 	    }
-	}
-      else
-	{
-	  c->c2.event_set_status = SOCKET_READ;
+
+	  if (link_socket_write_blocked (c->c2.link_socket))
+	    {
+	      if (c->c2.event_set_status & SOCKET_WRITE)
+		{
+		  link_socket_write_flush (c->c2.link_socket);
+
+		  /* nothing else was waiting to be written */
+		  if (flush_only)
+		    c->c2.event_set_status &= ~SOCKET_WRITE;
+		}
+	    }
+	  else if (!(c->c2.event_set_status & (TUN_READ|SOCKET_WRITE)))
+	    link_socket_write_flush (c->c2.link_socket);
 	}
     }
 
@@ -1496,6 +1988,75 @@ io_wait_dowork (struct context *c, const unsigned int flags)
   dmsg (D_EVENT_WAIT, "I/O WAIT status=0x%04x", c->c2.event_set_status);
 }
 
+/*
+ * Bursts are only written out without waiting for io_wait when
+ * a would-block can be told apart from a lost packet, that is
+ * for UDP to the peer and a tun device, which both keep packet
+ * boundaries.
+ */
+static inline bool
+data_burst_allowed (const struct context *c)
+{
+  return proto_is_udp (c->c2.link_socket->info.proto)
+    && TUNNEL_TYPE (c->c1.tuntap) == DEV_TYPE_TUN;
+}
+
+/*
+ * The first datagram of a UDP_GRO train from the peer has been
+ * read into c->c2.buf.  Process the train in bursts, without
+ * going back to io_wait for each datagram, until a write to the
+ * TUN/TAP device stops one.
+ */
+static void
+process_incoming_link_train (struct context *c)
+{
+  struct buffer bufs[DATA_BATCH_MAX];
+  int n = 0;
+
+  bufs[n++] = c->c2.buf;
+  do
+    {
+      while (n < DATA_BATCH_MAX && link_socket_read_gro_next (c->c2.link_socket, &bufs[n]))
+	++n;
+      process_incoming_link_batch (c, bufs, n);
+      n = 0;
+    } while (!IS_SIG (c) && !(c->c2.burst_flags & BURST_TO_TUN)
+	     && socket_read_gro_residual (c->c2.link_socket));
+}
+
+/*
+ * The first segment of a super-packet from the TUN device has
+ * been read into c->c2.buf.  Process the remaining segments in
+ * bursts, without going back to io_wait for each of them, until
+ * a write to the peer stops one.
+ */
+static void
+process_incoming_tun_segments (struct context *c)
+{
+  struct context_buffers *b = get_context_buffers (c);
+  struct buffer bufs[DATA_BATCH_MAX];
+  int n = 0;
+
+  if (!b->batch_tun_bufs)
+    init_context_buffers_batch (b, &c->c2.frame);
+
+  bufs[n++] = c->c2.buf;
+  do
+    {
+      while (n < DATA_BATCH_MAX && tun_read_residual (c->c1.tuntap))
+	{
+	  bufs[n] = b->batch_tun_bufs[n];
+	  read_incoming_tun_buf (c, &bufs[n]);
+	  if (IS_SIG (c))
+	    return;
+	  ++n;
+	}
+      process_incoming_tun_batch (c, bufs, n);
+      n = 0;
+    } while (!IS_SIG (c) && !(c->c2.burst_flags & BURST_TO_LINK)
+	     && tun_read_residual (c->c1.tuntap));
+}
+
 void
 process_io (struct context *c)
 {
@@ -1513,24 +2074,38 @@ process_io (struct context *c)
   if (status & SOCKET_WRITE)
     {
       process_outgoing_link (c);
+      if (c->c2.burst_flags & BURST_TO_LINK)
+	resume_incoming_tun_burst (c);
     }
   /* TUN device ready to accept write */
   else if (status & TUN_WRITE)
     {
       process_outgoing_tun (c);
+      if (c->c2.burst_flags & BURST_TO_TUN)
+	resume_incoming_link_burst (c);
     }
   /* Incoming data on TCP/UDP port */
   else if (status & SOCKET_READ)
     {
       read_incoming_link (c);
       if (!IS_SIG (c))
-	process_incoming_link (c);
+	{
+	  if (socket_read_gro_residual (c->c2.link_socket) && data_burst_allowed (c))
+	    process_incoming_link_train (c);
+	  else
+	    process_incoming_link (c);
+	}
     }
   /* Incoming data on TUN device */
   else if (status & TUN_READ)
     {
       read_incoming_tun (c);
       if (!IS_SIG (c))
-	process_incoming_tun (c);
+	{
+	  if (tun_read_residual (c->c1.tuntap) && !c->options.shaper && data_burst_allowed (c))
+	    process_incoming_tun_segments (c);
+	  else
+	    process_incoming_tun (c);
+	}
     }
 }
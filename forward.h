@@ -162,6 +162,31 @@ void read_incoming_link (struct context *c);
 void process_incoming_link (struct context *c);
 
 
+/**
+ * Process a burst of packets read from the same peer on the external
+ * network interface.
+ * @ingroup external_multiplexer
+ *
+ * This is the batch form of \c process_incoming_link() followed by \c
+ * process_outgoing_tun().  HMAC verification, decryption and replay
+ * checking are run as one loop over the whole burst, so that the cipher
+ * and HMAC state stay hot, before the packets are reassembled,
+ * decompressed and written to the tun/tap device in order.
+ *
+ * It is only used for UDP with a tun device.  If a write to the device
+ * would block, the packet is kept in \c c->c2.to_tun and the rest of the
+ * burst is left for \c process_io() to resume once io_wait reports the
+ * device writable.
+ *
+ * @param c - The context structure of the VPN tunnel associated with the
+ *     packets, whose source address is in \c c->c2.from.
+ * @param bufs - The packets, which are modified in place.  They must stay
+ *     valid until the burst has been written out.
+ * @param n - The number of packets, at most \c DATA_BATCH_MAX.
+ */
+void process_incoming_link_batch (struct context *c, struct buffer *bufs, const int n);
+
+
 /**
  * Write a packet to the external network interface.
  * @ingroup external_multiplexer
@@ -208,6 +233,30 @@ void read_incoming_tun (struct context *c);
 void process_incoming_tun (struct context *c);
 
 
+/**
+ * Process a burst of packets read from the virtual tun/tap network
+ * interface.
+ * @ingroup internal_multiplexer
+ *
+ * This is the batch form of \c process_incoming_tun() followed by \c
+ * process_outgoing_link(), including any further fragments.  The IP
+ * headers of the whole burst are examined first, then the packets are
+ * encrypted and written to the peer in order.
+ *
+ * It is only used for UDP with a tun device.  If a write to the peer
+ * would block, the packet is kept in \c c->c2.to_link and the rest of
+ * the burst is left for \c process_io() to resume once io_wait reports
+ * the socket writable.
+ *
+ * @param c - The context structure of the VPN tunnel associated with the
+ *     packets.
+ * @param bufs - The packets, which are modified in place.  They must stay
+ *     valid until the burst has been written out.
+ * @param n - The number of packets, at most \c DATA_BATCH_MAX.
+ */
+void process_incoming_tun_batch (struct context *c, struct buffer *bufs, const int n);
+
+
 /**
  * Write a packet to the virtual tun/tap network interface.
  * @ingroup internal_multiplexer
@@ -233,7 +282,14 @@ bool send_control_channel_string (struct context *c, const char *str, int msglev
 #define PIPV4_EXTRACT_DHCP_ROUTER (1<<3)
 #define PIPV4_CLIENT_NAT      (1<<4)
 
-void process_ipv4_header (struct context *c, unsigned int flags, struct buffer *buf);
+void process_ipv4_header (struct context *c, unsigned int flags, struct buffer *buf, struct packet_info *info);
+
+/*
+ * Select the data channel stages specialized for the
+ * features c has been set up with.  Must be called again
+ * when those change, such as after options are pulled.
+ */
+void data_path_init (struct context *c);
 
 #if P2MP
 void schedule_exit (struct context *c, const int n_seconds, const int signal);
@@ -33,14 +33,6 @@
 
 #define FRAG_ERR(s) { errmsg = s; goto error; }
 
-static void
-fragment_list_buf_init (struct fragment_list *list, const struct frame *frame)
-{
-  int i;
-  for (i = 0; i < N_FRAG_BUF; ++i)
-    list->fragments[i].buf = alloc_buf (BUF_SIZE (frame));
-}
-
 static void
 fragment_list_buf_free (struct fragment_list *list)
 {
@@ -107,16 +99,36 @@ fragment_free (struct fragment_master *f)
 {
   fragment_list_buf_free (&f->incoming);
   free_buf (&f->outgoing);
-  free_buf (&f->outgoing_return);
   free (f);
 }
 
 void
 fragment_frame_init (struct fragment_master *f, const struct frame *frame)
 {
-  fragment_list_buf_init (&f->incoming, frame);
-  f->outgoing = alloc_buf (BUF_SIZE (frame));
-  f->outgoing_return = alloc_buf (BUF_SIZE (frame));
+  f->buf_size = BUF_SIZE (frame);
+}
+
+void
+fragment_release_idle (struct fragment_master *f)
+{
+  int i;
+  for (i = 0; i < N_FRAG_BUF; ++i)
+    {
+      struct fragment *frag = &f->incoming.fragments[i];
+      if (!frag->defined)
+	free_buf (&frag->buf);
+    }
+  if (!fragment_outgoing_defined (f))
+    free_buf (&f->outgoing);
+}
+
+int
+fragment_footprint (const struct fragment_master *f)
+{
+  int i, ret = sizeof (*f) + f->outgoing.capacity;
+  for (i = 0; i < N_FRAG_BUF; ++i)
+    ret += f->incoming.fragments[i].buf.capacity;
+  return ret;
 }
 
 /*
@@ -196,6 +208,8 @@ fragment_incoming (struct fragment_master *f, struct buffer *buf,
 	      frag->defined = true;
 	      frag->max_frag_size = size;
 	      frag->map = 0;
+	      if (!frag->buf.data)
+		frag->buf = alloc_buf (f->buf_size);
 	      ASSERT (buf_init (&frag->buf, FRAME_HEADROOM_ADJ (frame, FRAME_HEADROOM_MARKER_FRAGMENT)));
 	    }
 
@@ -315,6 +329,8 @@ fragment_outgoing (struct fragment_master *f, struct buffer *buf,
 	  f->outgoing_frag_size = optimal_fragment_size (buf->len, PAYLOAD_SIZE_DYNAMIC(frame));
 	  if (buf->len > f->outgoing_frag_size * MAX_FRAGS)
 	    FRAG_ERR ("too many fragments would be required to send datagram");
+	  if (!f->outgoing.data)
+	    f->outgoing = alloc_buf (f->buf_size);
 	  ASSERT (buf_init (&f->outgoing, FRAME_HEADROOM (frame)));
 	  ASSERT (buf_copy (&f->outgoing, buf));
 	  f->outgoing_seq_id = modulo_add (f->outgoing_seq_id, 1, N_SEQ_ID);
@@ -360,10 +376,11 @@ fragment_ready_to_send (struct fragment_master *f, struct buffer *buf,
 	  last = true;
 	}
 
-      /* initialize return buffer */
-      *buf = f->outgoing_return;
-      ASSERT (buf_init (buf, FRAME_HEADROOM (frame)));
-      ASSERT (buf_copy_n (buf, &f->outgoing, size));
+      /* return the fragment in place, its header goes into
+	 the space taken by the previous one */
+      *buf = f->outgoing;
+      buf->len = size;
+      ASSERT (buf_advance (&f->outgoing, size));
 
       /* fragment flags differ based on whether or not we are sending the last fragment */
       fragment_prepend_flags (buf,
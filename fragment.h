@@ -171,15 +171,21 @@ struct fragment_master {
                                  *   be sent.  Must have a value between 0
                                  *   and \c MAX_FRAGS-1. */
   struct buffer outgoing;       /**< Buffer containing the remaining parts
-                                 *   of the fragmented packet being sent. */
-  struct buffer outgoing_return;
-                                /**< Buffer used by \c
-                                 *   fragment_ready_to_send() to return a
-                                 *   part to send. */
+                                 *   of the fragmented packet being sent.
+                                 *   Parts are returned by \c
+                                 *   fragment_ready_to_send() in place,
+                                 *   so the headroom in front of each part
+                                 *   is the already sent tail of the
+                                 *   previous one. */
 
   struct fragment_list incoming;
                                 /**< List of structures for reassembling
                                  *   incoming packets. */
+
+  int buf_size;                 /**< Size of the \c outgoing and
+                                 *   reassembly buffers, which are only
+                                 *   allocated once they are first
+                                 *   needed. */
 };
 
 
@@ -275,10 +281,11 @@ struct fragment_master *fragment_init (struct frame *frame);
 
 
 /**
- * Allocate internal packet buffers for a \c fragment_master structure.
+ * Size the internal packet buffers for a \c fragment_master structure.
+ * The buffers themselves are allocated when they are first needed.
  *
  * @param f            - The \c fragment_master structure for which to
- *                       allocate the internal buffers.
+ *                       size the internal buffers.
  * @param frame        - The packet geometry parameters for this VPN
  *                       tunnel, used to determine how much memory to
  *                       allocate for each packet buffer.
@@ -293,6 +300,24 @@ void fragment_frame_init (struct fragment_master *f, const struct frame *frame);
  */
 void fragment_free (struct fragment_master *f);
 
+
+/**
+ * Free the internal packet buffers which do not currently hold a packet
+ * being sent or reassembled.
+ *
+ * @param f            - The \c fragment_master structure to trim.
+ */
+void fragment_release_idle (struct fragment_master *f);
+
+
+/**
+ * Return the number of bytes of memory held by a \c fragment_master
+ * structure, including its internal packet buffers.
+ *
+ * @param f            - The \c fragment_master structure to check.
+ */
+int fragment_footprint (const struct fragment_master *f);
+
 /** @} name Functions for initialization and cleanup *//*******************/
 
 
@@ -405,6 +430,11 @@ void fragment_outgoing (struct fragment_master *f, struct buffer *buf,
  * modifies the \a buf argument to point to a buffer containing the next
  * part to be sent.
  *
+ * The part is not copied: \a buf points into the internal buffer, and
+ * stays valid until this function is called again.  Data may be
+ * prepended to it, but it must not grow at the tail, since that is
+ * where the following part starts.
+ *
  * @param f            - The \a fragment_master structure for this VPN
  *                       tunnel.
  * @param buf          - A pointer to a buffer structure which on return,
@@ -0,0 +1,452 @@
+/*
+ *  OpenVPN -- An application to securely tunnel IP networks
+ *             over a single TCP/UDP port, with support for SSL/TLS-based
+ *             session authentication and key exchange,
+ *             packet encryption, packet authentication, and
+ *             packet compression.
+ *
+ *  Copyright (C) 2002-2010 OpenVPN Technologies, Inc. <sales@openvpn.net>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2
+ *  as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program (see the file COPYING included with this
+ *  distribution); if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "syshead.h"
+
+#include "fwatch.h"
+#include "buffer.h"
+#include "error.h"
+#include "fdmisc.h"
+
+#include "memdbg.h"
+
+#if P2MP_SERVER
+
+static uint32_t
+file_watch_hash_function (const void *key, uint32_t iv)
+{
+  return hash_func ((uint8_t *)key, strlen ((char *)key) + 1, iv);
+}
+
+static bool
+file_watch_compare_function (const void *key1, const void *key2)
+{
+  return !strcmp ((const char *)key1, (const char *)key2);
+}
+
+struct file_watch *
+file_watch_new (void)
+{
+  struct file_watch *fw;
+
+  ALLOC_OBJ_CLEAR (fw, struct file_watch);
+  fw->fd = -1;
+  fw->files = hash_init (256, 0, file_watch_hash_function, file_watch_compare_function);
+  return fw;
+}
+
+static void
+file_watch_entry_free (struct file_watch_entry *e)
+{
+  free (e->contents);
+  free (e->path);
+  free (e);
+}
+
+void
+file_watch_free (struct file_watch *fw)
+{
+  if (fw)
+    {
+      struct hash_iterator hi;
+      struct hash_element *he;
+      struct file_watch_dir *d;
+
+      hash_iterator_init (fw->files, &hi);
+      while ((he = hash_iterator_next (&hi)))
+	{
+	  file_watch_entry_free ((struct file_watch_entry *) he->value);
+	  hash_iterator_delete_element (&hi);
+	}
+      hash_iterator_free (&hi);
+      hash_free (fw->files);
+
+      d = fw->dirs;
+      while (d)
+	{
+	  struct file_watch_dir *next = d->next;
+	  free (d->prefix);
+	  free (d);
+	  d = next;
+	}
+
+      if (fw->fd >= 0)
+	close (fw->fd);
+      free (fw);
+    }
+}
+
+#ifdef ENABLE_FILE_WATCH
+
+#define FILE_WATCH_MASK (IN_CLOSE_WRITE|IN_MODIFY|IN_ATTRIB|IN_CREATE|IN_DELETE \
+			 |IN_MOVED_FROM|IN_MOVED_TO|IN_DELETE_SELF|IN_MOVE_SELF)
+
+/*
+ * Hand out generations from a single counter, so that an entry
+ * which was dropped and created again doesn't repeat one.
+ */
+static unsigned int
+file_watch_next_generation (struct file_watch *fw)
+{
+  if (!++fw->generation)
+    ++fw->generation;
+  return fw->generation;
+}
+
+static void
+file_watch_lru_unlink (struct file_watch *fw, struct file_watch_entry *e)
+{
+  if (e->lru_prev)
+    e->lru_prev->lru_next = e->lru_next;
+  else
+    fw->lru_head = e->lru_next;
+  if (e->lru_next)
+    e->lru_next->lru_prev = e->lru_prev;
+  else
+    fw->lru_tail = e->lru_prev;
+  e->lru_prev = e->lru_next = NULL;
+}
+
+static void
+file_watch_lru_push (struct file_watch *fw, struct file_watch_entry *e)
+{
+  e->lru_prev = NULL;
+  e->lru_next = fw->lru_head;
+  if (fw->lru_head)
+    fw->lru_head->lru_prev = e;
+  else
+    fw->lru_tail = e;
+  fw->lru_head = e;
+}
+
+static void
+file_watch_remove (struct file_watch *fw, struct file_watch_entry *e)
+{
+  file_watch_lru_unlink (fw, e);
+  hash_remove (fw->files, e->path);
+  file_watch_entry_free (e);
+}
+
+static void
+file_watch_invalidate (struct file_watch *fw, struct file_watch_entry *e)
+{
+  e->generation = file_watch_next_generation (fw);
+  e->cached = false;
+  e->uncacheable = false;
+  free (e->contents);
+  e->contents = NULL;
+}
+
+/*
+ * Invalidate the entries of directory dir, or of all
+ * directories if dir is NULL.
+ */
+static void
+file_watch_invalidate_dir (struct file_watch *fw, const struct file_watch_dir *dir)
+{
+  struct hash_iterator hi;
+  struct hash_element *he;
+
+  hash_iterator_init (fw->files, &hi);
+  while ((he = hash_iterator_next (&hi)))
+    {
+      struct file_watch_entry *e = (struct file_watch_entry *) he->value;
+      if (!dir || e->dir == dir)
+	file_watch_invalidate (fw, e);
+    }
+  hash_iterator_free (&hi);
+}
+
+/*
+ * Find or create the record for the directory holding path,
+ * and make sure it is being watched.  Returns NULL if it
+ * cannot be watched.
+ */
+static struct file_watch_dir *
+file_watch_dir (struct file_watch *fw, const char *path)
+{
+  const char *sep = strrchr (path, OS_SPECIFIC_DIRSEP);
+  const size_t prefix_len = sep ? (size_t)(sep - path + 1) : 0;
+  struct file_watch_dir *d;
+
+  for (d = fw->dirs; d != NULL; d = d->next)
+    {
+      if (strlen (d->prefix) == prefix_len && !strncmp (d->prefix, path, prefix_len))
+	break;
+    }
+
+  if (!d)
+    {
+      ALLOC_OBJ_CLEAR (d, struct file_watch_dir);
+      d->prefix = (char *) malloc (prefix_len + 1);
+      check_malloc_return (d->prefix);
+      memcpy (d->prefix, path, prefix_len);
+      d->prefix[prefix_len] = '\0';
+      d->wd = -1;
+      d->next = fw->dirs;
+      fw->dirs = d;
+    }
+
+  if (d->wd < 0 && !d->failed)
+    {
+      if (fw->fd < 0 && !fw->failed)
+	{
+	  fw->fd = inotify_init ();
+	  if (fw->fd >= 0)
+	    {
+	      set_nonblock (fw->fd);
+	      set_cloexec (fw->fd);
+	    }
+	  else
+	    {
+	      msg (D_MULTI_ERRORS|M_ERRNO, "MULTI: inotify_init failed, files will be polled");
+	      fw->failed = true;
+	    }
+	}
+
+      if (fw->fd >= 0)
+	{
+	  const char *watch_path = ".";
+	  struct gc_arena gc = gc_new ();
+
+	  if (prefix_len == 1)
+	    watch_path = d->prefix;
+	  else if (prefix_len > 1)
+	    {
+	      struct buffer b = alloc_buf_gc (prefix_len, &gc);
+	      buf_write (&b, d->prefix, prefix_len - 1);
+	      buf_null_terminate (&b);
+	      watch_path = BSTR (&b);
+	    }
+
+	  d->wd = inotify_add_watch (fw->fd, watch_path, FILE_WATCH_MASK);
+	  if (d->wd < 0 && errno != ENOENT && errno != ENOTDIR)
+	    {
+	      msg (D_MULTI_ERRORS|M_ERRNO, "MULTI: cannot watch directory %s, files in it will be polled", watch_path);
+	      d->failed = true;
+	    }
+	  gc_free (&gc);
+	}
+    }
+
+  return d->wd >= 0 ? d : NULL;
+}
+
+const struct file_watch_entry *
+file_watch_get (struct file_watch *fw, const char *path)
+{
+  struct file_watch_entry *e;
+
+  /* don't answer from the cache before hearing of recent changes */
+  file_watch_process (fw);
+
+  e = (struct file_watch_entry *) hash_lookup (fw->files, path);
+  if (e)
+    {
+      /* the directory may have been removed and recreated since */
+      if (e->dir->wd < 0 && !file_watch_dir (fw, path))
+	return NULL;
+      file_watch_lru_unlink (fw, e);
+    }
+  else
+    {
+      /* watch before the first read, so no change can slip by */
+      struct file_watch_dir *d = file_watch_dir (fw, path);
+      if (!d)
+	return NULL;
+
+      if (hash_n_elements (fw->files) >= FILE_WATCH_MAX_FILES)
+	file_watch_remove (fw, fw->lru_tail);
+
+      ALLOC_OBJ_CLEAR (e, struct file_watch_entry);
+      e->path = string_alloc (path, NULL);
+      e->dir = d;
+      e->generation = file_watch_next_generation (fw);
+      hash_add (fw->files, e->path, e, false);
+    }
+  file_watch_lru_push (fw, e);
+  return e;
+}
+
+void
+file_watch_forget (struct file_watch *fw, const char *path)
+{
+  struct file_watch_entry *e = (struct file_watch_entry *) hash_lookup (fw->files, path);
+  if (e)
+    file_watch_remove (fw, e);
+}
+
+/*
+ * Read the file of entry e into its cache.
+ */
+static void
+file_watch_load (struct file_watch_entry *e)
+{
+  struct stat s;
+
+  if (lstat (e->path, &s))
+    {
+      if (errno == ENOENT || errno == ENOTDIR)
+	{
+	  e->exists = false;
+	  e->cached = true;
+	}
+      else
+	e->uncacheable = true;
+    }
+  else if (!S_ISREG (s.st_mode) || s.st_size > FILE_WATCH_MAX_SIZE)
+    e->uncacheable = true;
+  else
+    {
+      FILE *fp = fopen (e->path, "r");
+      if (fp)
+	{
+	  char *contents = (char *) malloc (FILE_WATCH_MAX_SIZE + 1);
+	  size_t len;
+
+	  check_malloc_return (contents);
+	  len = fread (contents, 1, FILE_WATCH_MAX_SIZE + 1, fp);
+	  if (ferror (fp) || len > FILE_WATCH_MAX_SIZE)
+	    {
+	      free (contents);
+	      e->uncacheable = true;
+	    }
+	  else
+	    {
+	      contents[len] = '\0';
+	      e->contents = (char *) realloc (contents, len + 1);
+	      check_malloc_return (e->contents);
+	      e->exists = true;
+	      e->cached = true;
+	    }
+	  fclose (fp);
+	}
+      else
+	e->uncacheable = true;
+    }
+}
+
+bool
+file_watch_contents (struct file_watch *fw, const char *path, const char **contents)
+{
+  struct file_watch_entry *e = (struct file_watch_entry *) file_watch_get (fw, path);
+
+  if (!e)
+    return false;
+  if (!e->cached && !e->uncacheable)
+    file_watch_load (e);
+  if (!e->cached)
+    return false;
+  *contents = e->exists ? e->contents : NULL;
+  return true;
+}
+
+void
+file_watch_process (struct file_watch *fw)
+{
+  union {
+    struct inotify_event ev;
+    char buf[4096];
+  } u;
+  ssize_t len;
+
+  if (fw->fd < 0)
+    return;
+
+  while ((len = read (fw->fd, u.buf, sizeof (u.buf))) > 0)
+    {
+      const char *p = u.buf;
+
+      while (p + sizeof (struct inotify_event) <= u.buf + len)
+	{
+	  const struct inotify_event *ev = (const struct inotify_event *) p;
+	  struct file_watch_dir *d;
+
+	  p += sizeof (struct inotify_event) + ev->len;
+
+	  if (ev->mask & IN_Q_OVERFLOW)
+	    {
+	      msg (D_MULTI_ERRORS, "MULTI: inotify queue overflow, dropping all cached files");
+	      file_watch_invalidate_dir (fw, NULL);
+	      continue;
+	    }
+
+	  /* the same directory may be reached through several prefixes */
+	  for (d = fw->dirs; d != NULL; d = d->next)
+	    {
+	      if (d->wd != ev->wd)
+		continue;
+
+	      if (ev->len && ev->name[0])
+		{
+		  struct gc_arena gc = gc_new ();
+		  struct buffer path = alloc_buf_gc (strlen (d->prefix) + strlen (ev->name) + 1, &gc);
+		  struct file_watch_entry *e;
+
+		  buf_printf (&path, "%s%s", d->prefix, ev->name);
+		  e = (struct file_watch_entry *) hash_lookup (fw->files, BSTR (&path));
+		  if (e)
+		    file_watch_invalidate (fw, e);
+		  gc_free (&gc);
+		}
+	      else
+		{
+		  /* the directory itself went away */
+		  file_watch_invalidate_dir (fw, d);
+		  if (ev->mask & IN_MOVE_SELF)
+		    inotify_rm_watch (fw->fd, d->wd);
+		  if (ev->mask & (IN_IGNORED|IN_MOVE_SELF))
+		    d->wd = -1;
+		}
+	    }
+	}
+    }
+}
+
+#else
+
+const struct file_watch_entry *
+file_watch_get (struct file_watch *fw, const char *path)
+{
+  return NULL;
+}
+
+void
+file_watch_forget (struct file_watch *fw, const char *path)
+{
+}
+
+bool
+file_watch_contents (struct file_watch *fw, const char *path, const char **contents)
+{
+  return false;
+}
+
+void
+file_watch_process (struct file_watch *fw)
+{
+}
+
+#endif
+#endif
@@ -0,0 +1,115 @@
+/*
+ *  OpenVPN -- An application to securely tunnel IP networks
+ *             over a single TCP/UDP port, with support for SSL/TLS-based
+ *             session authentication and key exchange,
+ *             packet encryption, packet authentication, and
+ *             packet compression.
+ *
+ *  Copyright (C) 2002-2010 OpenVPN Technologies, Inc. <sales@openvpn.net>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2
+ *  as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program (see the file COPYING included with this
+ *  distribution); if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * Change notification for files which the server consults
+ * repeatedly, such as --client-config-dir files and plugin pf
+ * files.  Where inotify is available, the directories holding
+ * them are watched, so that a file is only stat()ed or read
+ * again after the kernel reported a change to it.  Elsewhere,
+ * every query falls through to the filesystem.
+ */
+
+#ifndef FWATCH_H
+#define FWATCH_H
+
+#if P2MP_SERVER
+
+#include "basic.h"
+#include "list.h"
+
+/*
+ * Files larger than this are never cached.
+ */
+#define FILE_WATCH_MAX_SIZE (256*1024)
+
+/*
+ * Upper bound on the number of files tracked, beyond
+ * which the least recently used one is dropped.
+ */
+#define FILE_WATCH_MAX_FILES 4096
+
+struct file_watch_dir
+{
+  struct file_watch_dir *next;
+  char *prefix;             /* directory part of the watched paths */
+  int wd;                   /* -1 if not (or no longer) watched */
+  bool failed;              /* couldn't be watched, don't try again */
+};
+
+struct file_watch_entry
+{
+  struct file_watch_entry *lru_prev;  /* more recently used */
+  struct file_watch_entry *lru_next;  /* less recently used */
+  char *path;
+  struct file_watch_dir *dir;
+  unsigned int generation;  /* changes on each change, never 0 */
+  bool cached;              /* exists and contents are valid */
+  bool exists;
+  bool uncacheable;         /* too large, or a symbolic link */
+  char *contents;
+};
+
+struct file_watch
+{
+  int fd;                         /* inotify descriptor, -1 if not open */
+  bool failed;                    /* inotify unavailable, don't try again */
+  struct file_watch_dir *dirs;
+  struct hash *files;             /* path -> struct file_watch_entry */
+  struct file_watch_entry *lru_head;
+  struct file_watch_entry *lru_tail;
+  unsigned int generation;        /* last generation handed out */
+};
+
+struct file_watch *file_watch_new (void);
+void file_watch_free (struct file_watch *fw);
+
+/*
+ * Start watching path, if it isn't already, after picking up
+ * any pending change events.  Returns NULL if changes to path
+ * cannot be reported, in which case the caller must go to the
+ * filesystem.  The entry is only valid until the next call.
+ */
+const struct file_watch_entry *file_watch_get (struct file_watch *fw, const char *path);
+
+/*
+ * Stop watching path.
+ */
+void file_watch_forget (struct file_watch *fw, const char *path);
+
+/*
+ * Return the contents of path in *contents, read from the
+ * cache where possible, or NULL if the file doesn't exist.
+ * Returns false if path cannot be watched or cached, in which
+ * case the caller must read the file itself.
+ */
+bool file_watch_contents (struct file_watch *fw, const char *path, const char **contents);
+
+/*
+ * Drain pending change events without blocking.
+ */
+void file_watch_process (struct file_watch *fw);
+
+#endif
+#endif
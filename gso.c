@@ -0,0 +1,411 @@
+/*
+ *  OpenVPN -- An application to securely tunnel IP networks
+ *             over a single TCP/UDP port, with support for SSL/TLS-based
+ *             session authentication and key exchange,
+ *             packet encryption, packet authentication, and
+ *             packet compression.
+ *
+ *  Copyright (C) 2002-2010 OpenVPN Technologies, Inc. <sales@openvpn.net>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2
+ *  as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program (see the file COPYING included with this
+ *  distribution); if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "syshead.h"
+
+#ifdef ENABLE_TUN_OFFLOAD
+
+#include "buffer.h"
+#include "integer.h"
+#include "proto.h"
+#include "gso.h"
+
+#include "memdbg.h"
+
+/*
+ * Accumulate the ones-complement sum of len bytes
+ * at p, taken as big-endian 16-bit words.
+ */
+static inline uint32_t
+gso_csum_add (uint32_t sum, const uint8_t *p, int len)
+{
+  while (len > 1)
+    {
+      sum += (p[0] << 8) | p[1];
+      p += 2;
+      len -= 2;
+    }
+  if (len)
+    sum += p[0] << 8;
+  return sum;
+}
+
+static inline uint16_t
+gso_csum_fold (uint32_t sum)
+{
+  while (sum >> 16)
+    sum = (sum & 0xffff) + (sum >> 16);
+  return (uint16_t) sum;
+}
+
+/*
+ * Sum of the TCP pseudo-header for a segment
+ * with l4len bytes of TCP header and payload.
+ */
+static uint32_t
+gso_pseudo_sum (const uint8_t *ip, const bool ipv6, const int l4len)
+{
+  uint32_t sum;
+
+  if (ipv6)
+    sum = gso_csum_add (0, (const uint8_t *) &((const struct openvpn_ipv6hdr *) ip)->saddr, 2 * sizeof (struct in6_addr));
+  else
+    sum = gso_csum_add (0, (const uint8_t *) &((const struct openvpn_iphdr *) ip)->saddr, 2 * sizeof (uint32_t));
+  sum += OPENVPN_IPPROTO_TCP;
+  sum += (uint32_t) l4len & 0xffff;
+  sum += (uint32_t) l4len >> 16;
+  return sum;
+}
+
+static void
+gso_ipv4_checksum (struct openvpn_iphdr *iph, const int ip_hdr_len)
+{
+  iph->check = 0;
+  iph->check = htons ((uint16_t) ~gso_csum_fold (gso_csum_add (0, (const uint8_t *) iph, ip_hdr_len)));
+}
+
+/*
+ * Verify the IPv4 header and TCP checksums of a segment before
+ * merging it, as its own checksums are lost once merged.  A
+ * corrupt segment is written on its own, so that the stack
+ * still drops it.
+ */
+static bool
+gso_csum_ok (const uint8_t *pkt, const int len, const int ip_hdr_len, const bool ipv6)
+{
+  const int l4len = len - ip_hdr_len;
+
+  if (!ipv6 && gso_csum_fold (gso_csum_add (0, pkt, ip_hdr_len)) != 0xffff)
+    return false;
+  return gso_csum_fold (gso_csum_add (gso_pseudo_sum (pkt, ipv6, l4len),
+				      pkt + ip_hdr_len, l4len)) == 0xffff;
+}
+
+/*
+ * If pkt is a TCP packet we know how to segment or merge,
+ * return the length of its IP + TCP headers, otherwise 0.
+ */
+static int
+gso_tcp_hdr_len (const uint8_t *pkt, const int len, int *ip_hdr_len, bool *ipv6)
+{
+  const struct openvpn_tcphdr *tcp;
+  int doff;
+
+  if (len < (int) sizeof (struct openvpn_iphdr))
+    return 0;
+
+  switch (OPENVPN_IPH_GET_VER (pkt[0]))
+    {
+    case 4:
+      {
+	const struct openvpn_iphdr *iph = (const struct openvpn_iphdr *) pkt;
+	*ip_hdr_len = OPENVPN_IPH_GET_LEN (iph->version_len);
+	if (iph->protocol != OPENVPN_IPPROTO_TCP
+	    || *ip_hdr_len < (int) sizeof (struct openvpn_iphdr)
+	    || (ntohs (iph->frag_off) & (OPENVPN_IP_MF|OPENVPN_IP_OFFMASK)))
+	  return 0;
+	*ipv6 = false;
+	break;
+      }
+    case 6:
+      {
+	const struct openvpn_ipv6hdr *ip6 = (const struct openvpn_ipv6hdr *) pkt;
+	if (len < (int) sizeof (struct openvpn_ipv6hdr)
+	    || ip6->nexthdr != OPENVPN_IPPROTO_TCP)
+	  return 0;
+	*ip_hdr_len = sizeof (struct openvpn_ipv6hdr);
+	*ipv6 = true;
+	break;
+      }
+    default:
+      return 0;
+    }
+
+  if (len < *ip_hdr_len + (int) sizeof (struct openvpn_tcphdr))
+    return 0;
+  tcp = (const struct openvpn_tcphdr *) (pkt + *ip_hdr_len);
+  doff = OPENVPN_TCPH_GET_DOFF (tcp->doff_res);
+  if (doff < (int) sizeof (struct openvpn_tcphdr) || len < *ip_hdr_len + doff)
+    return 0;
+  return *ip_hdr_len + doff;
+}
+
+/*
+ * Packet length according to its IP header.
+ */
+static inline int
+gso_ip_len (const uint8_t *pkt, const bool ipv6)
+{
+  if (ipv6)
+    return sizeof (struct openvpn_ipv6hdr) + ntohs (((const struct openvpn_ipv6hdr *) pkt)->payload_len);
+  else
+    return ntohs (((const struct openvpn_iphdr *) pkt)->tot_len);
+}
+
+struct gso_state *
+gso_state_new (void)
+{
+  struct gso_state *gs;
+
+  ALLOC_OBJ_CLEAR (gs, struct gso_state);
+  ALLOC_ARRAY (gs->segmenter.data, uint8_t, GSO_MAX_PACKET);
+  ALLOC_ARRAY (gs->coalescer.data, uint8_t, GSO_MAX_PACKET);
+  return gs;
+}
+
+void
+gso_state_free (struct gso_state *gs)
+{
+  if (gs)
+    {
+      free (gs->segmenter.data);
+      free (gs->coalescer.data);
+      free (gs);
+    }
+}
+
+void
+gso_checksum_complete (uint8_t *pkt, const int len, const struct openvpn_vnet_hdr *vh)
+{
+  const int start = vh->csum_start;
+  const int where = start + vh->csum_offset;
+  uint16_t check;
+
+  if (!(vh->flags & OPENVPN_VNET_HDR_F_NEEDS_CSUM) || where + 2 > len)
+    return;
+
+  /* the checksum field already holds the pseudo-header sum */
+  check = ~gso_csum_fold (gso_csum_add (0, pkt + start, len - start));
+  if (!check)
+    check = 0xffff; /* 0 means "no checksum" to UDP */
+  pkt[where] = check >> 8;
+  pkt[where + 1] = check & 0xff;
+}
+
+bool
+gso_segmenter_load (struct gso_segmenter *s, const struct openvpn_vnet_hdr *vh, const int len)
+{
+  const uint8_t gso_type = vh->gso_type & ~OPENVPN_VNET_HDR_GSO_ECN;
+  const struct openvpn_tcphdr *tcp;
+  bool ipv6;
+
+  s->len = 0;
+  if (gso_type != OPENVPN_VNET_HDR_GSO_TCPV4 && gso_type != OPENVPN_VNET_HDR_GSO_TCPV6)
+    return false;
+
+  s->hdr_len = gso_tcp_hdr_len (s->data, len, &s->ip_hdr_len, &ipv6);
+  if (!s->hdr_len
+      || ipv6 != (gso_type == OPENVPN_VNET_HDR_GSO_TCPV6)
+      || !vh->gso_size
+      || len <= s->hdr_len)
+    return false;
+
+  tcp = (const struct openvpn_tcphdr *) (s->data + s->ip_hdr_len);
+  s->ipv6 = ipv6;
+  s->mss = vh->gso_size;
+  s->offset = s->hdr_len;
+  s->n = 0;
+  s->ip_id = ipv6 ? 0 : ntohs (((const struct openvpn_iphdr *) s->data)->id);
+  s->seq = ntohl (tcp->seq);
+  s->len = len;
+  return true;
+}
+
+int
+gso_segmenter_next (struct gso_segmenter *s, uint8_t *buf, const int maxlen)
+{
+  const int plen = min_int (s->mss, s->len - s->offset);
+  const int len = s->hdr_len + plen;
+  const int l4len = len - s->ip_hdr_len;
+  const bool last = (s->offset + plen >= s->len);
+  struct openvpn_tcphdr *tcp;
+
+  ASSERT (gso_segmenter_pending (s));
+  if (len > maxlen)
+    {
+      s->len = 0;
+      return -1;
+    }
+
+  memcpy (buf, s->data, s->hdr_len);
+  memcpy (buf + s->hdr_len, s->data + s->offset, plen);
+
+  if (s->ipv6)
+    ((struct openvpn_ipv6hdr *) buf)->payload_len = htons (l4len);
+  else
+    {
+      struct openvpn_iphdr *iph = (struct openvpn_iphdr *) buf;
+      iph->tot_len = htons (len);
+      iph->id = htons ((uint16_t) (s->ip_id + s->n));
+      gso_ipv4_checksum (iph, s->ip_hdr_len);
+    }
+
+  tcp = (struct openvpn_tcphdr *) (buf + s->ip_hdr_len);
+  tcp->seq = htonl (s->seq + (s->offset - s->hdr_len));
+  if (!last)
+    tcp->flags &= ~(OPENVPN_TCPH_FIN_MASK|OPENVPN_TCPH_PSH_MASK);
+  if (s->n)
+    tcp->flags &= ~OPENVPN_TCPH_CWR_MASK;
+  tcp->check = 0;
+  tcp->check = htons ((uint16_t) ~gso_csum_fold (gso_csum_add (gso_pseudo_sum (buf, s->ipv6, l4len),
+							       buf + s->ip_hdr_len, l4len)));
+
+  s->offset += plen;
+  ++s->n;
+  if (last)
+    s->len = 0;
+  return len;
+}
+
+bool
+gso_coalesce_start (struct gso_coalescer *co, const uint8_t *pkt, const int len)
+{
+  const struct openvpn_tcphdr *tcp;
+  int ip_hdr_len;
+  bool ipv6;
+  const int hdr_len = gso_tcp_hdr_len (pkt, len, &ip_hdr_len, &ipv6);
+
+  co->len = 0;
+  if (!hdr_len || len <= hdr_len || len > GSO_MAX_PACKET || gso_ip_len (pkt, ipv6) != len)
+    return false;
+
+  /* only plain data segments start a run, anything else is written as-is */
+  tcp = (const struct openvpn_tcphdr *) (pkt + ip_hdr_len);
+  if (tcp->flags != OPENVPN_TCPH_ACK_MASK || tcp->urg_ptr
+      || !gso_csum_ok (pkt, len, ip_hdr_len, ipv6))
+    return false;
+
+  memcpy (co->data, pkt, len);
+  co->len = len;
+  co->ip_hdr_len = ip_hdr_len;
+  co->hdr_len = hdr_len;
+  co->mss = len - hdr_len;
+  co->count = 1;
+  co->ipv6 = ipv6;
+  co->closed = false;
+  co->next_seq = ntohl (tcp->seq) + co->mss;
+  return true;
+}
+
+bool
+gso_coalesce (struct gso_coalescer *co, const uint8_t *pkt, const int len)
+{
+  const int plen = len - co->hdr_len;
+  struct openvpn_tcphdr *held = (struct openvpn_tcphdr *) (co->data + co->ip_hdr_len);
+  const struct openvpn_tcphdr *tcp = (const struct openvpn_tcphdr *) (pkt + co->ip_hdr_len);
+
+  ASSERT (gso_coalesce_pending (co));
+  if (gso_coalesce_full (co) || plen <= 0 || plen > co->mss
+      || OPENVPN_IPH_GET_VER (pkt[0]) != (co->ipv6 ? 6 : 4)
+      || gso_ip_len (pkt, co->ipv6) != len)
+    return false;
+
+  /* same flow, and IP headers which differ only in length and id */
+  if (co->ipv6)
+    {
+      const struct openvpn_ipv6hdr *a = (const struct openvpn_ipv6hdr *) co->data;
+      const struct openvpn_ipv6hdr *b = (const struct openvpn_ipv6hdr *) pkt;
+      if (a->version_prio != b->version_prio
+	  || memcmp (a->flow_lbl, b->flow_lbl, sizeof (a->flow_lbl))
+	  || a->nexthdr != b->nexthdr
+	  || a->hop_limit != b->hop_limit
+	  || memcmp (&a->saddr, &b->saddr, 2 * sizeof (struct in6_addr)))
+	return false;
+    }
+  else
+    {
+      const struct openvpn_iphdr *a = (const struct openvpn_iphdr *) co->data;
+      const struct openvpn_iphdr *b = (const struct openvpn_iphdr *) pkt;
+      if (a->version_len != b->version_len
+	  || a->tos != b->tos
+	  || a->frag_off != b->frag_off
+	  || a->ttl != b->ttl
+	  || a->protocol != b->protocol
+	  || a->saddr != b->saddr
+	  || a->daddr != b->daddr
+	  || memcmp (a + 1, b + 1, co->ip_hdr_len - sizeof (struct openvpn_iphdr)))
+	return false;
+    }
+
+  /* next in-order data segment with identical TCP header and options */
+  if (OPENVPN_TCPH_GET_DOFF (tcp->doff_res) != co->hdr_len - co->ip_hdr_len
+      || tcp->source != held->source
+      || tcp->dest != held->dest
+      || ntohl (tcp->seq) != co->next_seq
+      || tcp->ack_seq != held->ack_seq
+      || (tcp->flags & ~OPENVPN_TCPH_PSH_MASK) != OPENVPN_TCPH_ACK_MASK
+      || tcp->window != held->window
+      || tcp->urg_ptr != held->urg_ptr
+      || memcmp (tcp + 1, held + 1, co->hdr_len - co->ip_hdr_len - sizeof (struct openvpn_tcphdr))
+      || !gso_csum_ok (pkt, len, co->ip_hdr_len, co->ipv6))
+    return false;
+
+  memcpy (co->data + co->len, pkt + co->hdr_len, plen);
+  co->len += plen;
+  co->next_seq += plen;
+  ++co->count;
+
+  /* a short or pushed segment ends the run */
+  if (plen < co->mss || (tcp->flags & OPENVPN_TCPH_PSH_MASK))
+    {
+      held->flags |= tcp->flags;
+      co->closed = true;
+    }
+  return true;
+}
+
+int
+gso_coalesce_finish (struct gso_coalescer *co, struct openvpn_vnet_hdr *vh)
+{
+  CLEAR (*vh);
+  if (co->count > 1)
+    {
+      const int l4len = co->len - co->ip_hdr_len;
+      struct openvpn_tcphdr *tcp = (struct openvpn_tcphdr *) (co->data + co->ip_hdr_len);
+
+      if (co->ipv6)
+	((struct openvpn_ipv6hdr *) co->data)->payload_len = htons (l4len);
+      else
+	{
+	  struct openvpn_iphdr *iph = (struct openvpn_iphdr *) co->data;
+	  iph->tot_len = htons (co->len);
+	  gso_ipv4_checksum (iph, co->ip_hdr_len);
+	}
+
+      /* the kernel completes the checksum from the pseudo-header sum */
+      tcp->check = htons (gso_csum_fold (gso_pseudo_sum (co->data, co->ipv6, l4len)));
+
+      vh->flags = OPENVPN_VNET_HDR_F_NEEDS_CSUM;
+      vh->gso_type = co->ipv6 ? OPENVPN_VNET_HDR_GSO_TCPV6 : OPENVPN_VNET_HDR_GSO_TCPV4;
+      vh->hdr_len = co->hdr_len;
+      vh->gso_size = co->mss;
+      vh->csum_start = co->ip_hdr_len;
+      vh->csum_offset = (uint8_t *) &tcp->check - (uint8_t *) tcp;
+    }
+  return co->len;
+}
+
+#else
+static void dummy(void) {}
+#endif /* ENABLE_TUN_OFFLOAD */
@@ -0,0 +1,189 @@
+/*
+ *  OpenVPN -- An application to securely tunnel IP networks
+ *             over a single TCP/UDP port, with support for SSL/TLS-based
+ *             session authentication and key exchange,
+ *             packet encryption, packet authentication, and
+ *             packet compression.
+ *
+ *  Copyright (C) 2002-2010 OpenVPN Technologies, Inc. <sales@openvpn.net>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2
+ *  as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program (see the file COPYING included with this
+ *  distribution); if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * TCP segmentation and coalescing for TUN devices opened
+ * with IFF_VNET_HDR (--tun-offload).
+ *
+ * On the read side, the kernel hands us TSO super-packets
+ * of up to 64KB which we cut into MTU-sized segments just
+ * before they are encrypted.  On the write side, consecutive
+ * in-order segments of the same TCP flow are merged into a
+ * single super-packet which the kernel segments again (or
+ * delivers as-is to a local socket), so that one write()
+ * carries many packets.
+ */
+
+#ifndef GSO_H
+#define GSO_H
+
+#ifdef ENABLE_TUN_OFFLOAD
+
+#include "basic.h"
+
+/*
+ * The virtio-net header which the Linux tun driver
+ * prepends to each packet when the device is opened
+ * with IFF_VNET_HDR.  Fields are in host byte order.
+ */
+struct openvpn_vnet_hdr {
+# define OPENVPN_VNET_HDR_F_NEEDS_CSUM 1
+  uint8_t  flags;
+
+# define OPENVPN_VNET_HDR_GSO_NONE   0
+# define OPENVPN_VNET_HDR_GSO_TCPV4  1
+# define OPENVPN_VNET_HDR_GSO_TCPV6  4
+# define OPENVPN_VNET_HDR_GSO_ECN    0x80
+  uint8_t  gso_type;
+
+  uint16_t hdr_len;     /* length of IP + TCP headers */
+  uint16_t gso_size;    /* payload bytes per segment */
+  uint16_t csum_start;  /* checksum coverage starts here */
+  uint16_t csum_offset; /* checksum is stored at csum_start + csum_offset */
+};
+
+/*
+ * Largest super-packet we accept from or pass to the kernel.
+ */
+#define GSO_MAX_PACKET 65535
+
+/*
+ * Upper bound on the number of segments merged into one
+ * super-packet on the write side.
+ */
+#define GSO_MAX_SEGMENTS 64
+
+/*
+ * State for cutting a super-packet read from
+ * the tun device into individual segments.
+ */
+struct gso_segmenter
+{
+  uint8_t *data;        /* super-packet, GSO_MAX_PACKET bytes */
+  int len;              /* length of super-packet, 0 if nothing pending */
+  int ip_hdr_len;       /* IP header length */
+  int hdr_len;          /* IP + TCP header length */
+  int offset;           /* offset of next payload byte to emit */
+  int mss;              /* payload bytes per segment */
+  bool ipv6;
+  unsigned int n;       /* segments emitted so far */
+  uint16_t ip_id;       /* IPv4 id of first segment (host order) */
+  uint32_t seq;         /* TCP seq of first segment (host order) */
+};
+
+/*
+ * State for merging segments written to
+ * the tun device into a super-packet.
+ */
+struct gso_coalescer
+{
+  uint8_t *data;        /* super-packet being built, GSO_MAX_PACKET bytes */
+  int len;              /* length of super-packet, 0 if nothing held */
+  int ip_hdr_len;       /* IP header length */
+  int hdr_len;          /* IP + TCP header length */
+  int mss;              /* payload size of the first segment */
+  int count;            /* number of segments merged */
+  bool ipv6;
+  bool closed;          /* last segment was short or pushed, flush next */
+  uint32_t next_seq;    /* TCP seq the next segment must carry (host order) */
+};
+
+struct gso_state
+{
+  struct gso_segmenter segmenter;
+  struct gso_coalescer coalescer;
+};
+
+struct gso_state *gso_state_new (void);
+void gso_state_free (struct gso_state *gs);
+
+/*
+ * Complete a partial (NEEDS_CSUM) transport checksum
+ * on a packet which is not to be segmented.
+ */
+void gso_checksum_complete (uint8_t *pkt, const int len, const struct openvpn_vnet_hdr *vh);
+
+/*
+ * Load the packet of len bytes held in s->data.  Returns false
+ * if the packet cannot be segmented, in which case it should be
+ * dropped.
+ */
+bool gso_segmenter_load (struct gso_segmenter *s, const struct openvpn_vnet_hdr *vh, const int len);
+
+/*
+ * Copy the next segment into buf, returning its length, or
+ * -1 if it does not fit into maxlen bytes (the remainder of
+ * the super-packet is dropped).
+ */
+int gso_segmenter_next (struct gso_segmenter *s, uint8_t *buf, const int maxlen);
+
+static inline bool
+gso_segmenter_pending (const struct gso_segmenter *s)
+{
+  return s->len > 0;
+}
+
+/*
+ * Start a new super-packet with pkt.  Returns false, holding
+ * nothing, if pkt is not a TCP segment which could be merged
+ * with subsequent ones.
+ */
+bool gso_coalesce_start (struct gso_coalescer *co, const uint8_t *pkt, const int len);
+
+/*
+ * Append pkt to the held super-packet if it is the next
+ * in-order segment of the same flow and its checksums
+ * are valid.
+ */
+bool gso_coalesce (struct gso_coalescer *co, const uint8_t *pkt, const int len);
+
+/*
+ * Finalize the held super-packet for writing, filling in *vh.
+ * Returns its length; the caller writes co->data and then
+ * calls gso_coalesce_reset.
+ */
+int gso_coalesce_finish (struct gso_coalescer *co, struct openvpn_vnet_hdr *vh);
+
+static inline bool
+gso_coalesce_pending (const struct gso_coalescer *co)
+{
+  return co->len > 0;
+}
+
+static inline bool
+gso_coalesce_full (const struct gso_coalescer *co)
+{
+  return co->closed
+    || co->count >= GSO_MAX_SEGMENTS
+    || co->len + co->mss > GSO_MAX_PACKET;
+}
+
+static inline void
+gso_coalesce_reset (struct gso_coalescer *co)
+{
+  co->len = 0;
+}
+
+#endif /* ENABLE_TUN_OFFLOAD */
+#endif /* GSO_H */
@@ -36,6 +36,7 @@
 #include "ps.h"
 #include "lladdr.h"
 #include "ping.h"
+#include "bench.h"
 
 #include "memdbg.h"
 
@@ -675,6 +676,11 @@ init_static (void)
   return false;
 #endif
 
+#ifdef BENCH_TEST
+  bench_run ();
+  return false;
+#endif
+
 #ifdef IFCONFIG_POOL_TEST
   ifconfig_pool_test (0x0A010004, 0x0A0100FF);
   return false;
@@ -1100,6 +1106,13 @@ do_init_timers (struct context *c, bool deferred)
   if (c->options.inactivity_timeout)
     event_timeout_init (&c->c2.inactivity_interval, c->options.inactivity_timeout, now);
 
+  /* server instances release idle buffers */
+  if (c->mode == CM_CHILD_UDP || c->mode == CM_CHILD_TCP)
+    {
+      event_timeout_init (&c->c2.idle_release_interval, IDLE_RELEASE_SECONDS, now);
+      c->c2.idle_since = now;
+    }
+
   /* initialize pings */
 
   if (c->options.ping_send_timeout)
@@ -1788,6 +1801,9 @@ do_deferred_options (struct context *c, const unsigned int found)
     msg (D_PUSH, "OPTIONS IMPORT: --ip-win32 and/or --dhcp-option options modified");
   if (found & OPT_P_SETENV)
     msg (D_PUSH, "OPTIONS IMPORT: environment modified");
+
+  /* pulled options may enable --client-nat and the like */
+  data_path_init (c);
 }
 
 /*
@@ -2523,6 +2539,38 @@ init_context_buffers (const struct frame *frame)
   return b;
 }
 
+void
+init_context_buffers_batch (struct context_buffers *b, const struct frame *frame)
+{
+  int i;
+
+  ASSERT (!b->batch_tun_bufs);
+  ALLOC_ARRAY (b->batch_tun_bufs, struct buffer, DATA_BATCH_MAX);
+  for (i = 0; i < DATA_BATCH_MAX; ++i)
+    b->batch_tun_bufs[i] = alloc_buf (BUF_SIZE (frame));
+
+#ifdef USE_CRYPTO
+  ALLOC_ARRAY (b->batch_decrypt_bufs, struct buffer, DATA_BATCH_MAX);
+  for (i = 0; i < DATA_BATCH_MAX; ++i)
+    b->batch_decrypt_bufs[i] = alloc_buf (BUF_SIZE (frame));
+#endif
+
+  ALLOC_OBJ_CLEAR (b->burst_to_link, struct data_burst);
+  ALLOC_OBJ_CLEAR (b->burst_to_tun, struct data_burst);
+}
+
+static void
+free_buf_array (struct buffer *bufs, const int n)
+{
+  if (bufs)
+    {
+      int i;
+      for (i = 0; i < n; ++i)
+	free_buf (&bufs[i]);
+      free (bufs);
+    }
+}
+
 void
 free_context_buffers (struct context_buffers *b)
 {
@@ -2540,8 +2588,13 @@ free_context_buffers (struct context_buffers *b)
 #ifdef USE_CRYPTO
       free_buf (&b->encrypt_buf);
       free_buf (&b->decrypt_buf);
+      free_buf_array (b->batch_decrypt_bufs, DATA_BATCH_MAX);
 #endif
 
+      free_buf_array (b->batch_tun_bufs, DATA_BATCH_MAX);
+      free (b->burst_to_link);
+      free (b->burst_to_tun);
+
       free (b);
     }
 }
@@ -2557,6 +2610,37 @@ do_init_buffers (struct context *c)
   c->c2.buffers_owned = true;
 }
 
+void
+context_buffers_acquire (struct context *c)
+{
+  ASSERT (c->mode == CM_CHILD_TCP);
+  do_init_buffers (c);
+}
+
+static int
+context_buffers_footprint (const struct context_buffers *b)
+{
+  int ret = sizeof (*b)
+    + b->read_link_buf.capacity
+    + b->read_tun_buf.capacity
+    + b->aux_buf.capacity;
+#ifdef USE_CRYPTO
+  ret += b->encrypt_buf.capacity + b->decrypt_buf.capacity;
+#endif
+#ifdef USE_LZO
+  ret += b->lzo_compress_buf.capacity + b->lzo_decompress_buf.capacity;
+#endif
+  if (b->batch_tun_bufs)
+    ret += DATA_BATCH_MAX * (sizeof (struct buffer) + b->batch_tun_bufs[0].capacity);
+#ifdef USE_CRYPTO
+  if (b->batch_decrypt_bufs)
+    ret += DATA_BATCH_MAX * (sizeof (struct buffer) + b->batch_decrypt_bufs[0].capacity);
+#endif
+  if (b->burst_to_link)
+    ret += 2 * sizeof (struct data_burst);
+  return ret;
+}
+
 #ifdef ENABLE_FRAGMENT
 /*
  * Fragmenting code has buffers to initialize
@@ -2777,6 +2861,56 @@ do_close_free_buf (struct context *c)
     }
 }
 
+/*
+ * Free the memory which a server instance only needs while
+ * it passes traffic.  All of it is allocated again on demand.
+ */
+void
+context_release_idle (struct context *c)
+{
+  /* a packet held for output may point into any of these */
+  if (BLEN (&c->c2.to_link) || BLEN (&c->c2.to_tun))
+    return;
+
+  if (c->mode == CM_CHILD_TCP)
+    do_close_free_buf (c);
+
+#ifdef ENABLE_FRAGMENT
+  if (c->c2.fragment)
+    fragment_release_idle (c->c2.fragment);
+#endif
+
+#if defined(USE_CRYPTO) && defined(USE_SSL)
+  if (c->c2.tls_multi)
+    tls_multi_release_idle (c->c2.tls_multi);
+#endif
+}
+
+/*
+ * Bytes of packet buffer and per-tunnel state held by a
+ * context, beyond the context structure itself.
+ */
+int
+context_footprint (const struct context *c)
+{
+  int ret = 0;
+
+  if (c->c2.buffers_owned)
+    ret += context_buffers_footprint (c->c2.buffers);
+
+#ifdef ENABLE_FRAGMENT
+  if (c->c2.fragment)
+    ret += fragment_footprint (c->c2.fragment);
+#endif
+
+#if defined(USE_CRYPTO) && defined(USE_SSL)
+  if (c->c2.tls_multi)
+    ret += tls_multi_footprint (c->c2.tls_multi);
+#endif
+
+  return ret;
+}
+
 /*
  * close TLS
  */
@@ -2879,6 +3013,9 @@ do_event_set_init (struct context *c,
   if (need_us_timeout)
     flags |= EVENT_METHOD_US_TIMEOUT;
 
+  if (c->options.io_uring_poll)
+    flags |= EVENT_METHOD_IO_URING_POLL;
+
   c->c2.event_set = event_set_init (&c->c2.event_set_max, flags);
   c->c2.event_set_owned = true;
 }
@@ -3116,6 +3253,14 @@ management_show_net_callback (void *arg, const int msglevel)
 #endif
 }
 
+static void
+management_callback_delete_event_p2p (void *arg, event_t event)
+{
+  struct context *c = (struct context *) arg;
+  if (c->c2.event_set)
+    event_del (c->c2.event_set, event);
+}
+
 #endif
 
 void
@@ -3129,6 +3274,7 @@ init_management_callback_p2p (struct context *c)
       cb.arg = c;
       cb.status = management_callback_status_p2p;
       cb.show_net = management_show_net_callback;
+      cb.delete_event = management_callback_delete_event_p2p;
 #if HTTP_PROXY_FALLBACK
       cb.http_proxy_fallback_cmd = management_callback_http_proxy_fallback_cmd;
 #endif
@@ -3382,8 +3528,9 @@ init_instance (struct context *c, const struct env_set *env, const unsigned int
   /* initialize TLS MTU variables */
   do_init_frame_tls (c);
 
-  /* init workspace buffers whose size is derived from frame size */
-  if (c->mode == CM_P2P || c->mode == CM_CHILD_TCP)
+  /* init workspace buffers whose size is derived from frame size,
+     TCP server instances defer this until the first packet */
+  if (c->mode == CM_P2P)
     do_init_buffers (c);
 
 #ifdef ENABLE_FRAGMENT
@@ -3395,6 +3542,9 @@ init_instance (struct context *c, const struct env_set *env, const unsigned int
   /* initialize dynamic MTU variable */
   do_init_mssfix (c);
 
+  /* select the data channel stages for this configuration */
+  data_path_init (c);
+
   /* bind the TCP/UDP socket */
   if (c->mode == CM_P2P || c->mode == CM_TOP || c->mode == CM_CHILD_TCP)
     do_init_socket_1 (c, link_socket_mode);
@@ -3562,6 +3712,11 @@ inherit_context_child (struct context *dest,
   /* c1 init */
   packet_id_persist_init (&dest->c1.pid_persist);
 
+#if P2MP_SERVER
+  /* inherit file watch, owned by the multi_context */
+  dest->c1.file_watch = src->c1.file_watch;
+#endif
+
 #ifdef USE_CRYPTO
   dest->c1.ks.key_type = src->c1.ks.key_type;
 #ifdef USE_SSL
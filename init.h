@@ -101,8 +101,14 @@ void close_context (struct context *c, int sig, unsigned int flags);
 
 struct context_buffers *init_context_buffers (const struct frame *frame);
 
+void init_context_buffers_batch (struct context_buffers *b, const struct frame *frame);
+
 void free_context_buffers (struct context_buffers *b);
 
+void context_release_idle (struct context *c);
+
+int context_footprint (const struct context *c);
+
 #define ISC_ERRORS (1<<0)
 #define ISC_SERVER (1<<1)
 void initialization_sequence_completed (struct context *c, const unsigned int flags);
@@ -37,6 +37,14 @@
 #include "memdbg.h"
 
 #ifndef LZO_STUB
+/*
+ * Work memory of the LZO compressor, shared by all workspaces.
+ * The event loop compresses one packet at a time, so a server
+ * needs only one of these however many clients it has.
+ */
+static lzo_voidp lzo_wmem;
+static int lzo_wmem_users;
+
 /**
  * Perform adaptive compression housekeeping.
  *
@@ -110,12 +118,9 @@ lzo_compress_init (struct lzo_compress_workspace *lzowork, unsigned int flags)
 
   lzowork->flags = flags;
 #ifndef LZO_STUB
-  lzowork->wmem_size = LZO_WORKSPACE;
-
   if (lzo_init () != LZO_E_OK)
     msg (M_FATAL, "Cannot initialize LZO compression library");
-  lzowork->wmem = (lzo_voidp) lzo_malloc (lzowork->wmem_size);
-  check_malloc_return (lzowork->wmem);
+  ++lzo_wmem_users;
   msg (D_INIT_MEDIUM, "LZO compression initialized");
 #else
   msg (D_INIT_MEDIUM, "LZO stub compression initialized");
@@ -130,8 +135,11 @@ lzo_compress_uninit (struct lzo_compress_workspace *lzowork)
     {
       ASSERT (lzowork->defined);
 #ifndef LZO_STUB
-      lzo_free (lzowork->wmem);
-      lzowork->wmem = NULL;
+      if (!--lzo_wmem_users && lzo_wmem)
+	{
+	  lzo_free (lzo_wmem);
+	  lzo_wmem = NULL;
+	}
 #endif
       lzowork->defined = false;
     }
@@ -185,7 +193,13 @@ lzo_compress (struct buffer *buf, struct buffer work,
 	  return;
 	}
 
-      err = LZO_COMPRESS (BPTR (buf), BLEN (buf), BPTR (&work), &zlen, lzowork->wmem);
+      if (!lzo_wmem)
+	{
+	  lzo_wmem = (lzo_voidp) lzo_malloc (LZO_WORKSPACE);
+	  check_malloc_return (lzo_wmem);
+	}
+
+      err = LZO_COMPRESS (BPTR (buf), BLEN (buf), BPTR (&work), &zlen, lzo_wmem);
       if (err != LZO_E_OK)
 	{
 	  dmsg (D_COMP_ERRORS, "LZO compression error: %d", err);
@@ -245,9 +259,10 @@ lzo_decompress (struct buffer *buf, struct buffer work,
   if (c == YES_COMPRESS)	/* packet was compressed */
     {
 #ifndef LZO_STUB
+      /* lzo1x decompression takes no work memory, so lzo_wmem may still be NULL */
       ASSERT (buf_safe (&work, zlen));
       err = LZO_DECOMPRESS (BPTR (buf), BLEN (buf), BPTR (&work), &zlen,
-			    lzowork->wmem);
+			    lzo_wmem);
       if (err != LZO_E_OK)
 	{
 	  dmsg (D_COMP_ERRORS, "LZO decompression error: %d", err);
@@ -152,18 +152,18 @@ struct lzo_adaptive_compress {
  *
  * This structure contains compression module state, such as whether
  * compression is enabled and the status of the adaptive compression
- * routines.  It also contains an allocated working buffer.
+ * routines.
  *
  * One of these compression workspace structures is maintained for each
- * VPN tunnel.
+ * VPN tunnel.  The working buffer of the LZO library is not part of it:
+ * packets are compressed one at a time by the event loop, so a single
+ * buffer in lzo.c is shared by all workspaces.
  */
 struct lzo_compress_workspace
 {
   bool defined;
   unsigned int flags;
 #ifndef LZO_STUB
-  lzo_voidp wmem;
-  int wmem_size;
   struct lzo_adaptive_compress ac;
 
   /* statistics */
@@ -196,9 +196,10 @@ void lzo_adjust_frame_parameters(struct frame *frame);
 /**
  * Initialize a compression workspace structure.
  *
- * This function initializes the given workspace structure \a lzowork.
- * This includes allocating a work buffer for internal use and setting its
- * flags to the given value of \a flags.
+ * This function initializes the given workspace structure \a lzowork,
+ * setting its flags to the given value of \a flags.  The shared work
+ * buffer for internal use is allocated once the first packet is
+ * compressed.
  *
  * This function also initializes the lzo library.
  *
@@ -212,8 +213,8 @@ void lzo_compress_init (struct lzo_compress_workspace *lzowork, unsigned int fla
 /**
  * Cleanup a compression workspace structure.
  *
- * This function cleans up the given workspace structure \a lzowork.  This
- * includes freeing the structure's internal work buffer.
+ * This function cleans up the given workspace structure \a lzowork.  The
+ * shared work buffer is freed along with the last workspace.
  *
  * @param lzowork      - A pointer to the workspace structure to clean up.
  */
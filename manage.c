@@ -274,6 +274,8 @@ man_close_socket (struct management *man, const socket_descriptor_t sd)
    */
   if (man->persist.callback.delete_event)
     (*man->persist.callback.delete_event) (man->persist.callback.arg, sd);
+  if (man->connection.es)
+    event_del (man->connection.es, sd);
 #endif
   openvpn_close_socket (sd);
 }
@@ -2123,8 +2125,6 @@ man_connection_close (struct management *man)
 {
   struct man_connection *mc = &man->connection;
 
-  if (mc->es)
-    event_free (mc->es);
 #ifdef WIN32
   net_event_win32_close (&mc->ne32);
 #endif
@@ -2135,6 +2135,8 @@ man_connection_close (struct management *man)
     }
   if (socket_defined (mc->sd_cli))
     man_close_socket (man, mc->sd_cli);
+  if (mc->es)
+    event_free (mc->es);
   if (mc->in)
     command_line_free (mc->in);
   if (mc->out)
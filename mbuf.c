@@ -43,6 +43,27 @@ mbuf_init (unsigned int size)
   return ret;
 }
 
+/*
+ * Move the packets of ms into a new array of size
+ * entries, which must be able to hold them.
+ */
+void
+mbuf_resize (struct mbuf_set *ms, unsigned int size)
+{
+  struct mbuf_item *array;
+  unsigned int i;
+
+  size = adjust_power_of_2 (size);
+  ASSERT (ms->len <= size);
+  ALLOC_ARRAY (array, struct mbuf_item, size);
+  for (i = 0; i < ms->len; ++i)
+    array[i] = ms->array[MBUF_INDEX(ms->head, i, ms->capacity)];
+  free (ms->array);
+  ms->array = array;
+  ms->capacity = size;
+  ms->head = 0;
+}
+
 void
 mbuf_free (struct mbuf_set *ms)
 {
@@ -164,6 +185,429 @@ mbuf_dereference_instance (struct mbuf_set *ms, struct multi_instance *mi)
     }
 }
 
+struct mbuf_fq *
+mbuf_fq_init (unsigned int size)
+{
+  struct mbuf_fq *fq;
+  ALLOC_OBJ_CLEAR (fq, struct mbuf_fq);
+  fq->capacity = adjust_power_of_2 (size);
+  return fq;
+}
+
+void
+mbuf_fq_free (struct mbuf_fq *fq)
+{
+  if (fq)
+    {
+      /* flows belong to their instances, which remove them on close */
+      ASSERT (!fq->head && !fq->sleeping);
+      free (fq);
+    }
+}
+
+static void
+mbuf_fq_link (struct mbuf_fq *fq, struct mbuf_flow *f)
+{
+  f->prev = fq->tail;
+  f->next = NULL;
+  if (fq->tail)
+    fq->tail->next = f;
+  else
+    fq->head = f;
+  fq->tail = f;
+}
+
+static void
+mbuf_fq_unlink (struct mbuf_fq *fq, struct mbuf_flow *f)
+{
+  if (f->prev)
+    f->prev->next = f->next;
+  else
+    fq->head = f->next;
+  if (f->next)
+    f->next->prev = f->prev;
+  else
+    fq->tail = f->prev;
+  f->prev = f->next = NULL;
+}
+
+/*
+ * Move f, whose token buckets stay empty until f->wakeup,
+ * from the round to the list of sleeping queues.
+ */
+static void
+mbuf_fq_sleep (struct mbuf_fq *fq, struct mbuf_flow *f)
+{
+  struct mbuf_flow *prev = NULL;
+  struct mbuf_flow *next = fq->sleeping;
+
+  mbuf_fq_unlink (fq, f);
+  while (next && !tv_lt (&f->wakeup, &next->wakeup))
+    {
+      prev = next;
+      next = next->next;
+    }
+  f->prev = prev;
+  f->next = next;
+  if (prev)
+    prev->next = f;
+  else
+    fq->sleeping = f;
+  if (next)
+    next->prev = f;
+  f->sleeping = true;
+}
+
+static void
+mbuf_fq_unlink_sleeping (struct mbuf_fq *fq, struct mbuf_flow *f)
+{
+  if (f->prev)
+    f->prev->next = f->next;
+  else
+    fq->sleeping = f->next;
+  if (f->next)
+    f->next->prev = f->prev;
+  f->prev = f->next = NULL;
+  f->sleeping = false;
+}
+
+static void
+mbuf_fq_activate (struct mbuf_fq *fq, struct mbuf_flow *f)
+{
+  mbuf_fq_link (fq, f);
+  f->active = true;
+  f->deficit += MBUF_FQ_QUANTUM;
+}
+
+/*
+ * Take an emptied queue out of the round.  Unused credit
+ * is forfeited, but an overdrawn queue keeps its debt so
+ * that it cannot get a fresh quantum by draining.
+ */
+static void
+mbuf_fq_deactivate (struct mbuf_fq *fq, struct mbuf_flow *f)
+{
+  if (f->sleeping)
+    mbuf_fq_unlink_sleeping (fq, f);
+  else
+    mbuf_fq_unlink (fq, f);
+  f->active = false;
+  f->deficit = min_int (f->deficit, 0);
+  if (fq->ready == f)
+    fq->ready = NULL;
+  if (f->queue && !f->queue->len && f->queue->capacity > MBUF_FLOW_RING_MIN)
+    mbuf_resize (f->queue, MBUF_FLOW_RING_MIN);
+}
+
+/*
+ * Move the head queue to the end of the round.
+ */
+static void
+mbuf_fq_rotate (struct mbuf_fq *fq)
+{
+  struct mbuf_flow *f = fq->head;
+  if (f != fq->tail)
+    {
+      mbuf_fq_unlink (fq, f);
+      mbuf_fq_link (fq, f);
+    }
+}
+
+static inline struct mbuf_item *
+mbuf_flow_head (struct mbuf_flow *f)
+{
+  if (f->queue && f->queue->len)
+    return &f->queue->array[f->queue->head];
+  else
+    return NULL;
+}
+
+static bool
+mbuf_flow_extract (struct mbuf_fq *fq, struct mbuf_flow *f, struct mbuf_item *item)
+{
+  if (mbuf_extract_item (f->queue, item))
+    {
+      --fq->len;
+      f->bytes -= BLEN (&item->buffer->buf);
+      return true;
+    }
+  return false;
+}
+
+static void
+mbuf_flow_drop_head (struct mbuf_fq *fq, struct mbuf_flow *f)
+{
+  struct mbuf_item item;
+  if (mbuf_flow_extract (fq, f, &item))
+    mbuf_free_buf (item.buffer);
+  if (fq->ready == f)
+    fq->ready = NULL;
+}
+
+static unsigned int
+isqrt (unsigned int n)
+{
+  unsigned int x = n, y = (n + 1) / 2;
+  while (y < x)
+    {
+      x = y;
+      y = (x + n / x) / 2;
+    }
+  return x;
+}
+
+/*
+ * Next CoDel drop time: t + interval / sqrt(count)
+ */
+static void
+mbuf_codel_control_law (struct timeval *dest, const struct timeval *t, const unsigned int count)
+{
+  struct timeval delta;
+  const unsigned int usec = MBUF_CODEL_INTERVAL / max_int (isqrt (count), 1);
+  delta.tv_sec = usec / 1000000;
+  delta.tv_usec = usec % 1000000;
+  *dest = *t;
+  tv_add (dest, &delta);
+}
+
+static bool
+mbuf_codel_ok_to_drop (struct mbuf_flow *f, const struct mbuf_item *item, const struct timeval *tv)
+{
+  if (tv_subtract (tv, &item->enqueued, 10) < MBUF_CODEL_TARGET || f->queue->len <= 1)
+    {
+      /* went below target, or queue can't drain further */
+      tv_clear (&f->first_above_time);
+    }
+  else if (!tv_defined (&f->first_above_time))
+    {
+      mbuf_codel_control_law (&f->first_above_time, tv, 1);
+    }
+  else if (tv_ge (tv, &f->first_above_time))
+    return true;
+  return false;
+}
+
+/*
+ * Run CoDel on the head of f, dropping packets as needed.
+ * Returns false if f has no packet left to send.
+ */
+static bool
+mbuf_codel_head (struct mbuf_fq *fq, struct mbuf_flow *f, const struct timeval *tv)
+{
+  const struct mbuf_item *item = mbuf_flow_head (f);
+  bool ok_to_drop;
+
+  if (!item)
+    return false;
+
+  ok_to_drop = mbuf_codel_ok_to_drop (f, item, tv);
+  if (f->dropping)
+    {
+      if (!ok_to_drop)
+	f->dropping = false;
+      else
+	{
+	  while (f->dropping && tv_ge (tv, &f->drop_next))
+	    {
+	      mbuf_flow_drop_head (fq, f);
+	      ++f->n_dropped_codel;
+	      ++fq->n_dropped_codel;
+	      ++f->drop_count;
+	      item = mbuf_flow_head (f);
+	      if (!item || !mbuf_codel_ok_to_drop (f, item, tv))
+		f->dropping = false;
+	      else
+		mbuf_codel_control_law (&f->drop_next, &f->drop_next, f->drop_count);
+	    }
+	}
+    }
+  else if (ok_to_drop)
+    {
+      const unsigned int delta = f->drop_count - f->last_drop_count;
+
+      mbuf_flow_drop_head (fq, f);
+      ++f->n_dropped_codel;
+      ++fq->n_dropped_codel;
+      item = mbuf_flow_head (f);
+
+      /* resume at the previous drop rate if we were dropping recently */
+      f->dropping = true;
+      if (delta > 1 && tv_subtract (tv, &f->drop_next, 10) < 16 * MBUF_CODEL_INTERVAL)
+	f->drop_count = delta;
+      else
+	f->drop_count = 1;
+      f->last_drop_count = f->drop_count;
+      mbuf_codel_control_law (&f->drop_next, tv, f->drop_count);
+    }
+  return item != NULL;
+}
+
+/*
+ * Return true if one of the token buckets of f is empty,
+ * setting f->wakeup to the time at which all of them will
+ * allow it to send again.
+ */
+static bool
+mbuf_flow_throttled (struct mbuf_flow *f, const struct timeval *tv)
+{
+  int usec = -1;
+  int i;
+
+  for (i = 0; i < MBUF_FLOW_BUCKETS; ++i)
+    {
+      struct token_bucket *tb = f->bucket[i];
+      if (tb && !token_bucket_allow (tb, tv))
+	usec = max_int (usec, token_bucket_delay (tb));
+    }
+  if (usec >= 0)
+    {
+      struct timeval delta;
+      delta.tv_sec = usec / 1000000;
+      delta.tv_usec = usec % 1000000;
+      f->wakeup = *tv;
+      tv_add (&f->wakeup, &delta);
+      return true;
+    }
+  return false;
+}
+
+/*
+ * Pick the queue to send from next, by deficit round robin.
+ */
+struct mbuf_flow *
+mbuf_fq_select (struct mbuf_fq *fq)
+{
+  struct timeval tv;
+
+  if (fq->ready || !(fq->head || fq->sleeping))
+    return fq->ready;
+
+  openvpn_gettimeofday (&tv, NULL);
+
+  /* sleeping queues whose buckets have refilled rejoin the round */
+  while (fq->sleeping && !tv_lt (&tv, &fq->sleeping->wakeup))
+    {
+      struct mbuf_flow *f = fq->sleeping;
+      mbuf_fq_unlink_sleeping (fq, f);
+      mbuf_fq_link (fq, f);
+    }
+
+  while (fq->head)
+    {
+      struct mbuf_flow *f = fq->head;
+      if (mbuf_flow_shaped (f) && mbuf_flow_throttled (f, &tv))
+	mbuf_fq_sleep (fq, f);
+      else if (f->deficit <= 0)
+	{
+	  f->deficit += MBUF_FQ_QUANTUM;
+	  mbuf_fq_rotate (fq);
+	}
+      else if (mbuf_codel_head (fq, f, &tv))
+	{
+	  fq->ready = f;
+	  break;
+	}
+      else
+	mbuf_fq_deactivate (fq, f);
+    }
+  return fq->ready;
+}
+
+static struct mbuf_flow *
+mbuf_fq_longest (struct mbuf_fq *fq)
+{
+  struct mbuf_flow *ret = fq->head ? fq->head : fq->sleeping;
+  struct mbuf_flow *f;
+  for (f = fq->head; f; f = f->next)
+    if (f->bytes > ret->bytes)
+      ret = f;
+  for (f = fq->sleeping; f; f = f->next)
+    if (f->bytes > ret->bytes)
+      ret = f;
+  return ret;
+}
+
+void
+mbuf_fq_add_item (struct mbuf_fq *fq, struct mbuf_flow *f, const struct mbuf_item *item)
+{
+  struct mbuf_item qi = *item;
+
+  if (fq->len >= fq->capacity)
+    {
+      struct mbuf_flow *longest = mbuf_fq_longest (fq);
+      ASSERT (longest);
+      mbuf_flow_drop_head (fq, longest);
+      ++longest->n_dropped_overflow;
+      ++fq->n_dropped_overflow;
+      msg (D_MULTI_DROPPED, "MBUF: packet dropped from longest client queue");
+    }
+
+  if (!f->queue)
+    f->queue = mbuf_init (min_int (MBUF_FLOW_RING_MIN, fq->capacity));
+  else if (f->queue->len == f->queue->capacity && f->queue->capacity < fq->capacity)
+    mbuf_resize (f->queue, f->queue->capacity * 2);
+  f->instance = item->instance;
+
+  openvpn_gettimeofday (&qi.enqueued, NULL);
+  mbuf_add_item (f->queue, &qi);
+  f->bytes += BLEN (&item->buffer->buf);
+  if (!f->active)
+    mbuf_fq_activate (fq, f);
+
+  if (++fq->len > fq->max_queued)
+    fq->max_queued = fq->len;
+}
+
+bool
+mbuf_fq_extract_item (struct mbuf_fq *fq, struct mbuf_item *item)
+{
+  struct mbuf_flow *f;
+
+  if (mbuf_fq_defined (fq) && (f = mbuf_fq_select (fq)))
+    {
+      int i;
+      ASSERT (mbuf_flow_extract (fq, f, item));
+      fq->ready = NULL;
+      f->deficit -= BLEN (&item->buffer->buf);
+      for (i = 0; i < MBUF_FLOW_BUCKETS; ++i)
+	if (f->bucket[i])
+	  token_bucket_charge (f->bucket[i], BLEN (&item->buffer->buf));
+      if (!f->queue->len)
+	mbuf_fq_deactivate (fq, f);
+      return true;
+    }
+  return false;
+}
+
+bool
+mbuf_fq_throttled (struct mbuf_fq *fq, struct timeval *wakeup)
+{
+  if (mbuf_fq_defined (fq) && !mbuf_fq_select (fq) && fq->sleeping)
+    {
+      *wakeup = fq->sleeping->wakeup;
+      return true;
+    }
+  return false;
+}
+
+void
+mbuf_fq_remove_flow (struct mbuf_fq *fq, struct mbuf_flow *f)
+{
+  if (f->queue)
+    {
+      struct mbuf_item item;
+      while (mbuf_flow_extract (fq, f, &item))
+	{
+	  mbuf_free_buf (item.buffer);
+	  msg (D_MBUF, "MBUF: dereferenced queued packet");
+	}
+      mbuf_free (f->queue);
+      f->queue = NULL;
+    }
+  if (f->active)
+    mbuf_fq_deactivate (fq, f);
+}
+
 #else
 static void dummy(void) {}
 #endif /* P2MP */
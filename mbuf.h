@@ -36,6 +36,8 @@
 
 #include "basic.h"
 #include "buffer.h"
+#include "otime.h"
+#include "shaper.h"
 
 struct multi_instance;
 
@@ -54,6 +56,7 @@ struct mbuf_item
 {
   struct mbuf_buffer *buffer;
   struct multi_instance *instance;
+  struct timeval enqueued;      /* set by mbuf_fq_add_item */
 };
 
 struct mbuf_set
@@ -66,6 +69,7 @@ struct mbuf_set
 };
 
 struct mbuf_set *mbuf_init (unsigned int size);
+void mbuf_resize (struct mbuf_set *ms, unsigned int size);
 void mbuf_free (struct mbuf_set *ms);
 
 struct mbuf_buffer *mbuf_alloc_buf (const struct buffer *buf);
@@ -105,5 +109,168 @@ mbuf_peek (struct mbuf_set *ms)
     return NULL;
 }
 
+/*
+ * Fair queuing of client output.
+ *
+ * Each client has its own queue (struct mbuf_flow).  Queues
+ * with packets waiting are served by deficit round robin, so
+ * that every client gets an equal share of the output in
+ * bytes, and CoDel drops packets from the head of a queue
+ * whose packets have been waiting longer than
+ * MBUF_CODEL_TARGET for at least MBUF_CODEL_INTERVAL.  When
+ * the total number of queued packets reaches the capacity,
+ * a packet is dropped from the longest queue.
+ *
+ * A queue may also be limited by up to MBUF_FLOW_BUCKETS
+ * token buckets (--client-rate).  While any of them is
+ * empty the queue sleeps outside the round, in a list kept
+ * in order of wakeup time, so that the scheduler only has
+ * to look at the earliest one.
+ */
+
+/* bytes a queue may send per round */
+#define MBUF_FQ_QUANTUM      1500
+
+/*
+ * Packets a queue holds before its ring is grown, by
+ * doubling up to the capacity of the whole mbuf_fq.  An
+ * emptied queue goes back to this size.
+ */
+#define MBUF_FLOW_RING_MIN   8
+
+/* CoDel parameters, in microseconds */
+#define MBUF_CODEL_TARGET    5000
+#define MBUF_CODEL_INTERVAL  100000
+
+#define MBUF_FLOW_BUCKETS    2
+
+struct mbuf_flow
+{
+  struct mbuf_set *queue;       /* allocated on first use */
+  struct multi_instance *instance;
+
+  /* queue has packets waiting, in the round or sleeping */
+  bool active;
+  bool sleeping;
+  struct mbuf_flow *prev;
+  struct mbuf_flow *next;
+  struct timeval wakeup;        /* while sleeping */
+
+  int deficit;                  /* DRR byte credit, negative if overdrawn */
+  int bytes;                    /* bytes queued */
+
+  /* rate limits, owned by the instance, NULL if unused */
+  struct token_bucket *bucket[MBUF_FLOW_BUCKETS];
+
+  /* CoDel state */
+  bool dropping;
+  unsigned int drop_count;
+  unsigned int last_drop_count;
+  struct timeval first_above_time;
+  struct timeval drop_next;
+
+  /* statistics */
+  counter_type n_dropped_overflow;
+  counter_type n_dropped_codel;
+};
+
+struct mbuf_fq
+{
+  struct mbuf_flow *head;       /* next queue to serve */
+  struct mbuf_flow *tail;
+  struct mbuf_flow *ready;      /* head queue, its first packet cleared for sending */
+  struct mbuf_flow *sleeping;   /* queues waiting for tokens, earliest wakeup first */
+  unsigned int len;             /* packets queued over all queues */
+  unsigned int capacity;
+  unsigned int max_queued;
+
+  counter_type n_dropped_overflow;
+  counter_type n_dropped_codel;
+};
+
+struct mbuf_fq *mbuf_fq_init (unsigned int size);
+void mbuf_fq_free (struct mbuf_fq *fq);
+
+void mbuf_fq_add_item (struct mbuf_fq *fq, struct mbuf_flow *f, const struct mbuf_item *item);
+
+bool mbuf_fq_extract_item (struct mbuf_fq *fq, struct mbuf_item *item);
+
+/*
+ * Drop all packets queued in f and release its queue.
+ */
+void mbuf_fq_remove_flow (struct mbuf_fq *fq, struct mbuf_flow *f);
+
+static inline bool
+mbuf_fq_defined (const struct mbuf_fq *fq)
+{
+  return fq && fq->len;
+}
+
+static inline int
+mbuf_fq_maximum_queued (const struct mbuf_fq *fq)
+{
+  return (int) fq->max_queued;
+}
+
+/*
+ * If packets are queued but every queue holding them is
+ * waiting for tokens, return true and set *wakeup to the
+ * time at which the first of them may send again.
+ */
+bool mbuf_fq_throttled (struct mbuf_fq *fq, struct timeval *wakeup);
+
+/*
+ * Pick the queue to send from next, by deficit round robin.
+ * Returns NULL if every queue is empty or waiting for tokens.
+ */
+struct mbuf_flow *mbuf_fq_select (struct mbuf_fq *fq);
+
+/*
+ * Return true if mbuf_fq_extract_item has a packet to return.
+ */
+static inline bool
+mbuf_fq_ready (struct mbuf_fq *fq)
+{
+  return mbuf_fq_defined (fq) && mbuf_fq_select (fq);
+}
+
+static inline bool
+mbuf_flow_shaped (const struct mbuf_flow *f)
+{
+  int i;
+  for (i = 0; i < MBUF_FLOW_BUCKETS; ++i)
+    if (f->bucket[i])
+      return true;
+  return false;
+}
+
+static inline int
+mbuf_flow_len (const struct mbuf_flow *f)
+{
+  return f->queue ? (int) f->queue->len : 0;
+}
+
+static inline int
+mbuf_flow_maximum_queued (const struct mbuf_flow *f)
+{
+  return f->queue ? mbuf_maximum_queued (f->queue) : 0;
+}
+
+/*
+ * Return the instance whose packet mbuf_fq_extract_item
+ * will return next.
+ */
+static inline struct multi_instance *
+mbuf_fq_peek (struct mbuf_fq *fq)
+{
+  if (mbuf_fq_defined (fq))
+    {
+      const struct mbuf_flow *f = mbuf_fq_select (fq);
+      if (f)
+	return f->instance;
+    }
+  return NULL;
+}
+
 #endif
 #endif
@@ -0,0 +1,516 @@
+/*
+ *  OpenVPN -- An application to securely tunnel IP networks
+ *             over a single TCP/UDP port, with support for SSL/TLS-based
+ *             session authentication and key exchange,
+ *             packet encryption, packet authentication, and
+ *             packet compression.
+ *
+ *  Copyright (C) 2002-2010 OpenVPN Technologies, Inc. <sales@openvpn.net>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2
+ *  as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program (see the file COPYING included with this
+ *  distribution); if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "syshead.h"
+
+#if P2MP_SERVER
+
+#include "multi.h"
+#include "mcast.h"
+#include "proto.h"
+
+#include "memdbg.h"
+
+/* IGMP message types (RFC 1112, 2236, 3376) */
+#define IGMP_MEMBERSHIP_QUERY      0x11
+#define IGMP_V1_MEMBERSHIP_REPORT  0x12
+#define IGMP_V2_MEMBERSHIP_REPORT  0x16
+#define IGMP_V2_LEAVE_GROUP        0x17
+#define IGMP_V3_MEMBERSHIP_REPORT  0x22
+
+/* MLD message types (RFC 2710, 3810) */
+#define MLD_LISTENER_QUERY         130
+#define MLD_V1_LISTENER_REPORT     131
+#define MLD_V1_LISTENER_DONE       132
+#define MLD_V2_LISTENER_REPORT     143
+
+/* IGMPv3/MLDv2 group record types */
+#define MCAST_MODE_IS_INCLUDE      1
+#define MCAST_MODE_IS_EXCLUDE      2
+#define MCAST_CHANGE_TO_INCLUDE    3
+#define MCAST_CHANGE_TO_EXCLUDE    4
+#define MCAST_ALLOW_NEW_SOURCES    5
+#define MCAST_BLOCK_OLD_SOURCES    6
+
+#define IPV6_NEXTHDR_HOP           0
+#define IPV6_NEXTHDR_ICMP          58
+
+/* general queries ask for reports within 10 seconds */
+#define IGMP_QUERY_LEN             12
+#define IGMP_QUERY_MAX_RESP        100    /* 1/10 seconds */
+#define MLD_QUERY_LEN              28
+#define MLD_QUERY_MAX_RESP         10000  /* milliseconds */
+#define MCAST_QUERY_ROBUSTNESS     2
+#define MCAST_QUERY_INTERVAL       125    /* seconds */
+
+struct mcast_set *
+mcast_init (const int max_groups)
+{
+  struct mcast_set *ms;
+  ALLOC_OBJ_CLEAR (ms, struct mcast_set);
+  ms->hash = hash_init (256,
+			get_random (),
+			mroute_addr_hash_function,
+			mroute_addr_compare_function);
+  ms->max_groups = max_groups;
+  return ms;
+}
+
+static void
+mcast_group_free (struct mcast_group *g)
+{
+  struct mcast_member *mm = g->members;
+  while (mm)
+    {
+      struct mcast_member *next = mm->next;
+      free (mm);
+      mm = next;
+    }
+  free (g);
+}
+
+void
+mcast_free (struct mcast_set *ms)
+{
+  if (ms)
+    {
+      struct hash_iterator hi;
+      struct hash_element *he;
+
+      hash_iterator_init (ms->hash, &hi);
+      while ((he = hash_iterator_next (&hi)))
+	{
+	  mcast_group_free ((struct mcast_group *) he->value);
+	  hash_iterator_delete_element (&hi);
+	}
+      hash_iterator_free (&hi);
+      hash_free (ms->hash);
+      free (ms);
+    }
+}
+
+bool
+mcast_flood_group (const struct mroute_addr *addr)
+{
+  switch (addr->type & MR_ADDR_MASK)
+    {
+    case MR_ADDR_IPV4:
+      /* 224.0.0.0/24, local network control block */
+      return addr->addr[0] == 224 && addr->addr[1] == 0 && addr->addr[2] == 0;
+    case MR_ADDR_IPV6:
+      {
+	/* ff02::1, link-local all-nodes */
+	static const uint8_t all_nodes[16] = { 0xff, 0x02, 0, 0, 0, 0, 0, 0,
+					       0, 0, 0, 0, 0, 0, 0, 0x01 };
+	return !memcmp (addr->addr, all_nodes, sizeof (all_nodes));
+      }
+    }
+  return false;
+}
+
+static void
+mcast_join (struct mcast_set *ms, struct multi_instance *mi, const struct mroute_addr *addr)
+{
+  struct mcast_group *g;
+  struct mcast_member *mm;
+
+  if (mcast_flood_group (addr))
+    return;
+
+  g = (struct mcast_group *) hash_lookup (ms->hash, addr);
+  if (g)
+    {
+      for (mm = g->members; mm; mm = mm->next)
+	if (mm->instance == mi)
+	  return;
+    }
+
+  if (mi->n_mcast_groups >= ms->max_groups)
+    {
+      struct gc_arena gc = gc_new ();
+      msg (D_MULTI_DROPPED, "MCAST: join of %s ignored, client is a member of %d groups already",
+	   mroute_addr_print (addr, &gc),
+	   mi->n_mcast_groups);
+      gc_free (&gc);
+      return;
+    }
+
+  if (!g)
+    {
+      ALLOC_OBJ_CLEAR (g, struct mcast_group);
+      g->addr = *addr;
+      hash_add (ms->hash, &g->addr, g, false);
+    }
+
+  ALLOC_OBJ (mm, struct mcast_member);
+  mm->instance = mi;
+  mm->next = g->members;
+  g->members = mm;
+  ++mi->n_mcast_groups;
+
+  {
+    struct gc_arena gc = gc_new ();
+    msg (D_MULTI_DEBUG, "MCAST: join %s", mroute_addr_print (addr, &gc));
+    gc_free (&gc);
+  }
+}
+
+static void
+mcast_leave (struct mcast_set *ms, struct multi_instance *mi, const struct mroute_addr *addr)
+{
+  struct mcast_group *g = (struct mcast_group *) hash_lookup (ms->hash, addr);
+  if (g)
+    {
+      struct mcast_member **mmp;
+      for (mmp = &g->members; *mmp; mmp = &(*mmp)->next)
+	{
+	  struct mcast_member *mm = *mmp;
+	  if (mm->instance == mi)
+	    {
+	      struct gc_arena gc = gc_new ();
+	      msg (D_MULTI_DEBUG, "MCAST: leave %s", mroute_addr_print (addr, &gc));
+	      gc_free (&gc);
+
+	      *mmp = mm->next;
+	      free (mm);
+	      --mi->n_mcast_groups;
+	      break;
+	    }
+	}
+      if (!g->members)
+	{
+	  hash_remove (ms->hash, &g->addr);
+	  mcast_group_free (g);
+	}
+    }
+}
+
+/*
+ * Apply an IGMPv3 or MLDv2 group record.  Any record which
+ * leaves the client receiving some sources of the group
+ * counts as a join; we do not filter by source.
+ */
+static void
+mcast_record (struct mcast_set *ms, struct multi_instance *mi,
+	      const struct mroute_addr *addr, const int type, const int n_sources)
+{
+  switch (type)
+    {
+    case MCAST_MODE_IS_INCLUDE:
+    case MCAST_CHANGE_TO_INCLUDE:
+      if (n_sources)
+	mcast_join (ms, mi, addr);
+      else
+	mcast_leave (ms, mi, addr);
+      break;
+    case MCAST_MODE_IS_EXCLUDE:
+    case MCAST_CHANGE_TO_EXCLUDE:
+    case MCAST_ALLOW_NEW_SOURCES:
+      mcast_join (ms, mi, addr);
+      break;
+    case MCAST_BLOCK_OLD_SOURCES:
+      break;
+    }
+}
+
+static void
+mcast_get_ipv4 (struct mroute_addr *ma, const uint8_t *src)
+{
+  ma->type = MR_ADDR_IPV4;
+  ma->netbits = 0;
+  ma->len = 4;
+  memcpy (ma->addr, src, 4);
+}
+
+static void
+mcast_get_ipv6 (struct mroute_addr *ma, const uint8_t *src)
+{
+  ma->type = MR_ADDR_IPV6;
+  ma->netbits = 0;
+  ma->len = 16;
+  memcpy (ma->addr, src, 16);
+}
+
+static bool
+mcast_snoop_igmp (struct mcast_set *ms, struct multi_instance *mi, const uint8_t *p, const int len)
+{
+  struct mroute_addr addr;
+
+  if (len < 8)
+    return false;
+
+  switch (p[0])
+    {
+    case IGMP_V1_MEMBERSHIP_REPORT:
+    case IGMP_V2_MEMBERSHIP_REPORT:
+      if (p[4] < 224 || p[4] > 239)
+	return false;
+      mcast_get_ipv4 (&addr, p + 4);
+      mcast_join (ms, mi, &addr);
+      return true;
+    case IGMP_V2_LEAVE_GROUP:
+      if (p[4] < 224 || p[4] > 239)
+	return false;
+      mcast_get_ipv4 (&addr, p + 4);
+      mcast_leave (ms, mi, &addr);
+      return true;
+    case IGMP_V3_MEMBERSHIP_REPORT:
+      {
+	int n_records = (p[6] << 8) | p[7];
+	int offset = 8;
+	while (n_records-- > 0)
+	  {
+	    int n_sources;
+	    if (offset + 8 > len)
+	      break;
+	    n_sources = (p[offset + 2] << 8) | p[offset + 3];
+	    if (p[offset + 4] >= 224 && p[offset + 4] <= 239)
+	      {
+		mcast_get_ipv4 (&addr, p + offset + 4);
+		mcast_record (ms, mi, &addr, p[offset], n_sources);
+	      }
+	    offset += 8 + n_sources * 4 + p[offset + 1] * 4;
+	  }
+	return true;
+      }
+    }
+  return false;
+}
+
+static bool
+mcast_snoop_mld (struct mcast_set *ms, struct multi_instance *mi, const uint8_t *p, const int len)
+{
+  struct mroute_addr addr;
+
+  if (len < 8)
+    return false;
+
+  switch (p[0])
+    {
+    case MLD_V1_LISTENER_REPORT:
+    case MLD_V1_LISTENER_DONE:
+      if (len < 24 || p[8] != 0xff)
+	return false;
+      mcast_get_ipv6 (&addr, p + 8);
+      if (p[0] == MLD_V1_LISTENER_REPORT)
+	mcast_join (ms, mi, &addr);
+      else
+	mcast_leave (ms, mi, &addr);
+      return true;
+    case MLD_V2_LISTENER_REPORT:
+      {
+	int n_records = (p[6] << 8) | p[7];
+	int offset = 8;
+	while (n_records-- > 0)
+	  {
+	    int n_sources;
+	    if (offset + 20 > len)
+	      break;
+	    n_sources = (p[offset + 2] << 8) | p[offset + 3];
+	    if (p[offset + 4] == 0xff)
+	      {
+		mcast_get_ipv6 (&addr, p + offset + 4);
+		mcast_record (ms, mi, &addr, p[offset], n_sources);
+	      }
+	    offset += 20 + n_sources * 16 + p[offset + 1] * 4;
+	  }
+	return true;
+      }
+    }
+  return false;
+}
+
+bool
+mcast_snoop (struct mcast_set *ms, struct multi_instance *mi, const struct buffer *buf)
+{
+  const uint8_t *p = BPTR (buf);
+  int len = BLEN (buf);
+
+  if (len < 1)
+    return false;
+
+  switch (OPENVPN_IPH_GET_VER (*p))
+    {
+    case 4:
+      if (len >= (int) sizeof (struct openvpn_iphdr))
+	{
+	  const struct openvpn_iphdr *ip = (const struct openvpn_iphdr *) p;
+	  const int hlen = OPENVPN_IPH_GET_LEN (ip->version_len);
+	  if (ip->protocol == OPENVPN_IPPROTO_IGMP && hlen >= (int) sizeof (struct openvpn_iphdr) && hlen <= len)
+	    return mcast_snoop_igmp (ms, mi, p + hlen, len - hlen);
+	}
+      break;
+    case 6:
+      if (len >= (int) sizeof (struct openvpn_ipv6hdr))
+	{
+	  const struct openvpn_ipv6hdr *ipv6 = (const struct openvpn_ipv6hdr *) p;
+	  int nexthdr = ipv6->nexthdr;
+	  int offset = sizeof (struct openvpn_ipv6hdr);
+
+	  /* MLD messages carry a router alert in a hop-by-hop options header */
+	  if (nexthdr == IPV6_NEXTHDR_HOP)
+	    {
+	      if (offset + 8 > len)
+		return false;
+	      nexthdr = p[offset];
+	      offset += 8 + p[offset + 1] * 8;
+	    }
+	  if (nexthdr == IPV6_NEXTHDR_ICMP && offset <= len)
+	    return mcast_snoop_mld (ms, mi, p + offset, len - offset);
+	}
+      break;
+    }
+  return false;
+}
+
+static uint32_t
+mcast_sum (uint32_t sum, const uint8_t *p, const int len)
+{
+  int i;
+
+  for (i = 0; i + 1 < len; i += 2)
+    sum += (p[i] << 8) | p[i + 1];
+  if (i < len)
+    sum += p[i] << 8;
+  return sum;
+}
+
+static uint16_t
+mcast_checksum (uint32_t sum, const uint8_t *p, const int len)
+{
+  sum = mcast_sum (sum, p, len);
+  while (sum >> 16)
+    sum = (sum & 0xffff) + (sum >> 16);
+  return htons ((uint16_t) ~sum);
+}
+
+int
+mcast_igmp_query (uint8_t *buf, const in_addr_t local)
+{
+  struct openvpn_iphdr *ip = (struct openvpn_iphdr *) buf;
+  uint8_t *ra = buf + sizeof (struct openvpn_iphdr);
+  uint8_t *q = ra + 4;
+  const int hlen = sizeof (struct openvpn_iphdr) + 4;
+
+  memset (buf, 0, hlen + IGMP_QUERY_LEN);
+  ip->version_len = 0x40 | (hlen >> 2);
+  ip->tos = 0xc0;
+  ip->tot_len = htons (hlen + IGMP_QUERY_LEN);
+  ip->ttl = 1;
+  ip->protocol = OPENVPN_IPPROTO_IGMP;
+  ip->saddr = htonl (local);
+  ip->daddr = htonl (0xe0000001); /* 224.0.0.1 */
+
+  /* router alert, RFC 2113 */
+  ra[0] = 0x94;
+  ra[1] = 4;
+  ip->check = mcast_checksum (0, buf, hlen);
+
+  /* IGMPv3 general query, also understood by IGMPv1/v2 hosts */
+  q[0] = IGMP_MEMBERSHIP_QUERY;
+  q[1] = IGMP_QUERY_MAX_RESP;
+  q[8] = MCAST_QUERY_ROBUSTNESS;
+  q[9] = MCAST_QUERY_INTERVAL;
+  *(uint16_t *) (q + 2) = mcast_checksum (0, q, IGMP_QUERY_LEN);
+
+  return hlen + IGMP_QUERY_LEN;
+}
+
+int
+mcast_mld_query (uint8_t *buf)
+{
+  /* hosts only accept queries from a link-local address */
+  static const uint8_t querier[16] = { 0xfe, 0x80, 0, 0, 0, 0, 0, 0,
+				       0, 0, 0, 0, 0, 0, 0, 0x01 };
+  static const uint8_t all_nodes[16] = { 0xff, 0x02, 0, 0, 0, 0, 0, 0,
+					 0, 0, 0, 0, 0, 0, 0, 0x01 };
+  struct openvpn_ipv6hdr *ipv6 = (struct openvpn_ipv6hdr *) buf;
+  uint8_t *hop = buf + sizeof (struct openvpn_ipv6hdr);
+  uint8_t *q = hop + 8;
+  uint32_t sum;
+
+  memset (buf, 0, sizeof (struct openvpn_ipv6hdr) + 8 + MLD_QUERY_LEN);
+  ipv6->version_prio = 0x60;
+  ipv6->payload_len = htons (8 + MLD_QUERY_LEN);
+  ipv6->nexthdr = IPV6_NEXTHDR_HOP;
+  ipv6->hop_limit = 1;
+  memcpy (&ipv6->saddr, querier, 16);
+  memcpy (&ipv6->daddr, all_nodes, 16);
+
+  /* hop-by-hop options header with router alert, RFC 2711 */
+  hop[0] = IPV6_NEXTHDR_ICMP;
+  hop[2] = 5;
+  hop[3] = 2;
+  hop[6] = 1; /* PadN */
+
+  /* MLDv2 general query, also understood by MLDv1 hosts */
+  q[0] = MLD_LISTENER_QUERY;
+  q[4] = MLD_QUERY_MAX_RESP >> 8;
+  q[5] = MLD_QUERY_MAX_RESP & 0xff;
+  q[24] = MCAST_QUERY_ROBUSTNESS;
+  q[25] = MCAST_QUERY_INTERVAL;
+  sum = mcast_sum (MLD_QUERY_LEN + IPV6_NEXTHDR_ICMP, (const uint8_t *) &ipv6->saddr, 32);
+  *(uint16_t *) (q + 2) = mcast_checksum (sum, q, MLD_QUERY_LEN);
+
+  return sizeof (struct openvpn_ipv6hdr) + 8 + MLD_QUERY_LEN;
+}
+
+void
+mcast_delete_instance (struct mcast_set *ms, struct multi_instance *mi)
+{
+  struct hash_iterator hi;
+  struct hash_element *he;
+
+  if (!mi->n_mcast_groups)
+    return;
+
+  hash_iterator_init (ms->hash, &hi);
+  while ((he = hash_iterator_next (&hi)))
+    {
+      struct mcast_group *g = (struct mcast_group *) he->value;
+      struct mcast_member **mmp = &g->members;
+      while (*mmp)
+	{
+	  struct mcast_member *mm = *mmp;
+	  if (mm->instance == mi)
+	    {
+	      *mmp = mm->next;
+	      free (mm);
+	    }
+	  else
+	    mmp = &mm->next;
+	}
+      if (!g->members)
+	{
+	  hash_iterator_delete_element (&hi);
+	  mcast_group_free (g);
+	}
+    }
+  hash_iterator_free (&hi);
+  mi->n_mcast_groups = 0;
+}
+
+#else
+static void dummy(void) {}
+#endif /* P2MP_SERVER */
@@ -0,0 +1,111 @@
+/*
+ *  OpenVPN -- An application to securely tunnel IP networks
+ *             over a single TCP/UDP port, with support for SSL/TLS-based
+ *             session authentication and key exchange,
+ *             packet encryption, packet authentication, and
+ *             packet compression.
+ *
+ *  Copyright (C) 2002-2010 OpenVPN Technologies, Inc. <sales@openvpn.net>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2
+ *  as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program (see the file COPYING included with this
+ *  distribution); if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef MCAST_H
+#define MCAST_H
+
+/*
+ * IGMP/MLD snooping for TUN-mode servers.
+ *
+ * Membership reports sent by clients are used to
+ * maintain, for each multicast group, the set of
+ * client instances which have joined it, so that
+ * multicast packets can be delivered to group
+ * members only rather than to every client.
+ */
+
+#if P2MP_SERVER
+
+#include "basic.h"
+#include "buffer.h"
+#include "list.h"
+#include "mroute.h"
+
+struct multi_instance;
+
+/*
+ * Default maximum number of groups a single client may join.
+ */
+#define MCAST_MAX_GROUPS_DEFAULT 64
+
+struct mcast_member
+{
+  struct multi_instance *instance;
+  struct mcast_member *next;
+};
+
+struct mcast_group
+{
+  struct mroute_addr addr;
+  struct mcast_member *members;
+};
+
+struct mcast_set
+{
+  struct hash *hash;          /* struct mcast_group indexed by group address */
+  int max_groups;             /* per-client limit on joined groups */
+};
+
+struct mcast_set *mcast_init (const int max_groups);
+void mcast_free (struct mcast_set *ms);
+
+/*
+ * Examine a packet sent by mi.  If it is an IGMP or MLD
+ * membership report or leave, update the group memberships
+ * of mi and return true.
+ */
+bool mcast_snoop (struct mcast_set *ms, struct multi_instance *mi, const struct buffer *buf);
+
+/*
+ * Forget all group memberships of mi.
+ */
+void mcast_delete_instance (struct mcast_set *ms, struct multi_instance *mi);
+
+/*
+ * Build an IGMP (IPv4) or MLD (IPv6) general query into buf,
+ * which must hold MCAST_QUERY_MAX bytes, and return its length.
+ * Sent to a client when it connects, so that it reports the
+ * groups it still belongs to, for instance after reconnecting
+ * with --persist-tun, rather than only the ones it joins later.
+ */
+#define MCAST_QUERY_MAX 76
+
+int mcast_igmp_query (uint8_t *buf, const in_addr_t local);
+int mcast_mld_query (uint8_t *buf);
+
+/*
+ * Return true if packets sent to addr must reach every client,
+ * because hosts do not report membership of such groups
+ * (224.0.0.0/24 and ff02::1).
+ */
+bool mcast_flood_group (const struct mroute_addr *addr);
+
+static inline const struct mcast_group *
+mcast_lookup (struct mcast_set *ms, const struct mroute_addr *addr)
+{
+  return (const struct mcast_group *) hash_lookup (ms->hash, addr);
+}
+
+#endif /* P2MP_SERVER */
+#endif /* MCAST_H */
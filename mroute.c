@@ -146,75 +146,70 @@ mroute_extract_addr_arp (struct mroute_addr *src,
 
 #endif
 
-unsigned int
-mroute_extract_addr_ipv4 (struct mroute_addr *src,
-			  struct mroute_addr *dest,
-			  const struct buffer *buf)
+/*
+ * Extract the addresses of the IP packet which pi
+ * found at its l3 offset.
+ */
+static unsigned int
+mroute_extract_addr_ip (struct mroute_addr *src,
+			struct mroute_addr *dest,
+			const struct packet_info *pi)
 {
   unsigned int ret = 0;
-  if (BLEN (buf) >= 1)
+  if (pi->flags & PI_IPV4)
     {
-      switch (OPENVPN_IPH_GET_VER (*BPTR(buf)))
-	{
-	case 4:
-	  if (BLEN (buf) >= (int) sizeof (struct openvpn_iphdr))
-	    {
-	      const struct openvpn_iphdr *ip = (const struct openvpn_iphdr *) BPTR (buf);
+      const struct openvpn_iphdr *ip = (const struct openvpn_iphdr *) (pi->data + pi->l3);
 
-	      mroute_get_in_addr_t (src, ip->saddr, 0);
-	      mroute_get_in_addr_t (dest, ip->daddr, 0);
+      mroute_get_in_addr_t (src, ip->saddr, 0);
+      mroute_get_in_addr_t (dest, ip->daddr, 0);
 
-	      /* multicast packet? */
-	      if (mroute_is_mcast (ip->daddr))
-		ret |= MROUTE_EXTRACT_MCAST;
+      /* multicast packet? */
+      if (mroute_is_mcast (ip->daddr))
+	ret |= MROUTE_EXTRACT_MCAST;
 
-	      /* IGMP message? */
-	      if (ip->protocol == OPENVPN_IPPROTO_IGMP)
-		ret |= MROUTE_EXTRACT_IGMP;
+      /* IGMP message? */
+      if (pi->flags & PI_IGMP)
+	ret |= MROUTE_EXTRACT_IGMP;
 
-	      ret |= MROUTE_EXTRACT_SUCCEEDED;
-	    }
-	  break;
-	case 6:
-	  if (BLEN (buf) >= (int) sizeof (struct openvpn_ipv6hdr))
-	    {
-	      const struct openvpn_ipv6hdr *ipv6 = (const struct openvpn_ipv6hdr *) BPTR (buf);
-#if 0				/* very basic debug */
-	      struct gc_arena gc = gc_new ();
-	      msg( M_INFO, "IPv6 packet! src=%s, dst=%s",
-			print_in6_addr( ipv6->saddr, 0, &gc ),
-			print_in6_addr( ipv6->daddr, 0, &gc ));
-	      gc_free (&gc);
-#endif
+      ret |= MROUTE_EXTRACT_SUCCEEDED;
+    }
+  else if (pi->flags & PI_IPV6)
+    {
+      const struct openvpn_ipv6hdr *ipv6 = (const struct openvpn_ipv6hdr *) (pi->data + pi->l3);
 
-	      mroute_get_in6_addr (src, ipv6->saddr, 0);
-	      mroute_get_in6_addr (dest, ipv6->daddr, 0);
+      mroute_get_in6_addr (src, ipv6->saddr, 0);
+      mroute_get_in6_addr (dest, ipv6->daddr, 0);
 
-	      if (mroute_is_mcast_ipv6 (ipv6->daddr))
-		ret |= MROUTE_EXTRACT_MCAST;
+      if (mroute_is_mcast_ipv6 (ipv6->daddr))
+	ret |= MROUTE_EXTRACT_MCAST;
 
-	      ret |= MROUTE_EXTRACT_SUCCEEDED;
-	    }
-	  break;
-	default:
-	    msg (M_WARN, "IP packet with unknown IP version=%d seen",
-	                 OPENVPN_IPH_GET_VER (*BPTR(buf)));
-	}
+      ret |= MROUTE_EXTRACT_SUCCEEDED;
     }
   return ret;
 }
 
 unsigned int
-mroute_extract_addr_ether (struct mroute_addr *src,
-			   struct mroute_addr *dest,
-			   struct mroute_addr *esrc,
-			   struct mroute_addr *edest,
-			   const struct buffer *buf)
+mroute_extract_addr_classified (struct mroute_addr *src,
+				struct mroute_addr *dest,
+				struct mroute_addr *esrc,
+				struct mroute_addr *edest,
+				const struct packet_info *pi)
 {
   unsigned int ret = 0;
-  if (BLEN (buf) >= (int) sizeof (struct openvpn_ethhdr))
+
+  if (pi->tunnel_type == DEV_TYPE_TUN)
+    {
+      ret = mroute_extract_addr_ip (src, dest, pi);
+      if (!ret && pi->len >= 1)
+	{
+	  const int ver = OPENVPN_IPH_GET_VER (*pi->data);
+	  if (ver != 4 && ver != 6)
+	    msg (M_WARN, "IP packet with unknown IP version=%d seen", ver);
+	}
+    }
+  else if (pi->tunnel_type == DEV_TYPE_TAP && (pi->flags & PI_ETHER))
     {
-      const struct openvpn_ethhdr *eth = (const struct openvpn_ethhdr *) BPTR (buf);
+      const struct openvpn_ethhdr *eth = (const struct openvpn_ethhdr *) pi->data;
       if (src)
 	{
 	  src->type = MR_ADDR_ETHER;
@@ -239,18 +234,13 @@ mroute_extract_addr_ether (struct mroute_addr *src,
 #ifdef ENABLE_PF
       if (esrc || edest)
 	{
-	  struct buffer b = *buf;
-	  if (buf_advance (&b, sizeof (struct openvpn_ethhdr)))
+	  if (pi->flags & PI_IPV4)
+	    ret |= (mroute_extract_addr_ip (esrc, edest, pi) << MROUTE_SEC_SHIFT);
+	  else if (pi->flags & PI_ARP)
 	    {
-	      switch (ntohs (eth->proto))
-		{
-		case OPENVPN_ETH_P_IPV4:
-		  ret |= (mroute_extract_addr_ipv4 (esrc, edest, &b) << MROUTE_SEC_SHIFT);
-		  break;
-		case OPENVPN_ETH_P_ARP:
-		  ret |= (mroute_extract_addr_arp (esrc, edest, &b) << MROUTE_SEC_SHIFT);
-		  break;
-		}
+	      struct buffer b;
+	      buf_set_read (&b, pi->data + pi->l3, pi->len - pi->l3);
+	      ret |= (mroute_extract_addr_arp (esrc, edest, &b) << MROUTE_SEC_SHIFT);
 	    }
 	}
 #endif
@@ -30,6 +30,7 @@
 #include "buffer.h"
 #include "list.h"
 #include "route.h"
+#include "proto.h"
 
 #define IP_MCAST_SUBNET_MASK  ((in_addr_t)240<<24)
 #define IP_MCAST_NETWORK      ((in_addr_t)224<<24)
@@ -130,6 +131,16 @@ void mroute_helper_del_iroute (struct mroute_helper *mh, const struct iroute *ir
 void mroute_helper_add_iroute6 (struct mroute_helper *mh, const struct iroute_ipv6 *ir6);
 void mroute_helper_del_iroute6 (struct mroute_helper *mh, const struct iroute_ipv6 *ir6);
 
+/*
+ * Return the src and dest addresses of the
+ * packet which pi classified.
+ */
+unsigned int mroute_extract_addr_classified (struct mroute_addr *src,
+					     struct mroute_addr *dest,
+					     struct mroute_addr *esrc,
+					     struct mroute_addr *edest,
+					     const struct packet_info *pi);
+
 /*
  * Given a raw packet in buf, return the src and dest
  * addresses of the packet.
@@ -142,22 +153,9 @@ mroute_extract_addr_from_packet (struct mroute_addr *src,
 				 const struct buffer *buf,
 				 int tunnel_type)
 {
-  unsigned int mroute_extract_addr_ipv4 (struct mroute_addr *src,
-					 struct mroute_addr *dest,
-					 const struct buffer *buf);
-
-  unsigned int mroute_extract_addr_ether (struct mroute_addr *src,
-					  struct mroute_addr *dest,
-					  struct mroute_addr *esrc,
-					  struct mroute_addr *edest,
-					  const struct buffer *buf);
-  unsigned int ret = 0;
-  verify_align_4 (buf);
-  if (tunnel_type == DEV_TYPE_TUN)
-    ret = mroute_extract_addr_ipv4 (src, dest, buf);
-  else if (tunnel_type == DEV_TYPE_TAP)
-    ret = mroute_extract_addr_ether (src, dest, esrc, edest, buf);
-  return ret;
+  struct packet_info pi;
+  packet_classify (&pi, buf, tunnel_type);
+  return mroute_extract_addr_classified (src, dest, esrc, edest, &pi);
 }
 
 static inline bool
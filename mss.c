@@ -30,39 +30,9 @@
 /*
  * Lower MSS on TCP SYN packets to fix MTU
  * problems which arise from protocol
- * encapsulation.
+ * encapsulation.  buf holds the TCP segment,
+ * see process_ipv4_header.
  */
-void
-mss_fixup (struct buffer *buf, int maxmss)
-{
-  const struct openvpn_iphdr *pip;
-  int hlen;
-
-  if (BLEN (buf) < (int) sizeof (struct openvpn_iphdr))
-    return;
-  
-  verify_align_4 (buf);
-  pip = (struct openvpn_iphdr *) BPTR (buf);
-
-  hlen = OPENVPN_IPH_GET_LEN (pip->version_len);
-
-  if (pip->protocol == OPENVPN_IPPROTO_TCP
-      && ntohs (pip->tot_len) == BLEN (buf)
-      && (ntohs (pip->frag_off) & OPENVPN_IP_OFFMASK) == 0
-      && hlen <= BLEN (buf)
-      && BLEN (buf) - hlen
-         >= (int) sizeof (struct openvpn_tcphdr))
-    {
-      struct buffer newbuf = *buf;
-      if (buf_advance (&newbuf, hlen))
-	{
-	  struct openvpn_tcphdr *tc = (struct openvpn_tcphdr *) BPTR (&newbuf);
-	  if (tc->flags & OPENVPN_TCPH_SYN_MASK)
-	    mss_fixup_dowork (&newbuf, (uint16_t) maxmss);
-	}
-    }
-}
-
 void
 mss_fixup_dowork (struct buffer *buf, uint16_t maxmss)
 {
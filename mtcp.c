@@ -168,7 +168,7 @@ multi_tcp_instance_specific_free (struct multi_instance *mi)
 }
 
 struct multi_tcp *
-multi_tcp_init (int maxevents, int *maxclients)
+multi_tcp_init (int maxevents, int *maxclients, unsigned int event_flags)
 {
   struct multi_tcp *mtcp;
   const int extra_events = BASE_N_EVENTS;
@@ -178,7 +178,7 @@ multi_tcp_init (int maxevents, int *maxclients)
 
   ALLOC_OBJ_CLEAR (mtcp, struct multi_tcp);
   mtcp->maxevents = maxevents + extra_events;
-  mtcp->es = event_set_init (&mtcp->maxevents, 0);
+  mtcp->es = event_set_init (&mtcp->maxevents, event_flags);
   wait_signal (mtcp->es, MTCP_SIG);
   ALLOC_ARRAY (mtcp->esr, struct event_set_return, mtcp->maxevents);
   *maxclients = max_int (min_int (mtcp->maxevents - extra_events, *maxclients), 1);
@@ -239,6 +239,7 @@ multi_tcp_wait (const struct context *c,
   if (management)
     management_socket_set (management, mtcp->es, MTCP_MANAGEMENT, &mtcp->management_persist_flags);
 #endif
+  tun_write_flush (c->c1.tuntap);
   status = event_wait (mtcp->es, &c->c2.timeval, mtcp->esr, mtcp->maxevents);
   update_time ();
   mtcp->n_esr = 0;
@@ -575,6 +576,19 @@ multi_tcp_action (struct multi_context *m, struct multi_instance *mi, int action
   } while (action != TA_UNDEF);
 }
 
+/*
+ * Process queued mbuf packets destined for TCP socket
+ */
+static void
+multi_tcp_process_queue (struct multi_context *m)
+{
+  struct multi_instance *mi;
+  while (!IS_SIG (&m->top) && (mi = mbuf_fq_peek (m->mbuf)) != NULL)
+    {
+      multi_tcp_action (m, mi, TA_SOCKET_WRITE, true);
+    }
+}
+
 static void
 multi_tcp_process_io (struct multi_context *m)
 {
@@ -613,7 +627,13 @@ multi_tcp_process_io (struct multi_context *m)
 	      if (e->rwflags & EVENT_WRITE)
 		multi_tcp_action (m, NULL, TA_TUN_WRITE, false);
 	      else if (e->rwflags & EVENT_READ)
-		multi_tcp_action (m, NULL, TA_TUN_READ, false);
+		{
+		  multi_tcp_action (m, NULL, TA_TUN_READ, false);
+
+		  /* drain the rest of a super-packet read with --tun-offload */
+		  while (tun_read_residual (m->top.c1.tuntap) && !IS_SIG (&m->top))
+		    multi_tcp_action (m, NULL, TA_TUN_READ, false);
+		}
 	    }
 	  /* new incoming TCP client attempting to connect? */
 	  else if (e->arg == MTCP_SOCKET)
@@ -636,16 +656,7 @@ multi_tcp_process_io (struct multi_context *m)
     }
   mtcp->n_esr = 0;
 
-  /*
-   * Process queued mbuf packets destined for TCP socket
-   */
-  {
-    struct multi_instance *mi;
-    while (!IS_SIG (&m->top) && (mi = mbuf_peek (m->mbuf)) != NULL)
-      {
-	multi_tcp_action (m, mi, TA_SOCKET_WRITE, true);
-      }
-  }
+  multi_tcp_process_queue (m);
 }
 
 /*
@@ -701,6 +712,9 @@ tunnel_server_tcp (struct context *top)
       else if (status == 0)
 	{
 	  multi_tcp_action (&multi, NULL, TA_TIMEOUT, false);
+
+	  /* rate-limited output may have become ready to send */
+	  multi_tcp_process_queue (&multi);
 	}
 
       perf_pop ();
@@ -51,7 +51,7 @@ struct multi_tcp
 struct multi_instance;
 struct context;
 
-struct multi_tcp *multi_tcp_init (int maxevents, int *maxclients);
+struct multi_tcp *multi_tcp_init (int maxevents, int *maxclients, unsigned int event_flags);
 void multi_tcp_free (struct multi_tcp *mtcp);
 void multi_tcp_dereference_instance (struct multi_tcp *mtcp, struct multi_instance *mi);
 
@@ -191,7 +191,7 @@ p2mp_iow_flags (const struct multi_context *m)
       if (LINK_OUT (&m->pending->context))
 	flags |= IOW_TO_LINK;
     }
-  else if (mbuf_defined (m->mbuf))
+  else if (mbuf_fq_ready (m->mbuf))
     flags |= IOW_MBUF;
   else
     flags |= IOW_READ;
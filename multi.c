@@ -249,6 +249,11 @@ multi_init (struct multi_context *m, struct context *t, bool tcp_mode, int threa
   
   m->thread_mode = thread_mode;
 
+  /*
+   * Client instances are allocated from a slab.
+   */
+  m->instance_slab = slab_init (sizeof (struct multi_instance), MULTI_INSTANCE_SLAB_BLOCK);
+
   /*
    * Real address hash table (source port number is
    * considered to be part of the address).  Used
@@ -302,7 +307,7 @@ multi_init (struct multi_context *m, struct context *t, bool tcp_mode, int threa
   /*
    * Allocate broadcast/multicast buffer list
    */
-  m->mbuf = mbuf_init (t->options.n_bcast_buf);
+  m->mbuf = mbuf_fq_init (t->options.n_bcast_buf);
 
   /*
    * Different status file format options are available
@@ -360,7 +365,9 @@ multi_init (struct multi_context *m, struct context *t, bool tcp_mode, int threa
    * Initialize multi-socket TCP I/O wait object
    */
   if (tcp_mode)
-    m->mtcp = multi_tcp_init (t->options.max_clients, &m->max_clients);
+    m->mtcp = multi_tcp_init (t->options.max_clients,
+			      &m->max_clients,
+			      t->options.io_uring_poll ? EVENT_METHOD_IO_URING_POLL : 0);
   m->tcp_queue_limit = t->options.tcp_queue_limit;
   
   /*
@@ -368,6 +375,37 @@ multi_init (struct multi_context *m, struct context *t, bool tcp_mode, int threa
    * tun/tap interface and network stack?
    */
   m->enable_c2c = t->options.enable_c2c;
+
+  /*
+   * Deliver multicast only to clients which
+   * have joined the group?
+   */
+  if (t->options.mcast_snooping && dev == DEV_TYPE_TUN)
+    m->mcast = mcast_init (t->options.mcast_max_groups);
+
+  /*
+   * Answer ARP and neighbor solicitations
+   * between clients ourselves?
+   */
+  if (t->options.neighbor_proxy && t->options.enable_c2c && dev == DEV_TYPE_TAP)
+    m->neigh = neigh_init (t->options.neighbor_proxy_max);
+
+  /*
+   * Token buckets shared by groups of clients.
+   */
+  {
+    const struct rate_group_option *rgo;
+    for (rgo = t->options.rate_groups; rgo; rgo = rgo->next)
+      {
+	struct multi_rate_group *rg;
+	ALLOC_OBJ_CLEAR (rg, struct multi_rate_group);
+	rg->name = rgo->name;
+	token_bucket_init (&rg->down, rgo->down, rgo->burst);
+	token_bucket_init (&rg->up, rgo->up, rgo->burst);
+	rg->next = m->rate_groups;
+	m->rate_groups = rg;
+      }
+  }
 }
 
 const char *
@@ -540,9 +578,16 @@ multi_close_instance (struct multi_context *m,
       if (m->mtcp)
 	multi_tcp_dereference_instance (m->mtcp, mi);
 
-      mbuf_dereference_instance (m->mbuf, mi);
+      if (m->mcast)
+	mcast_delete_instance (m->mcast, mi);
+
+      if (m->neigh)
+	neigh_delete_instance (m->neigh, mi);
     }
 
+  if (m->mbuf)
+    mbuf_fq_remove_flow (m->mbuf, &mi->mbuf_flow);
+
 #ifdef MANAGEMENT_DEF_AUTH
   set_cc_config (mi, NULL);
 #endif
@@ -604,12 +649,21 @@ multi_uninit (struct multi_context *m)
 	  m->hash = NULL;
 
 	  schedule_free (m->schedule);
-	  mbuf_free (m->mbuf);
+	  mbuf_fq_free (m->mbuf);
+	  mcast_free (m->mcast);
+	  neigh_free (m->neigh);
+	  while (m->rate_groups)
+	    {
+	      struct multi_rate_group *next = m->rate_groups->next;
+	      free (m->rate_groups);
+	      m->rate_groups = next;
+	    }
 	  ifconfig_pool_free (m->ifconfig_pool);
 	  frequency_limit_free (m->new_connection_limiter);
 	  multi_reap_free (m->reaper);
 	  mroute_helper_free (m->route_helper);
 	  multi_tcp_free (m->mtcp);
+	  slab_free (m->instance_slab);
 	  m->thread_mode = MC_UNDEF;
 	}
     }
@@ -628,7 +682,8 @@ multi_create_instance (struct multi_context *m, const struct mroute_addr *real)
 
   msg (D_MULTI_MEDIUM, "MULTI: multi_create_instance called");
 
-  ALLOC_OBJ_CLEAR (mi, struct multi_instance);
+  mi = (struct multi_instance *) slab_alloc (m->instance_slab);
+  mi->slab = m->instance_slab;
 
   mi->gc = gc_new ();
   multi_instance_inc_refcount (mi);
@@ -696,6 +751,27 @@ multi_create_instance (struct multi_context *m, const struct mroute_addr *real)
   return NULL;
 }
 
+/*
+ * Return the event set used to wait for client I/O.
+ */
+static const struct event_set *
+multi_event_set (const struct multi_context *m)
+{
+  if (m->mtcp)
+    return m->mtcp->es;
+  else
+    return m->top.c2.event_set;
+}
+
+/*
+ * Bytes of memory held on behalf of one client.
+ */
+static int
+multi_instance_footprint (const struct multi_instance *mi)
+{
+  return (int) mi->slab->size + context_footprint (&mi->context);
+}
+
 /*
  * Dump tables -- triggered by SIGUSR2.
  * If status file is defined, write to file.
@@ -709,6 +785,7 @@ multi_print_status (struct multi_context *m, struct status_output *so, const int
       struct gc_arena gc_top = gc_new ();
       struct hash_iterator hi;
       const struct hash_element *he;
+      struct event_set_stats es_stats;
 
       status_reset (so);
 
@@ -768,14 +845,27 @@ multi_print_status (struct multi_context *m, struct status_output *so, const int
 
 	  status_printf (so, "GLOBAL STATS");
 	  if (m->mbuf)
-	    status_printf (so, "Max bcast/mcast queue length,%d",
-			   mbuf_maximum_queued (m->mbuf));
+	    {
+	      status_printf (so, "Max bcast/mcast queue length,%d",
+			     mbuf_fq_maximum_queued (m->mbuf));
+	      status_printf (so, "Queue overflow drops," counter_format,
+			     m->mbuf->n_dropped_overflow);
+	      status_printf (so, "Queue CoDel drops," counter_format,
+			     m->mbuf->n_dropped_codel);
+	    }
+	  if (event_get_stats (multi_event_set (m), &es_stats))
+	    {
+	      status_printf (so, "Event ctl calls," counter_format, es_stats.ctl);
+	      status_printf (so, "Event ctl kernel updates," counter_format, es_stats.ctl_kernel);
+	    }
 
 	  status_printf (so, "END");
 	}
       else if (version == 2 || version == 3)
 	{
 	  const char sep = (version == 3) ? '\t' : ',';
+	  counter_type n_alloc_bytes = 0;
+	  int n_hibernated = 0;
 
 	  /*
 	   * Status file version 2 and 3
@@ -833,9 +923,72 @@ multi_print_status (struct multi_context *m, struct status_output *so, const int
 	    }
 	  hash_iterator_free (&hi);
 
+	  status_printf (so, "HEADER%cCLIENT_QUEUE%cCommon Name%cReal Address%cQueued%cMax Queued%cOverflow Drops%cCoDel Drops%cRate Drops",
+			 sep, sep, sep, sep, sep, sep, sep, sep);
+	  hash_iterator_init (m->hash, &hi);
+	  while ((he = hash_iterator_next (&hi)))
+	    {
+	      struct gc_arena gc = gc_new ();
+	      const struct multi_instance *mi = (struct multi_instance *) he->value;
+
+	      if (!mi->halt)
+		{
+		  status_printf (so, "CLIENT_QUEUE%c%s%c%s%c%d%c%d%c" counter_format "%c" counter_format "%c" counter_format,
+				 sep, tls_common_name (mi->context.c2.tls_multi, false),
+				 sep, mroute_addr_print (&mi->real, &gc),
+				 sep, mbuf_flow_len (&mi->mbuf_flow),
+				 sep, mbuf_flow_maximum_queued (&mi->mbuf_flow),
+				 sep, mi->mbuf_flow.n_dropped_overflow,
+				 sep, mi->mbuf_flow.n_dropped_codel,
+				 sep, mi->n_rate_dropped);
+		}
+	      gc_free (&gc);
+	    }
+	  hash_iterator_free (&hi);
+
+	  status_printf (so, "HEADER%cCLIENT_MEMORY%cCommon Name%cReal Address%cBytes Allocated",
+			 sep, sep, sep, sep);
+	  hash_iterator_init (m->hash, &hi);
+	  while ((he = hash_iterator_next (&hi)))
+	    {
+	      struct gc_arena gc = gc_new ();
+	      const struct multi_instance *mi = (struct multi_instance *) he->value;
+
+	      if (!mi->halt)
+		{
+		  const int bytes = multi_instance_footprint (mi);
+		  status_printf (so, "CLIENT_MEMORY%c%s%c%s%c%d",
+				 sep, tls_common_name (mi->context.c2.tls_multi, false),
+				 sep, mroute_addr_print (&mi->real, &gc),
+				 sep, bytes);
+		  n_alloc_bytes += bytes;
+		  if (mi->context.c2.tls_multi && tls_multi_hibernated (mi->context.c2.tls_multi))
+		    ++n_hibernated;
+		}
+	      gc_free (&gc);
+	    }
+	  hash_iterator_free (&hi);
+
 	  if (m->mbuf)
-	    status_printf (so, "GLOBAL_STATS%cMax bcast/mcast queue length%c%d",
-			   sep, sep, mbuf_maximum_queued (m->mbuf));
+	    {
+	      status_printf (so, "GLOBAL_STATS%cMax bcast/mcast queue length%c%d",
+			     sep, sep, mbuf_fq_maximum_queued (m->mbuf));
+	      status_printf (so, "GLOBAL_STATS%cQueue overflow drops%c" counter_format,
+			     sep, sep, m->mbuf->n_dropped_overflow);
+	      status_printf (so, "GLOBAL_STATS%cQueue CoDel drops%c" counter_format,
+			     sep, sep, m->mbuf->n_dropped_codel);
+	    }
+	  status_printf (so, "GLOBAL_STATS%cClient bytes allocated%c" counter_format,
+			 sep, sep, n_alloc_bytes);
+	  status_printf (so, "GLOBAL_STATS%cHibernated clients%c%d",
+			 sep, sep, n_hibernated);
+	  if (event_get_stats (multi_event_set (m), &es_stats))
+	    {
+	      status_printf (so, "GLOBAL_STATS%cEvent ctl calls%c" counter_format,
+			     sep, sep, es_stats.ctl);
+	      status_printf (so, "GLOBAL_STATS%cEvent ctl kernel updates%c" counter_format,
+			     sep, sep, es_stats.ctl_kernel);
+	    }
 
 	  status_printf (so, "END");
 	}
@@ -1522,6 +1675,113 @@ multi_client_connect_setenv (struct multi_context *m,
   gc_free (&gc);
 }
 
+static struct multi_rate_group *
+multi_rate_group_lookup (struct multi_context *m, const char *name)
+{
+  struct multi_rate_group *rg;
+  for (rg = m->rate_groups; rg; rg = rg->next)
+    if (!strcmp (rg->name, name))
+      return rg;
+  return NULL;
+}
+
+/*
+ * Set up the --client-rate token buckets of a newly
+ * authenticated client.  Data to the client is shaped
+ * in its output queue; data from the client is policed
+ * by multi_rate_allow_up.
+ */
+static void
+multi_rate_init (struct multi_context *m, struct multi_instance *mi)
+{
+  const struct options *o = &mi->context.options;
+
+  token_bucket_init (&mi->rate_down, o->client_rate_down, o->client_rate_burst);
+  token_bucket_init (&mi->rate_up, o->client_rate_up, o->client_rate_burst);
+
+  mi->rate_group = NULL;
+  if (o->client_rate_group)
+    {
+      mi->rate_group = multi_rate_group_lookup (m, o->client_rate_group);
+      if (!mi->rate_group)
+	msg (D_MULTI_ERRORS, "MULTI: --client-rate-group %s is not defined by --rate-group",
+	     o->client_rate_group);
+    }
+
+  mi->mbuf_flow.bucket[0] = token_bucket_defined (&mi->rate_down) ? &mi->rate_down : NULL;
+  mi->mbuf_flow.bucket[1] = (mi->rate_group && token_bucket_defined (&mi->rate_group->down))
+    ? &mi->rate_group->down : NULL;
+}
+
+/*
+ * Return true if nbytes received from a client are
+ * within its --client-rate limits, and charge them.
+ */
+static bool
+multi_rate_allow_up (struct multi_instance *mi, const int nbytes)
+{
+  struct token_bucket *tb[2];
+  struct timeval tv;
+  int i;
+
+  tb[0] = token_bucket_defined (&mi->rate_up) ? &mi->rate_up : NULL;
+  tb[1] = (mi->rate_group && token_bucket_defined (&mi->rate_group->up)) ? &mi->rate_group->up : NULL;
+  if (!tb[0] && !tb[1])
+    return true;
+
+  ASSERT (!openvpn_gettimeofday (&tv, NULL));
+  for (i = 0; i < 2; ++i)
+    if (tb[i] && !token_bucket_allow (tb[i], &tv))
+      return false;
+  for (i = 0; i < 2; ++i)
+    if (tb[i])
+      token_bucket_charge (tb[i], nbytes);
+  return true;
+}
+
+/*
+ * Source a --client-config-dir file, taking its contents from
+ * the file watch cache when possible.  Returns false if the
+ * file doesn't exist.
+ */
+static bool
+multi_import_ccd (struct multi_context *m,
+		  struct multi_instance *mi,
+		  const char *ccd_file,
+		  const unsigned int option_permissions_mask,
+		  unsigned int *option_types_found)
+{
+  const char *contents = NULL;
+
+  if (!ccd_file)
+    return false;
+
+  if (file_watch_contents (m->top.c1.file_watch, ccd_file, &contents))
+    {
+      if (!contents)
+	return false;
+      options_server_import_string (&mi->context.options,
+				    ccd_file,
+				    contents,
+				    D_IMPORT_ERRORS|M_OPTERR,
+				    option_permissions_mask,
+				    option_types_found,
+				    mi->context.c2.es);
+    }
+  else
+    {
+      if (!test_file (ccd_file))
+	return false;
+      options_server_import (&mi->context.options,
+			     ccd_file,
+			     D_IMPORT_ERRORS|M_OPTERR,
+			     option_permissions_mask,
+			     option_types_found,
+			     mi->context.c2.es);
+    }
+  return true;
+}
+
 /*
  * Called as soon as the SSL/TLS connection authenticates.
  *
@@ -1581,30 +1841,14 @@ multi_connection_established (struct multi_context *m, struct multi_instance *mi
 			       &gc);
 
 	  /* try common-name file */
-	  if (test_file (ccd_file))
-	    {
-	      options_server_import (&mi->context.options,
-				     ccd_file,
-				     D_IMPORT_ERRORS|M_OPTERR,
-				     option_permissions_mask,
-				     &option_types_found,
-				     mi->context.c2.es);
-	    }
-	  else /* try default file */
+	  if (!multi_import_ccd (m, mi, ccd_file, option_permissions_mask, &option_types_found))
 	    {
+	      /* try default file */
 	      ccd_file = gen_path (mi->context.options.client_config_dir,
 				   CCD_DEFAULT,
 				   &gc);
 
-	      if (test_file (ccd_file))
-		{
-		  options_server_import (&mi->context.options,
-					 ccd_file,
-					 D_IMPORT_ERRORS|M_OPTERR,
-					 option_permissions_mask,
-					 &option_types_found,
-					 mi->context.c2.es);
-		}
+	      multi_import_ccd (m, mi, ccd_file, option_permissions_mask, &option_types_found);
 	    }
 	}
 
@@ -1794,6 +2038,9 @@ multi_connection_established (struct multi_context *m, struct multi_instance *mi
 	  /* set our client's VPN endpoint for status reporting purposes */
 	  mi->reporting_addr = mi->context.c2.push_ifconfig_local;
 
+	  /* apply --client-rate and --client-rate-group limits */
+	  multi_rate_init (m, mi);
+
 	  /* set context-level authentication flag */
 	  mi->context.c2.context_auth = CAS_SUCCEEDED;
 	}
@@ -1838,7 +2085,7 @@ multi_add_mbuf (struct multi_context *m,
       struct mbuf_item item;
       item.buffer = mb;
       item.instance = mi;
-      mbuf_add_item (m->mbuf, &item);
+      mbuf_fq_add_item (m->mbuf, &mi->mbuf_flow, &item);
     }
   else
     {
@@ -1865,6 +2112,47 @@ multi_unicast (struct multi_context *m,
     }
 }
 
+/*
+ * Queue a broadcast or multicast packet
+ * for one client, subject to the packet filter.
+ */
+static void
+multi_bcast_add (struct multi_context *m,
+		 struct multi_instance *mi,
+		 struct mbuf_buffer *mb,
+		 const struct multi_instance *sender_instance,
+		 const struct mroute_addr *sender_addr)
+{
+  if (mi != sender_instance && !mi->halt)
+    {
+#ifdef ENABLE_PF
+      if (sender_instance)
+	{
+	  if (!pf_c2c_test (&sender_instance->context, &mi->context, "bcast_c2c"))
+	    {
+	      msg (D_PF_DROPPED_BCAST, "PF: client[%s] -> client[%s] packet dropped by BCAST packet filter",
+		   mi_prefix (sender_instance),
+		   mi_prefix (mi));
+	      return;
+	    }
+	}
+      if (sender_addr)
+	{
+	  if (!pf_addr_test (&mi->context, sender_addr, "bcast_src_addr"))
+	    {
+	      struct gc_arena gc = gc_new ();
+	      msg (D_PF_DROPPED_BCAST, "PF: addr[%s] -> client[%s] packet dropped by BCAST packet filter",
+		   mroute_addr_print_ex (sender_addr, MAPF_SHOW_ARP, &gc),
+		   mi_prefix (mi));
+	      gc_free (&gc);
+	      return;
+	    }
+	}
+#endif
+      multi_add_mbuf (m, mi, mb);
+    }
+}
+
 /*
  * Broadcast a packet to all clients.
  */
@@ -1876,7 +2164,6 @@ multi_bcast (struct multi_context *m,
 {
   struct hash_iterator hi;
   struct hash_element *he;
-  struct multi_instance *mi;
   struct mbuf_buffer *mb;
 
   if (BLEN (buf) > 0)
@@ -1889,37 +2176,7 @@ multi_bcast (struct multi_context *m,
       hash_iterator_init (m->iter, &hi);
 
       while ((he = hash_iterator_next (&hi)))
-	{
-	  mi = (struct multi_instance *) he->value;
-	  if (mi != sender_instance && !mi->halt)
-	    {
-#ifdef ENABLE_PF
-	      if (sender_instance)
-		{
-		  if (!pf_c2c_test (&sender_instance->context, &mi->context, "bcast_c2c"))
-		    {
-		      msg (D_PF_DROPPED_BCAST, "PF: client[%s] -> client[%s] packet dropped by BCAST packet filter",
-			   mi_prefix (sender_instance),
-			   mi_prefix (mi));
-		      continue;
-		    }
-		}
-	      if (sender_addr)
-		{
-		  if (!pf_addr_test (&mi->context, sender_addr, "bcast_src_addr"))
-		    {
-		      struct gc_arena gc = gc_new ();
-		      msg (D_PF_DROPPED_BCAST, "PF: addr[%s] -> client[%s] packet dropped by BCAST packet filter",
-			   mroute_addr_print_ex (sender_addr, MAPF_SHOW_ARP, &gc),
-			   mi_prefix (mi));
-		      gc_free (&gc);
-		      continue;
-		    }
-		}
-#endif
-	      multi_add_mbuf (m, mi, mb);
-	    }
-	}
+	multi_bcast_add (m, (struct multi_instance *) he->value, mb, sender_instance, sender_addr);
 
       hash_iterator_free (&hi);
       mbuf_free_buf (mb);
@@ -1927,6 +2184,107 @@ multi_bcast (struct multi_context *m,
     }
 }
 
+/*
+ * Send a multicast packet to the clients which have joined
+ * the group it is addressed to.  Without --multicast-snooping,
+ * multicast is treated as broadcast.
+ */
+static void
+multi_mcast (struct multi_context *m,
+	     const struct buffer *buf,
+	     const struct mroute_addr *group,
+	     const struct multi_instance *sender_instance,
+	     const struct mroute_addr *sender_addr)
+{
+  if (!m->mcast || mcast_flood_group (group))
+    multi_bcast (m, buf, sender_instance, sender_addr);
+  else if (BLEN (buf) > 0)
+    {
+      const struct mcast_group *g = mcast_lookup (m->mcast, group);
+      if (g)
+	{
+	  const struct mcast_member *mm;
+	  struct mbuf_buffer *mb;
+
+	  perf_push (PERF_MULTI_BCAST);
+#ifdef MULTI_DEBUG_EVENT_LOOP
+	  printf ("MCAST len=%d\n", BLEN (buf));
+#endif
+	  mb = mbuf_alloc_buf (buf);
+	  for (mm = g->members; mm; mm = mm->next)
+	    multi_bcast_add (m, mm->instance, mb, sender_instance, sender_addr);
+	  mbuf_free_buf (mb);
+	  perf_pop ();
+	}
+    }
+}
+
+/*
+ * Ask a newly connected client which groups it has joined.
+ * A client reconnecting with --persist-tun doesn't report
+ * them by itself, and would otherwise get no multicast until
+ * it joins another group.
+ */
+static void
+multi_mcast_query (struct multi_context *m, struct multi_instance *mi)
+{
+  if (m->mcast && mi->context.c2.context_auth == CAS_SUCCEEDED)
+    {
+      struct gc_arena gc = gc_new ();
+      struct buffer buf = alloc_buf_gc (BUF_SIZE (&mi->context.c2.frame), &gc);
+      const in_addr_t local = m->top.c1.tuntap ? m->top.c1.tuntap->local : 0;
+
+      ASSERT (buf_init (&buf, FRAME_HEADROOM (&mi->context.c2.frame)));
+      ASSERT (buf_safe (&buf, MCAST_QUERY_MAX));
+      ASSERT (buf_inc_len (&buf, mcast_igmp_query (BPTR (&buf), local)));
+      multi_unicast (m, &buf, mi);
+
+      if (m->top.options.tun_ipv6)
+	{
+	  ASSERT (buf_init (&buf, FRAME_HEADROOM (&mi->context.c2.frame)));
+	  ASSERT (buf_inc_len (&buf, mcast_mld_query (BPTR (&buf))));
+	  multi_unicast (m, &buf, mi);
+	}
+      gc_free (&gc);
+    }
+}
+
+/*
+ * If the frame received from the pending client is an ARP
+ * request or neighbor solicitation for the address of another
+ * client, queue the reply on that client's behalf and return
+ * true; the request need not be passed on.
+ */
+static bool
+multi_neigh_proxy (struct multi_context *m, struct context *c)
+{
+  uint8_t reply[NEIGH_REPLY_MAX];
+  int reply_len = 0;
+  struct multi_instance *owner;
+  bool ret = false;
+
+  owner = neigh_proxy (m->neigh, m->pending, &c->c2.to_tun_info, reply, &reply_len);
+  if (owner)
+    {
+#ifdef ENABLE_PF
+      if (!pf_c2c_test (c, &owner->context, "tap_neigh"))
+	return false;
+#endif
+      {
+	struct gc_arena gc = gc_new ();
+	struct buffer buf = alloc_buf_gc (BUF_SIZE (&c->c2.frame), &gc);
+	ASSERT (buf_init (&buf, FRAME_HEADROOM (&c->c2.frame)));
+	if (buf_write (&buf, reply, reply_len))
+	  {
+	    multi_unicast (m, &buf, m->pending);
+	    ret = true;
+	  }
+	gc_free (&gc);
+      }
+    }
+  return ret;
+}
+
 /*
  * Given a time delta, indicating that we wish to be
  * awoken by the scheduler at time now + delta, figure
@@ -1996,7 +2354,10 @@ multi_process_post (struct multi_context *m, struct multi_instance *mi, const un
 	  /* connection is "established" when SSL/TLS key negotiation succeeds
 	     and (if specified) auth user/pass succeeds */
 	  if (!mi->connection_established_flag && CONNECTION_ESTABLISHED (&mi->context))
-	    multi_connection_established (m, mi);
+	    {
+	      multi_connection_established (m, mi);
+	      multi_mcast_query (m, mi);
+	    }
 	}
     }
 
@@ -2080,15 +2441,23 @@ multi_process_incoming_link (struct multi_context *m, struct multi_instance *ins
 	  /* decrypt in instance context */
 	  process_incoming_link (c);
 
+	  /* enforce --client-rate limits on data from client */
+	  if (BLEN (&c->c2.to_tun) > 0 && !multi_rate_allow_up (m->pending, BLEN (&c->c2.to_tun)))
+	    {
+	      dmsg (D_MULTI_DROPPED, "MULTI: packet dropped due to --client-rate limit");
+	      ++m->pending->n_rate_dropped;
+	      c->c2.to_tun.len = 0;
+	    }
+
 	  if (TUNNEL_TYPE (m->top.c1.tuntap) == DEV_TYPE_TUN)
 	    {
-	      /* extract packet source and dest addresses */
-	      mroute_flags = mroute_extract_addr_from_packet (&src,
-							      &dest,
-							      NULL,
-							      NULL,
-							      &c->c2.to_tun,
-							      DEV_TYPE_TUN);
+	      /* classify packet once, and extract its source and dest addresses */
+	      packet_classify (&c->c2.to_tun_info, &c->c2.to_tun, DEV_TYPE_TUN);
+	      mroute_flags = mroute_extract_addr_classified (&src,
+							     &dest,
+							     NULL,
+							     NULL,
+							     &c->c2.to_tun_info);
 
 	      /* drop packet if extract failed */
 	      if (!(mroute_flags & MROUTE_EXTRACT_SUCCEEDED))
@@ -2102,14 +2471,21 @@ multi_process_incoming_link (struct multi_context *m, struct multi_instance *ins
 		       mroute_addr_print (&src, &gc));
 		  c->c2.to_tun.len = 0;
 		}
+	      /* IGMP/MLD membership report? only the tun/tap interface
+		 sees it, so that other clients do not suppress theirs */
+	      else if ((mroute_flags & MROUTE_EXTRACT_MCAST)
+		       && m->mcast
+		       && mcast_snoop (m->mcast, m->pending, &c->c2.to_tun))
+		{
+		  ;
+		}
 	      /* client-to-client communication enabled? */
 	      else if (m->enable_c2c)
 		{
 		  /* multicast? */
 		  if (mroute_flags & MROUTE_EXTRACT_MCAST)
 		    {
-		      /* for now, treat multicast as broadcast */
-		      multi_bcast (m, &c->c2.to_tun, m->pending, NULL);
+		      multi_mcast (m, &c->c2.to_tun, &dest, m->pending, NULL);
 		    }
 		  else /* possible client to client routing */
 		    {
@@ -2150,17 +2526,17 @@ multi_process_incoming_link (struct multi_context *m, struct multi_instance *ins
 	      struct mroute_addr edest;
 	      mroute_addr_reset (&edest);
 #endif
-	      /* extract packet source and dest addresses */
-	      mroute_flags = mroute_extract_addr_from_packet (&src,
-							      &dest,
-							      NULL,
+	      /* classify packet once, and extract its source and dest addresses */
+	      packet_classify (&c->c2.to_tun_info, &c->c2.to_tun, DEV_TYPE_TAP);
+	      mroute_flags = mroute_extract_addr_classified (&src,
+							     &dest,
+							     NULL,
 #ifdef ENABLE_PF
-							      &edest,
+							     &edest,
 #else
-							      NULL,
+							     NULL,
 #endif
-							      &c->c2.to_tun,
-							      DEV_TYPE_TAP);
+							     &c->c2.to_tun_info);
 
 	      if (mroute_flags & MROUTE_EXTRACT_SUCCEEDED)
 		{
@@ -2169,7 +2545,10 @@ multi_process_incoming_link (struct multi_context *m, struct multi_instance *ins
 		      /* check for broadcast */
 		      if (m->enable_c2c)
 			{
-			  if (mroute_flags & (MROUTE_EXTRACT_BCAST|MROUTE_EXTRACT_MCAST))
+			  /* answer ARP/ND requests for other clients ourselves */
+			  if (m->neigh && multi_neigh_proxy (m, c))
+			    c->c2.to_tun.len = 0;
+			  else if (mroute_flags & (MROUTE_EXTRACT_BCAST|MROUTE_EXTRACT_MCAST))
 			    {
 			      multi_bcast (m, &c->c2.to_tun, m->pending, NULL);
 			    }
@@ -2271,29 +2650,36 @@ multi_process_incoming_tun (struct multi_context *m, const unsigned int mpp_flag
        * the appropriate multi_instance object.
        */
 
-      mroute_flags = mroute_extract_addr_from_packet (&src,
-						      &dest,
+      packet_classify (&m->top.c2.buf_info, &m->top.c2.buf, dev_type);
+      mroute_flags = mroute_extract_addr_classified (&src,
+						     &dest,
 #ifdef ENABLE_PF
-						      e1,
+						     e1,
 #else
-						      NULL,
+						     NULL,
 #endif
-						      NULL,
-						      &m->top.c2.buf,
-						      dev_type);
+						     NULL,
+						     &m->top.c2.buf_info);
 
       if (mroute_flags & MROUTE_EXTRACT_SUCCEEDED)
 	{
 	  struct context *c;
 
 	  /* broadcast or multicast dest addr? */
-	  if (mroute_flags & (MROUTE_EXTRACT_BCAST|MROUTE_EXTRACT_MCAST))
+	  if (mroute_flags & MROUTE_EXTRACT_BCAST)
 	    {
-	      /* for now, treat multicast as broadcast */
 #ifdef ENABLE_PF
 	      multi_bcast (m, &m->top.c2.buf, NULL, e2);
 #else
 	      multi_bcast (m, &m->top.c2.buf, NULL, NULL);
+#endif
+	    }
+	  else if (mroute_flags & MROUTE_EXTRACT_MCAST)
+	    {
+#ifdef ENABLE_PF
+	      multi_mcast (m, &m->top.c2.buf, &dest, NULL, e2);
+#else
+	      multi_mcast (m, &m->top.c2.buf, &dest, NULL, NULL);
 #endif
 	    }
 	  else
@@ -2317,10 +2703,25 @@ multi_process_incoming_tun (struct multi_context *m, const unsigned int mpp_flag
 		  else
 #endif
 		  {
-		    if (multi_output_queue_ready (m, m->pending))
+		    if (multi_output_queue_ready (m, m->pending)
+			&& mbuf_flow_shaped (&m->pending->mbuf_flow))
+		      {
+			/*
+			 * Rate-limited clients are fed from their output
+			 * queue, so do the accounting of process_incoming_tun
+			 * here, before the packet bypasses it.
+			 */
+			c->c2.tun_read_bytes += BLEN (&m->top.c2.buf);
+			check_hibernate_wake (c);
+			register_activity (c, BLEN (&m->top.c2.buf));
+			multi_unicast (m, &m->top.c2.buf, m->pending);
+			buf_reset_len (&c->c2.buf);
+		      }
+		    else if (multi_output_queue_ready (m, m->pending))
 		      {
-			/* transfer packet pointer from top-level context buffer to instance */
+			/* transfer packet pointer and its classification from top-level context to instance */
 			c->c2.buf = m->top.c2.buf;
+			c->c2.buf_info = m->top.c2.buf_info;
 		      }
 		    else
 		      {
@@ -2350,19 +2751,21 @@ multi_process_incoming_tun (struct multi_context *m, const unsigned int mpp_flag
  * queue.
  */
 struct multi_instance *
-multi_get_queue (struct mbuf_set *ms)
+multi_get_queue (struct mbuf_fq *fq)
 {
   struct mbuf_item item;
 
-  if (mbuf_extract_item (ms, &item)) /* cleartext IP packet */
+  if (mbuf_fq_extract_item (fq, &item)) /* cleartext IP packet */
     {
       unsigned int pipv4_flags = PIPV4_PASSTOS;
+      struct packet_info info;
 
       set_prefix (item.instance);
       item.instance->context.c2.buf = item.buffer->buf;
       if (item.buffer->flags & MF_UNICAST) /* --mssfix doesn't make sense for broadcast or multicast */
 	pipv4_flags |= PIPV4_MSSFIX;
-      process_ipv4_header (&item.instance->context, pipv4_flags, &item.instance->context.c2.buf);
+      packet_info_reset (&info);
+      process_ipv4_header (&item.instance->context, pipv4_flags, &item.instance->context.c2.buf, &info);
       encrypt_sign (&item.instance->context, true);
       mbuf_free_buf (item.buffer);
 
@@ -2478,6 +2881,9 @@ multi_process_per_second_timers_dowork (struct multi_context *m)
   /* possibly reap instances/routes in vhash */
   multi_reap_process (m);
 
+  /* pick up changes to --client-config-dir and pf files */
+  file_watch_process (m->top.c1.file_watch);
+
   /* possibly print to status log */
   if (m->top.c1.status_output)
     {
@@ -2500,6 +2906,7 @@ multi_top_init (struct multi_context *m, const struct context *top, const bool a
   m->top.c2.buffers = NULL;
   if (alloc_buffers)
     m->top.c2.buffers = init_context_buffers (&top->c2.frame);
+  m->top.c1.file_watch = file_watch_new ();
 }
 
 void
@@ -2507,6 +2914,8 @@ multi_top_free (struct multi_context *m)
 {
   close_context (&m->top, -1, CC_GC_FREE);
   free_context_buffers (m->top.c2.buffers);
+  file_watch_free (m->top.c1.file_watch);
+  m->top.c1.file_watch = NULL;
 }
 
 /*
@@ -2635,6 +3044,8 @@ management_delete_event (void *arg, event_t event)
   struct multi_context *m = (struct multi_context *) arg;
   if (m->mtcp)
     multi_tcp_delete_event (m->mtcp, event);
+  else if (m->top.c2.event_set)
+    event_del (m->top.c2.event_set, event);
 }
 
 #endif
@@ -35,6 +35,9 @@
 #include "forward.h"
 #include "mroute.h"
 #include "mbuf.h"
+#include "mcast.h"
+#include "neigh.h"
+#include "slab.h"
 #include "list.h"
 #include "schedule.h"
 #include "pool.h"
@@ -71,6 +74,7 @@ struct multi_instance {
   bool defined;
   bool halt;
   int refcount;
+  struct slab *slab;           /* allocator which owns this object */
   int route_count;             /* number of routes (including cached routes) owned by this instance */
   time_t created;               /**< Time at which a VPN tunnel instance
                                  *   was created.  This parameter is set
@@ -99,6 +103,15 @@ struct multi_instance {
   bool connection_established_flag;
   bool did_iroutes;
   int n_clients_delta; /* added to multi_context.n_clients when instance is closed */
+  int n_mcast_groups;          /* number of multicast groups joined, see mcast.h */
+  struct neigh_entry *neigh_entries; /* bindings learned by --neighbor-proxy, see neigh.h */
+  int n_neigh_entries;
+  struct mbuf_flow mbuf_flow;  /* output queue in multi_context.mbuf */
+
+  struct token_bucket rate_down;          /* --client-rate */
+  struct token_bucket rate_up;
+  struct multi_rate_group *rate_group;    /* --client-rate-group */
+  counter_type n_rate_dropped;            /* packets from client over rate */
 
   struct context context;       /**< The context structure storing state
                                  *   for this VPN tunnel. */
@@ -115,6 +128,22 @@ struct multi_instance {
  * page describes the role the structure plays when OpenVPN is running in
  * server-mode.
  */
+/*
+ * Token buckets shared by the clients of a --rate-group.
+ */
+struct multi_rate_group
+{
+  const char *name;
+  struct token_bucket down;
+  struct token_bucket up;
+  struct multi_rate_group *next;
+};
+
+/*
+ * Number of client instances allocated at a time.
+ */
+#define MULTI_INSTANCE_SLAB_BLOCK 16
+
 struct multi_context {
 # define MC_UNDEF                      0
 # define MC_SINGLE_THREADED            (1<<0)
@@ -132,11 +161,20 @@ struct multi_context {
                                  *   address of the remote peer, optimized
                                  *   for iteration. */
   struct schedule *schedule;
-  struct mbuf_set *mbuf;        /**< Set of buffers for passing data
-                                 *   channel packets between VPN tunnel
-                                 *   instances. */
+  struct mbuf_fq *mbuf;         /**< Per-instance queues of data channel
+                                 *   packets passed between VPN tunnel
+                                 *   instances, served fairly. */
   struct multi_tcp *mtcp;       /**< State specific to OpenVPN using TCP
                                  *   as external transport. */
+  struct mcast_set *mcast;      /**< Multicast group memberships learned
+                                 *   by IGMP/MLD snooping, or NULL. */
+  struct neigh_set *neigh;      /**< Address bindings used to answer
+                                 *   ARP and neighbor solicitations
+                                 *   between clients, or NULL. */
+  struct slab *instance_slab;   /**< Allocator for struct multi_instance. */
+  struct multi_rate_group *rate_groups;
+                                /**< Shared rate limits, from
+                                 *   --rate-group. */
   struct ifconfig_pool *ifconfig_pool;
   struct frequency_limit *new_connection_limiter;
   struct mroute_helper *route_helper;
@@ -291,7 +329,7 @@ void multi_process_drop_outgoing_tun (struct multi_context *m, const unsigned in
 
 void multi_print_status (struct multi_context *m, struct status_output *so, const int version);
 
-struct multi_instance *multi_get_queue (struct mbuf_set *ms);
+struct multi_instance *multi_get_queue (struct mbuf_fq *fq);
 
 void multi_add_mbuf (struct multi_context *m,
 		     struct multi_instance *mi,
@@ -331,7 +369,7 @@ multi_process_outgoing_link_pre (struct multi_context *m)
 
   if (m->pending)
     mi = m->pending;
-  else if (mbuf_defined (m->mbuf))
+  else if (mbuf_fq_ready (m->mbuf))
     mi = multi_get_queue (m->mbuf);
   return mi;
 }
@@ -383,7 +421,7 @@ multi_instance_dec_refcount (struct multi_instance *mi)
   if (--mi->refcount <= 0)
     {
       gc_free (&mi->gc);
-      free (mi);
+      slab_release (mi->slab, mi);
     }
 }
 
@@ -505,6 +543,19 @@ multi_get_timeout (struct multi_context *m, struct timeval *dest)
       dest->tv_sec = REAP_MAX_WAKEUP;
       dest->tv_usec = 0;
     }
+
+  /* queued output waiting for --client-rate tokens? */
+  if (mbuf_fq_throttled (m->mbuf, &tv))
+    {
+      struct timeval delta;
+      ASSERT (!openvpn_gettimeofday (&current, NULL));
+      tv_delta (&delta, &current, &tv);
+      if (tv_lt (&delta, dest))
+	{
+	  m->earliest_wakeup = NULL;
+	  *dest = delta;
+	}
+    }
 }
 
 
@@ -0,0 +1,423 @@
+/*
+ *  OpenVPN -- An application to securely tunnel IP networks
+ *             over a single TCP/UDP port, with support for SSL/TLS-based
+ *             session authentication and key exchange,
+ *             packet encryption, packet authentication, and
+ *             packet compression.
+ *
+ *  Copyright (C) 2002-2010 OpenVPN Technologies, Inc. <sales@openvpn.net>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2
+ *  as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program (see the file COPYING included with this
+ *  distribution); if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "syshead.h"
+
+#if P2MP_SERVER
+
+#include "multi.h"
+#include "neigh.h"
+
+#include "memdbg.h"
+
+#define IPV6_NEXTHDR_ICMP          58
+
+/* neighbor discovery (RFC 4861) */
+#define ND_NEIGHBOR_SOLICIT        135
+#define ND_NEIGHBOR_ADVERT         136
+#define ND_OPT_SOURCE_LINKADDR     1
+#define ND_OPT_TARGET_LINKADDR     2
+#define ND_NA_FLAG_SOLICITED       0x40
+
+#define ND_HDR_LEN                 24  /* type, code, checksum, flags, target */
+#define ND_OPT_LINKADDR_LEN        8
+
+struct neigh_set *
+neigh_init (const int max_entries)
+{
+  struct neigh_set *ns;
+  ALLOC_OBJ_CLEAR (ns, struct neigh_set);
+  ns->hash = hash_init (256,
+			get_random (),
+			mroute_addr_hash_function,
+			mroute_addr_compare_function);
+  ns->max_entries = max_entries;
+  return ns;
+}
+
+void
+neigh_free (struct neigh_set *ns)
+{
+  if (ns)
+    {
+      struct hash_iterator hi;
+      struct hash_element *he;
+
+      hash_iterator_init (ns->hash, &hi);
+      while ((he = hash_iterator_next (&hi)))
+	{
+	  free (he->value);
+	  hash_iterator_delete_element (&hi);
+	}
+      hash_iterator_free (&hi);
+      hash_free (ns->hash);
+      free (ns);
+    }
+}
+
+/*
+ * Unlink e from the list of bindings of its client.
+ */
+static void
+neigh_unlink (struct neigh_entry *e)
+{
+  struct neigh_entry **ep;
+  for (ep = &e->instance->neigh_entries; *ep; ep = &(*ep)->next)
+    {
+      if (*ep == e)
+	{
+	  *ep = e->next;
+	  --e->instance->n_neigh_entries;
+	  break;
+	}
+    }
+  e->next = NULL;
+}
+
+/*
+ * Make room for a new binding of mi by dropping
+ * the one which was refreshed least recently.
+ */
+static void
+neigh_evict (struct neigh_set *ns, struct multi_instance *mi)
+{
+  struct neigh_entry *e, *oldest = mi->neigh_entries;
+
+  for (e = mi->neigh_entries; e; e = e->next)
+    if (e->last_seen < oldest->last_seen)
+      oldest = e;
+
+  if (oldest)
+    {
+      struct gc_arena gc = gc_new ();
+      msg (D_MULTI_DROPPED, "NEIGH: dropping %s, client has %d bindings already",
+	   mroute_addr_print (&oldest->addr, &gc),
+	   mi->n_neigh_entries);
+      gc_free (&gc);
+
+      neigh_unlink (oldest);
+      hash_remove (ns->hash, &oldest->addr);
+      free (oldest);
+    }
+}
+
+static void
+neigh_learn (struct neigh_set *ns, struct multi_instance *mi,
+	     const struct mroute_addr *addr, const uint8_t *mac)
+{
+  struct neigh_entry *e;
+
+  /* a binding to a broadcast or multicast MAC is bogus */
+  if (mac[0] & 0x01)
+    return;
+
+  e = (struct neigh_entry *) hash_lookup (ns->hash, addr);
+  if (e && e->instance == mi)
+    {
+      memcpy (e->mac, mac, OPENVPN_ETH_ALEN);
+      e->last_seen = now;
+      return;
+    }
+
+  if (mi->n_neigh_entries >= ns->max_entries)
+    neigh_evict (ns, mi);
+
+  if (e)
+    neigh_unlink (e);
+  else
+    {
+      ALLOC_OBJ_CLEAR (e, struct neigh_entry);
+      e->addr = *addr;
+      hash_add (ns->hash, &e->addr, e, false);
+    }
+
+  memcpy (e->mac, mac, OPENVPN_ETH_ALEN);
+  e->last_seen = now;
+  e->instance = mi;
+  e->next = mi->neigh_entries;
+  mi->neigh_entries = e;
+  ++mi->n_neigh_entries;
+
+  {
+    struct gc_arena gc = gc_new ();
+    msg (D_MULTI_DEBUG, "NEIGH: learned %s", mroute_addr_print (addr, &gc));
+    gc_free (&gc);
+  }
+}
+
+/*
+ * Return the binding of addr which may be used to answer
+ * a request from mi, or NULL if the request should be flooded.
+ */
+static const struct neigh_entry *
+neigh_lookup (struct neigh_set *ns, struct multi_instance *mi, const struct mroute_addr *addr)
+{
+  const struct neigh_entry *e = (const struct neigh_entry *) hash_lookup (ns->hash, addr);
+  if (e
+      && e->instance != mi
+      && !e->instance->halt
+      && now - e->last_seen <= NEIGH_MAX_AGE)
+    return e;
+  return NULL;
+}
+
+static void
+neigh_get_ipv4 (struct mroute_addr *ma, const uint8_t *src)
+{
+  ma->type = MR_ADDR_IPV4;
+  ma->netbits = 0;
+  ma->len = 4;
+  memcpy (ma->addr, src, 4);
+}
+
+static void
+neigh_get_ipv6 (struct mroute_addr *ma, const uint8_t *src)
+{
+  ma->type = MR_ADDR_IPV6;
+  ma->netbits = 0;
+  ma->len = 16;
+  memcpy (ma->addr, src, 16);
+}
+
+static struct multi_instance *
+neigh_arp (struct neigh_set *ns, struct multi_instance *mi,
+	   const struct packet_info *pi, uint8_t *reply, int *reply_len)
+{
+  const struct openvpn_ethhdr *eth = (const struct openvpn_ethhdr *) pi->data;
+  const struct openvpn_arp *arp = (const struct openvpn_arp *) (pi->data + pi->l3);
+  struct mroute_addr addr;
+  const struct neigh_entry *e;
+
+  if (arp->mac_addr_type != htons (ARP_MAC_ADDR_TYPE)
+      || arp->proto_addr_type != htons (OPENVPN_ETH_P_IPV4)
+      || arp->mac_addr_size != OPENVPN_ETH_ALEN
+      || arp->proto_addr_size != sizeof (in_addr_t))
+    return NULL;
+
+  /* probes (RFC 5227) have no sender address */
+  if (!arp->ip_src)
+    return NULL;
+
+  /*
+   * Only believe a sender hardware address which the frame
+   * itself came from, so that a client cannot bind another
+   * station's IP address to an arbitrary MAC.
+   */
+  if (memcmp (arp->mac_src, eth->source, OPENVPN_ETH_ALEN))
+    return NULL;
+
+  neigh_get_ipv4 (&addr, (const uint8_t *) &arp->ip_src);
+  neigh_learn (ns, mi, &addr, arp->mac_src);
+
+  /* gratuitous ARP announces the sender's own address */
+  if (arp->arp_command != htons (ARP_REQUEST) || arp->ip_dest == arp->ip_src)
+    return NULL;
+
+  neigh_get_ipv4 (&addr, (const uint8_t *) &arp->ip_dest);
+  e = neigh_lookup (ns, mi, &addr);
+  if (!e)
+    return NULL;
+
+  {
+    struct openvpn_ethhdr *reth = (struct openvpn_ethhdr *) reply;
+    struct openvpn_arp *rarp = (struct openvpn_arp *) (reply + sizeof (struct openvpn_ethhdr));
+
+    memcpy (reth->dest, eth->source, OPENVPN_ETH_ALEN);
+    memcpy (reth->source, e->mac, OPENVPN_ETH_ALEN);
+    reth->proto = htons (OPENVPN_ETH_P_ARP);
+
+    rarp->mac_addr_type = arp->mac_addr_type;
+    rarp->proto_addr_type = arp->proto_addr_type;
+    rarp->mac_addr_size = arp->mac_addr_size;
+    rarp->proto_addr_size = arp->proto_addr_size;
+    rarp->arp_command = htons (ARP_REPLY);
+    memcpy (rarp->mac_src, e->mac, OPENVPN_ETH_ALEN);
+    rarp->ip_src = arp->ip_dest;
+    memcpy (rarp->mac_dest, arp->mac_src, OPENVPN_ETH_ALEN);
+    rarp->ip_dest = arp->ip_src;
+
+    *reply_len = sizeof (struct openvpn_ethhdr) + sizeof (struct openvpn_arp);
+  }
+  return e->instance;
+}
+
+/*
+ * Return the link-layer address carried by the first
+ * option of the given type, or NULL if there is none.
+ */
+static const uint8_t *
+neigh_nd_linkaddr (const uint8_t *p, const int len, const int type)
+{
+  int offset = ND_HDR_LEN;
+  while (offset + 2 <= len)
+    {
+      const int optlen = p[offset + 1] * 8;
+      if (!optlen || offset + optlen > len)
+	break;
+      if (p[offset] == type && optlen >= ND_OPT_LINKADDR_LEN)
+	return p + offset + 2;
+      offset += optlen;
+    }
+  return NULL;
+}
+
+static uint16_t
+neigh_icmp6_checksum (const struct openvpn_ipv6hdr *ipv6, const uint8_t *p, const int len)
+{
+  const uint8_t *addrs = (const uint8_t *) &ipv6->saddr;
+  uint32_t sum = len + IPV6_NEXTHDR_ICMP;
+  int i;
+
+  /* pseudo-header source and destination addresses */
+  for (i = 0; i < 32; i += 2)
+    sum += (addrs[i] << 8) | addrs[i + 1];
+  for (i = 0; i + 1 < len; i += 2)
+    sum += (p[i] << 8) | p[i + 1];
+  if (i < len)
+    sum += p[i] << 8;
+
+  while (sum >> 16)
+    sum = (sum & 0xffff) + (sum >> 16);
+  return htons ((uint16_t) ~sum);
+}
+
+static struct multi_instance *
+neigh_nd (struct neigh_set *ns, struct multi_instance *mi,
+	  const struct packet_info *pi, uint8_t *reply, int *reply_len)
+{
+  const struct openvpn_ethhdr *eth = (const struct openvpn_ethhdr *) pi->data;
+  const struct openvpn_ipv6hdr *ipv6 = (const struct openvpn_ipv6hdr *) (pi->data + pi->l3);
+  const uint8_t *p = pi->data + pi->l3 + sizeof (struct openvpn_ipv6hdr);
+  const uint8_t *mac;
+  struct mroute_addr addr;
+  const struct neigh_entry *e;
+  int len = pi->len - pi->l3 - (int) sizeof (struct openvpn_ipv6hdr);
+
+  /* neighbor discovery messages never leave the link */
+  if (ipv6->nexthdr != IPV6_NEXTHDR_ICMP || ipv6->hop_limit != 255)
+    return NULL;
+
+  /* ignore any ethernet padding */
+  if (ntohs (ipv6->payload_len) < len)
+    len = ntohs (ipv6->payload_len);
+  if (len < ND_HDR_LEN || p[1] != 0)
+    return NULL;
+
+  switch (p[0])
+    {
+    case ND_NEIGHBOR_ADVERT:
+      mac = neigh_nd_linkaddr (p, len, ND_OPT_TARGET_LINKADDR);
+      if (mac && !memcmp (mac, eth->source, OPENVPN_ETH_ALEN))
+	{
+	  neigh_get_ipv6 (&addr, p + 8);
+	  neigh_learn (ns, mi, &addr, mac);
+	}
+      return NULL;
+    case ND_NEIGHBOR_SOLICIT:
+      /* duplicate address detection has an unspecified source */
+      if (IN6_IS_ADDR_UNSPECIFIED (&ipv6->saddr))
+	return NULL;
+      mac = neigh_nd_linkaddr (p, len, ND_OPT_SOURCE_LINKADDR);
+      if (mac && !memcmp (mac, eth->source, OPENVPN_ETH_ALEN))
+	{
+	  neigh_get_ipv6 (&addr, (const uint8_t *) &ipv6->saddr);
+	  neigh_learn (ns, mi, &addr, mac);
+	}
+      break;
+    default:
+      return NULL;
+    }
+
+  neigh_get_ipv6 (&addr, p + 8);
+  e = neigh_lookup (ns, mi, &addr);
+  if (!e)
+    return NULL;
+
+  {
+    struct openvpn_ethhdr *reth = (struct openvpn_ethhdr *) reply;
+    struct openvpn_ipv6hdr *ripv6 = (struct openvpn_ipv6hdr *) (reply + sizeof (struct openvpn_ethhdr));
+    uint8_t *rp = (uint8_t *) ripv6 + sizeof (struct openvpn_ipv6hdr);
+    const int rlen = ND_HDR_LEN + ND_OPT_LINKADDR_LEN;
+
+    memcpy (reth->dest, eth->source, OPENVPN_ETH_ALEN);
+    memcpy (reth->source, e->mac, OPENVPN_ETH_ALEN);
+    reth->proto = htons (OPENVPN_ETH_P_IPV6);
+
+    memset (ripv6, 0, sizeof (struct openvpn_ipv6hdr));
+    ripv6->version_prio = 0x60;
+    ripv6->payload_len = htons (rlen);
+    ripv6->nexthdr = IPV6_NEXTHDR_ICMP;
+    ripv6->hop_limit = 255;
+    memcpy (&ripv6->saddr, p + 8, 16);
+    memcpy (&ripv6->daddr, &ipv6->saddr, 16);
+
+    /*
+     * Solicited, but without the override flag, as
+     * RFC 4861 section 7.2.8 asks of proxies.
+     */
+    memset (rp, 0, rlen);
+    rp[0] = ND_NEIGHBOR_ADVERT;
+    rp[4] = ND_NA_FLAG_SOLICITED;
+    memcpy (rp + 8, p + 8, 16);
+    rp[ND_HDR_LEN] = ND_OPT_TARGET_LINKADDR;
+    rp[ND_HDR_LEN + 1] = ND_OPT_LINKADDR_LEN / 8;
+    memcpy (rp + ND_HDR_LEN + 2, e->mac, OPENVPN_ETH_ALEN);
+    *(uint16_t *) (rp + 2) = neigh_icmp6_checksum (ripv6, rp, rlen);
+
+    *reply_len = sizeof (struct openvpn_ethhdr) + sizeof (struct openvpn_ipv6hdr) + rlen;
+  }
+  return e->instance;
+}
+
+struct multi_instance *
+neigh_proxy (struct neigh_set *ns, struct multi_instance *mi,
+	     const struct packet_info *pi, uint8_t *reply, int *reply_len)
+{
+  if (!(pi->flags & PI_ETHER))
+    return NULL;
+  if (pi->flags & PI_ARP)
+    return neigh_arp (ns, mi, pi, reply, reply_len);
+  if (pi->flags & PI_IPV6)
+    return neigh_nd (ns, mi, pi, reply, reply_len);
+  return NULL;
+}
+
+void
+neigh_delete_instance (struct neigh_set *ns, struct multi_instance *mi)
+{
+  struct neigh_entry *e = mi->neigh_entries;
+  while (e)
+    {
+      struct neigh_entry *next = e->next;
+      hash_remove (ns->hash, &e->addr);
+      free (e);
+      e = next;
+    }
+  mi->neigh_entries = NULL;
+  mi->n_neigh_entries = 0;
+}
+
+#else
+static void dummy(void) {}
+#endif /* P2MP_SERVER */
@@ -0,0 +1,105 @@
+/*
+ *  OpenVPN -- An application to securely tunnel IP networks
+ *             over a single TCP/UDP port, with support for SSL/TLS-based
+ *             session authentication and key exchange,
+ *             packet encryption, packet authentication, and
+ *             packet compression.
+ *
+ *  Copyright (C) 2002-2010 OpenVPN Technologies, Inc. <sales@openvpn.net>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2
+ *  as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program (see the file COPYING included with this
+ *  distribution); if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef NEIGH_H
+#define NEIGH_H
+
+/*
+ * ARP and IPv6 neighbor discovery proxy for TAP-mode servers
+ * (--neighbor-proxy).
+ *
+ * The IPv4 and IPv6 address bindings which clients announce in
+ * ARP packets and neighbor solicitations/advertisements are
+ * learned, so that a request from one client for the address of
+ * another can be answered by the server directly, rather than
+ * being broadcast to every client.  Requests for addresses which
+ * are unknown, stale or bound behind the requesting client are
+ * flooded as before.
+ */
+
+#if P2MP_SERVER
+
+#include "basic.h"
+#include "buffer.h"
+#include "list.h"
+#include "mroute.h"
+#include "proto.h"
+
+struct multi_instance;
+
+/*
+ * Default maximum number of bindings learned from a single client.
+ */
+#define NEIGH_MAX_ENTRIES_DEFAULT 16
+
+/*
+ * Bindings not refreshed for this many seconds
+ * are no longer used to answer requests.
+ */
+#define NEIGH_MAX_AGE 300
+
+/*
+ * Size of the largest reply, a neighbor advertisement
+ * with a target link-layer address option.
+ */
+#define NEIGH_REPLY_MAX 86
+
+struct neigh_entry
+{
+  struct mroute_addr addr;              /* IPv4 or IPv6 address, the hash key */
+  uint8_t mac[OPENVPN_ETH_ALEN];
+  struct multi_instance *instance;      /* client which announced the binding */
+  time_t last_seen;
+  struct neigh_entry *next;             /* next binding of the same client */
+};
+
+struct neigh_set
+{
+  struct hash *hash;          /* struct neigh_entry indexed by address */
+  int max_entries;            /* per-client limit on bindings */
+};
+
+struct neigh_set *neigh_init (const int max_entries);
+void neigh_free (struct neigh_set *ns);
+
+/*
+ * Examine a frame sent by mi and learn the binding it announces,
+ * if it is an ARP packet or neighbor discovery message.  If it is
+ * a request for an address bound to another client, write a reply
+ * of *reply_len bytes to reply, which must hold NEIGH_REPLY_MAX
+ * bytes, and return that client.  Returns NULL otherwise.
+ */
+struct multi_instance *neigh_proxy (struct neigh_set *ns,
+				    struct multi_instance *mi,
+				    const struct packet_info *pi,
+				    uint8_t *reply,
+				    int *reply_len);
+
+/*
+ * Forget all bindings learned from mi.
+ */
+void neigh_delete_instance (struct neigh_set *ns, struct multi_instance *mi);
+
+#endif /* P2MP_SERVER */
+#endif /* NEIGH_H */
@@ -212,7 +212,7 @@ check_send_occ_msg_dowork (struct context *c)
 {
   bool doit = false;
 
-  c->c2.buf = c->c2.buffers->aux_buf;
+  c->c2.buf = get_context_buffers (c)->aux_buf;
   ASSERT (buf_init (&c->c2.buf, FRAME_HEADROOM (&c->c2.frame)));
   ASSERT (buf_safe (&c->c2.buf, MAX_RW_SIZE_TUN (&c->c2.frame)));
   ASSERT (buf_write (&c->c2.buf, occ_magic, OCC_STRING_SIZE));
@@ -44,6 +44,7 @@
 #include "misc.h"
 #include "mbuf.h"
 #include "pool.h"
+#include "fwatch.h"
 #include "plugin.h"
 #include "manage.h"
 #include "pf.h"
@@ -93,6 +94,24 @@ packet_id_persist_init (struct packet_id_persist *p)
 /*
  * Packet processing buffers.
  */
+/*
+ * Largest burst of packets from the same peer handled
+ * by one call of the batch functions in forward.c.
+ */
+#define DATA_BATCH_MAX 32
+
+/*
+ * The rest of a burst which stopped because a write
+ * would block, resumed by process_io once the packet
+ * which blocked has been written.
+ */
+struct data_burst
+{
+  struct buffer bufs[DATA_BATCH_MAX];
+  int recv_size[DATA_BATCH_MAX];  /* original_recv_size, link -> tun only */
+  int n;
+};
+
 struct context_buffers
 {
   /* miscellaneous buffer, used by ping, occ, etc. */
@@ -116,6 +135,44 @@ struct context_buffers
    */
   struct buffer read_link_buf;
   struct buffer read_tun_buf;
+
+  /*
+   * Per-packet storage for the batch functions,
+   * DATA_BATCH_MAX entries each, allocated by
+   * init_context_buffers_batch on first use.
+   */
+  struct buffer *batch_tun_bufs;
+#ifdef USE_CRYPTO
+  struct buffer *batch_decrypt_bufs;
+#endif
+  struct data_burst *burst_to_link;
+  struct data_burst *burst_to_tun;
+};
+
+struct context;
+
+/*
+ * Data channel stages of a tunnel, specialized by data_path_init
+ * for the features the tunnel was set up with, so that the
+ * per-packet path does not re-test its configuration.
+ */
+struct data_path
+{
+# define DP_TLS       (1<<0)  /* data channel keys come from tls_multi */
+# define DP_LZO       (1<<1)  /* LZO compression is configured */
+# define DP_FRAGMENT  (1<<2)  /* --fragment is used */
+# define DP_N_VARIANTS (1<<3)
+  unsigned int features;
+
+  /* PIPV4_x stages of process_ipv4_header enabled by options */
+  unsigned int ipv4_flags;
+
+  /* stages specialized for features, see forward.c */
+  void (*encrypt_sign) (struct context *c, bool comp_frag);
+  bool (*link_in_decrypt) (struct context *c, struct link_socket_info *lsi,
+			   struct buffer *buf, struct buffer *work);
+  void (*link_in_finish) (struct context *c, struct link_socket_info *lsi,
+			  const uint8_t *orig_buf);
 };
 
 /*
@@ -203,6 +260,10 @@ struct context_1
   /* persist --ifconfig-pool db to file */
   struct ifconfig_pool_persist *ifconfig_pool_persist;
   bool ifconfig_pool_persist_owned;
+
+  /* change notification for --client-config-dir and pf files,
+     owned by the multi_context */
+  struct file_watch *file_watch;
 #endif
 
   /* if client mode, hash of option strings we pulled from server */
@@ -232,6 +293,114 @@ struct context_2
                                  *   allocations done in the level 2 scope
                                  *   of this context_2 structure. */
 
+  /*
+   * Per-packet state.  Everything the data channel touches
+   * for each packet is kept together at the head of the
+   * structure, so that a server with many clients pulls as
+   * few cache lines per packet as possible.  Session setup
+   * and housekeeping state follows further below.
+   */
+
+  /*
+   * These buffers don't actually allocate storage, they are used
+   * as pointers to the allocated buffers in
+   * struct context_buffers.
+   */
+  struct buffer buf;
+  struct buffer to_tun;
+  struct buffer to_link;
+
+  /*
+   * Classification of the cleartext packets in buf and to_tun,
+   * if an earlier stage (multi-client routing) already parsed
+   * them.  process_ipv4_header resets them once used.
+   */
+  struct packet_info buf_info;
+  struct packet_info to_tun_info;
+
+  /* buffers used for packet processing */
+  struct context_buffers *buffers;
+
+  /* data channel stages, see data_path_init */
+  struct data_path data_path;
+
+  /*
+   * Writes to the link (BURST_TO_LINK) or the tun/tap device
+   * (BURST_TO_TUN) belong to a burst.  A packet whose write
+   * would block then stays in to_link or to_tun, and the rest
+   * of the burst waits in buffers->burst_to_link/burst_to_tun.
+   * BURST_STOP is set by a write which did not complete.
+   */
+# define BURST_TO_LINK (1<<0)
+# define BURST_TO_TUN  (1<<1)
+# define BURST_STOP    (1<<2)
+  unsigned int burst_flags;
+
+  /* to_tun is being retried and was already examined by process_ipv4_header */
+  bool to_tun_retry;
+
+  struct link_socket *link_socket;	 /* socket used for TCP/UDP connection to remote */
+  struct link_socket_info *link_socket_info;
+  struct link_socket_actual *to_link_addr;	/* IP address of remote */
+
+#ifdef USE_SSL
+  struct tls_multi *tls_multi;  /**< TLS state structure for this VPN
+                                 *   tunnel. */
+#endif
+
+#ifdef ENABLE_FRAGMENT
+  /* Object to handle advanced MTU negotiation and datagram fragmentation */
+  struct fragment_master *fragment;
+#endif
+
+  /*
+   * Statistics
+   */
+  counter_type tun_read_bytes;
+  counter_type tun_write_bytes;
+  counter_type link_read_bytes;
+  counter_type link_read_bytes_auth;
+  counter_type link_write_bytes;
+
+  /*
+   * Keep track of maximum packet size received so far
+   * (of authenticated packets).
+   */
+  int original_recv_size;	/* temporary */
+  int max_recv_size_local;	/* max packet size received */
+  int max_send_size_local;	/* max packet size sent */
+
+  /* --inactive */
+  int inactivity_bytes;
+
+  /*
+   * IPv4 TUN device?
+   */
+  bool ipv4_tun;
+
+  /* should we print R|W|r|w to console on packet transfers? */
+  bool log_rw;
+
+  /* don't wait for TUN/TAP/UDP to be ready to accept write */
+  bool fast_io;
+
+  /* timers reset by traffic */
+  struct event_timeout ping_send_interval;
+  struct event_timeout ping_rec_interval;
+
+  struct link_socket_actual from;               /* address of incoming datagram */
+
+#ifdef USE_CRYPTO
+  struct crypto_options crypto_options;
+                                /**< Security parameters and crypto state
+                                 *   used by the \link data_crypto Data
+                                 *   Channel Crypto module\endlink to
+                                 *   process data channel packet. */
+#endif
+
+  /* MTU frame parameters */
+  struct frame frame;
+
   /* our global wait events */
   struct event_set *event_set;
   int event_set_max;
@@ -251,20 +420,10 @@ struct context_2
 
   unsigned int event_set_status;
 
-  struct link_socket *link_socket;	 /* socket used for TCP/UDP connection to remote */
   bool link_socket_owned;
-  struct link_socket_info *link_socket_info;
   const struct link_socket *accept_from; /* possibly do accept() on a parent link_socket */
 
-  struct link_socket_actual *to_link_addr;	/* IP address of remote */
-  struct link_socket_actual from;               /* address of incoming datagram */
-
-  /* MTU frame parameters */
-  struct frame frame;
-
 #ifdef ENABLE_FRAGMENT
-  /* Object to handle advanced MTU negotiation and datagram fragmentation */
-  struct fragment_master *fragment;
   struct frame frame_fragment;
   struct frame frame_fragment_omit;
 #endif
@@ -276,14 +435,6 @@ struct context_2
   struct shaper shaper;
 #endif
 
-  /*
-   * Statistics
-   */
-  counter_type tun_read_bytes;
-  counter_type tun_write_bytes;
-  counter_type link_read_bytes;
-  counter_type link_read_bytes_auth;
-  counter_type link_write_bytes;
 #ifdef PACKET_TRUNCATION_CHECK
   counter_type n_trunc_tun_read;
   counter_type n_trunc_tun_write;
@@ -296,12 +447,20 @@ struct context_2
    * timeout features.
    */
   struct event_timeout wait_for_connect;
-  struct event_timeout ping_send_interval;
-  struct event_timeout ping_rec_interval;
 
   /* --inactive */
   struct event_timeout inactivity_interval;
-  int inactivity_bytes;
+
+  /*
+   * Server instances free per-client buffers which are
+   * only needed while traffic flows, once no tun/tap
+   * bytes moved for a full interval, and hibernate
+   * after --hibernate seconds without such bytes.
+   */
+# define IDLE_RELEASE_SECONDS 60
+  struct event_timeout idle_release_interval;
+  counter_type idle_release_bytes;
+  time_t idle_since;
 
 #ifdef ENABLE_OCC
   /* the option strings must match across peers */
@@ -313,14 +472,7 @@ struct context_2
   struct event_timeout occ_interval;
 #endif
 
-  /*
-   * Keep track of maximum packet size received so far
-   * (of authenticated packets).
-   */
-  int original_recv_size;	/* temporary */
-  int max_recv_size_local;	/* max packet size received */
   int max_recv_size_remote;	/* max packet size received by remote */
-  int max_send_size_local;	/* max packet size sent */
   int max_send_size_remote;	/* max packet size sent by remote */
 
 #ifdef ENABLE_OCC
@@ -338,9 +490,6 @@ struct context_2
    */
 #ifdef USE_SSL
 
-  struct tls_multi *tls_multi;  /**< TLS state structure for this VPN
-                                 *   tunnel. */
-
   struct tls_auth_standalone *tls_auth_standalone;
                                 /**< TLS state structure required for the
                                  *   initial authentication of a client's
@@ -360,12 +509,6 @@ struct context_2
 
 #endif /* USE_SSL */
 
-  struct crypto_options crypto_options;
-                                /**< Security parameters and crypto state
-                                 *   used by the \link data_crypto Data
-                                 *   Channel Crypto module\endlink to
-                                 *   process data channel packet. */
-
   /* used to keep track of data channel packet sequence numbers */
   struct packet_id packet_id;
   struct event_timeout packet_id_persist_interval;
@@ -379,29 +522,8 @@ struct context_2
                                  *   Compression module\endlink. */
 #endif
 
-  /*
-   * Buffers used for packet processing.
-   */
-  struct context_buffers *buffers;
   bool buffers_owned; /* if true, we should free all buffers on close */
 
-  /*
-   * These buffers don't actually allocate storage, they are used
-   * as pointers to the allocated buffers in
-   * struct context_buffers.
-   */
-  struct buffer buf;
-  struct buffer to_tun;
-  struct buffer to_link;
-
-  /*
-   * IPv4 TUN device?
-   */
-  bool ipv4_tun;
-
-  /* should we print R|W|r|w to console on packet transfers? */
-  bool log_rw;
-
   /* route stuff */
   struct event_timeout route_wakeup;
   struct event_timeout route_wakeup_expire;
@@ -439,9 +561,6 @@ struct context_2
   struct env_set *es;
   bool es_owned;
 
-  /* don't wait for TUN/TAP/UDP to be ready to accept write */
-  bool fast_io;
-
 #if P2MP
 
 #if P2MP_SERVER
@@ -547,6 +666,21 @@ struct context
   struct context_2 c2;          /**< Level 2 %context. */
 };
 
+/*
+ * Packet buffers of a context.  TCP server instances
+ * allocate theirs when they first handle a packet and
+ * release them again when idle.
+ */
+static inline struct context_buffers *
+get_context_buffers (struct context *c)
+{
+  void context_buffers_acquire (struct context *c);
+
+  if (!c->c2.buffers)
+    context_buffers_acquire (c);
+  return c->c2.buffers;
+}
+
 /*
  * Check for a signal when inside an event loop
  */
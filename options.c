@@ -46,6 +46,8 @@
 #include "win32.h"
 #include "push.h"
 #include "pool.h"
+#include "mcast.h"
+#include "neigh.h"
 #include "helper.h"
 #include "manage.h"
 #include "forward.h"
@@ -249,6 +251,12 @@ static const char usage_message[] =
   "--multihome     : Configure a multi-homed UDP server.\n"
 #endif
   "--fast-io       : (experimental) Optimize TUN/TAP/UDP writes.\n"
+  "--io-uring-poll : (experimental) Use io_uring polls instead of epoll to wait\n"
+  "                  for I/O readiness.  Reads and writes are not affected.\n"
+#ifdef ENABLE_UDP_OFFLOAD
+  "--udp-offload   : Batch UDP datagrams into single send/receive calls using\n"
+  "                  segmentation offload (Linux only).\n"
+#endif
   "--remap-usr1 s  : On SIGUSR1 signals, remap signal (s='SIGHUP' or 'SIGTERM').\n"
   "--persist-tun   : Keep tun/tap device open across SIGUSR1 or --ping-restart.\n"
   "--persist-remote-ip : Keep remote IP address across SIGUSR1 or --ping-restart.\n"
@@ -285,6 +293,10 @@ static const char usage_message[] =
   "                  can be matched in policy routing and packetfilter rules.\n"
 #endif
   "--txqueuelen n  : Set the tun/tap TX queue length to n (Linux only).\n"
+#ifdef ENABLE_TUN_OFFLOAD
+  "--tun-offload   : Exchange TCP super-packets with the tun device using\n"
+  "                  segmentation offload (Linux only).\n"
+#endif
   "--mlock         : Disable Paging -- ensures key material and tunnel\n"
   "                  data will never be written to disk.\n"
   "--up cmd        : Shell cmd to execute after successful tun device open.\n"
@@ -438,6 +450,23 @@ static const char usage_message[] =
   "--no-name-remapping : Allow Common Name and X509 Subject to include\n"
   "                      any printable character.\n"
   "--client-to-client : Internally route client-to-client traffic.\n"
+  "--client-rate down up [burst] : Limit the rate at which each client may\n"
+  "                  receive and send data to down and up bytes per second,\n"
+  "                  0 meaning unlimited, with token buckets of burst bytes\n"
+  "                  (default=rate/10).  May be given in --client-config-dir.\n"
+  "--rate-group name down up [burst] : Define a group of clients which share\n"
+  "                  the given rate limits.\n"
+  "--client-rate-group name : Add clients to --rate-group name.  May be given\n"
+  "                  in --client-config-dir.\n"
+  "--hibernate m   : Free the TLS state of clients which have not passed data\n"
+  "                  for m minutes, renegotiating on their next packet.\n"
+  "--multicast-snooping [n] : In TUN mode, track IGMP/MLD membership reports and\n"
+  "                  send multicast only to clients which joined the group.\n"
+  "                  A client may join at most n groups (default=64).\n"
+  "--neighbor-proxy [n] : In TAP mode with --client-to-client, answer ARP and\n"
+  "                  IPv6 neighbor solicitations for other clients from\n"
+  "                  bindings learned from them.\n"
+  "                  At most n bindings are kept per client (default=16).\n"
   "--duplicate-cn  : Allow multiple clients with the same common name to\n"
   "                  concurrently connect.\n"
   "--client-connect cmd : Run script cmd on client connection.\n"
@@ -781,6 +810,8 @@ init_options (struct options *o, const bool init_gc)
   o->tcp_queue_limit = 64;
   o->max_clients = 1024;
   o->max_routes_per_client = 256;
+  o->mcast_max_groups = MCAST_MAX_GROUPS_DEFAULT;
+  o->neighbor_proxy_max = NEIGH_MAX_ENTRIES_DEFAULT;
   o->ifconfig_pool_persist_refresh_freq = 600;
 #endif
 #if P2MP
@@ -1178,6 +1209,20 @@ show_p2mp_parms (const struct options *o)
   msg (D_SHOW_PARMS, "  push_ifconfig_ipv6_local = %s/%d", print_in6_addr (o->push_ifconfig_ipv6_local, 0, &gc), o->push_ifconfig_ipv6_netbits );
   msg (D_SHOW_PARMS, "  push_ifconfig_ipv6_remote = %s", print_in6_addr (o->push_ifconfig_ipv6_remote, 0, &gc));
   SHOW_BOOL (enable_c2c);
+  SHOW_BOOL (mcast_snooping);
+  SHOW_INT (mcast_max_groups);
+  SHOW_BOOL (neighbor_proxy);
+  SHOW_INT (neighbor_proxy_max);
+  SHOW_INT (client_rate_down);
+  SHOW_INT (client_rate_up);
+  SHOW_INT (client_rate_burst);
+  SHOW_STR (client_rate_group);
+  {
+    const struct rate_group_option *rg;
+    for (rg = o->rate_groups; rg; rg = rg->next)
+      msg (D_SHOW_PARMS, "  rate_group = %s %d %d %d", rg->name, rg->down, rg->up, rg->burst);
+  }
+  SHOW_INT (hibernate_seconds);
   SHOW_BOOL (duplicate_cn);
   SHOW_INT (cf_max);
   SHOW_INT (cf_per);
@@ -1230,6 +1275,24 @@ option_iroute (struct options *o,
   o->iroutes = ir;
 }
 
+/*
+ * Parse a --client-rate or --rate-group rate
+ * in bytes per second, 0 meaning unlimited.
+ */
+static bool
+option_rate (const char *str, int *rate, int msglevel)
+{
+  const int r = atoi (str);
+  if (r && (r < SHAPER_MIN || r > SHAPER_MAX))
+    {
+      msg (msglevel, "Bad rate value %s, must be 0 or between %d and %d",
+	   str, SHAPER_MIN, SHAPER_MAX);
+      return false;
+    }
+  *rate = r;
+  return true;
+}
+
 static void
 option_iroute_ipv6 (struct options *o,
 	       const char *prefix_str,
@@ -1278,7 +1341,9 @@ options_detach (struct options *o)
   o->client_nat = NULL;
 #endif
 #if P2MP_SERVER
-  clone_push_list(o);
+  /* share the parent's push list until we modify it */
+  if (o->push_list.head)
+    o->push_list.shared = true;
 #endif
 }
 
@@ -1483,6 +1548,7 @@ show_settings (const struct options *o)
   SHOW_INT (sockflags);
 
   SHOW_BOOL (fast_io);
+  SHOW_BOOL (io_uring_poll);
 
 #ifdef USE_LZO
   SHOW_INT (lzo);
@@ -2117,6 +2183,8 @@ options_postprocess_verify_ce (const struct options *options, const struct conne
 	msg (M_USAGE, "--auth-user-pass cannot be used with --mode server (it should be used on the client side only)");
       if (options->ccd_exclusive && !options->client_config_dir)
 	msg (M_USAGE, "--ccd-exclusive must be used with --client-config-dir");
+      if (options->neighbor_proxy && !options->enable_c2c)
+	msg (M_USAGE, "--neighbor-proxy must be used with --client-to-client");
       if (options->key_method != 2)
 	msg (M_USAGE, "--mode server requires --key-method 2");
 
@@ -2159,6 +2227,14 @@ options_postprocess_verify_ce (const struct options *options, const struct conne
 	msg (M_USAGE, "--client-config-dir/--ccd-exclusive requires --mode server");
       if (options->enable_c2c)
 	msg (M_USAGE, "--client-to-client requires --mode server");
+      if (options->mcast_snooping)
+	msg (M_USAGE, "--multicast-snooping requires --mode server");
+      if (options->neighbor_proxy)
+	msg (M_USAGE, "--neighbor-proxy requires --mode server");
+      if (options->client_rate_down || options->client_rate_up || options->client_rate_group || options->rate_groups)
+	msg (M_USAGE, "--client-rate, --client-rate-group and --rate-group require --mode server");
+      if (options->hibernate_seconds)
+	msg (M_USAGE, "--hibernate requires --mode server");
       if (options->duplicate_cn)
 	msg (M_USAGE, "--duplicate-cn requires --mode server");
       if (options->cf_max || options->cf_per)
@@ -2546,6 +2622,12 @@ options_postprocess_mutate (struct options *o)
    */
   pre_pull_save (o);
 #endif
+
+#if P2MP_SERVER
+  /* the push list is complete, render it for send_push_reply */
+  if (o->mode == MODE_SERVER)
+    push_list_render (o);
+#endif
 }
 
 /*
@@ -3581,7 +3663,7 @@ read_config_string (const char *prefix,
 #if ENABLE_INLINE_FILES
 	  check_inline_file_via_buf (&multiline, p, &options->gc);
 #endif
-	  add_option (options, p, NULL, line_num, 0, msglevel, permission_mask, option_types_found, es);
+	  add_option (options, p, prefix, line_num, 0, msglevel, permission_mask, option_types_found, es);
 	}
       CLEAR (p);
     }
@@ -3689,6 +3771,29 @@ options_server_import (struct options *o,
 		    es);
 }
 
+/*
+ * Like options_server_import, but with the contents
+ * of filename already in memory.
+ */
+void
+options_server_import_string (struct options *o,
+			      const char *filename,
+			      const char *config,
+			      int msglevel,
+			      unsigned int permission_mask,
+			      unsigned int *option_types_found,
+			      struct env_set *es)
+{
+  msg (D_PUSH, "OPTIONS IMPORT: reading client specific options from: %s (cached)", filename);
+  read_config_string (filename,
+		      o,
+		      config,
+		      msglevel,
+		      permission_mask,
+		      option_types_found,
+		      es);
+}
+
 void options_string_import (struct options *options,
 			    const char *config,
 			    const int msglevel,
@@ -4418,6 +4523,13 @@ add_option (struct options *options,
       VERIFY_PERMISSION (OPT_P_GENERAL);
       options->sockflags |= SF_USE_IP_PKTINFO;
     }
+#endif
+#ifdef ENABLE_UDP_OFFLOAD
+  else if (streq (p[0], "udp-offload"))
+    {
+      VERIFY_PERMISSION (OPT_P_GENERAL);
+      options->sockflags |= SF_UDP_OFFLOAD;
+    }
 #endif
   else if (streq (p[0], "verb") && p[1])
     {
@@ -4554,6 +4666,16 @@ add_option (struct options *options,
 #else
       msg (msglevel, "--txqueuelen not supported on this OS");
       goto err;
+#endif
+    }
+  else if (streq (p[0], "tun-offload"))
+    {
+      VERIFY_PERMISSION (OPT_P_GENERAL);
+#ifdef ENABLE_TUN_OFFLOAD
+      options->tuntap_options.offload = true;
+#else
+      msg (msglevel, "--tun-offload not supported on this OS");
+      goto err;
 #endif
     }
   else if (streq (p[0], "shaper") && p[1])
@@ -4634,6 +4756,11 @@ add_option (struct options *options,
       VERIFY_PERMISSION (OPT_P_GENERAL);
       options->fast_io = true;
     }
+  else if (streq (p[0], "io-uring-poll"))
+    {
+      VERIFY_PERMISSION (OPT_P_GENERAL);
+      options->io_uring_poll = true;
+    }
   else if (streq (p[0], "inactive") && p[1])
     {
       VERIFY_PERMISSION (OPT_P_TIMER);
@@ -5463,6 +5590,84 @@ add_option (struct options *options,
       VERIFY_PERMISSION (OPT_P_GENERAL);
       options->enable_c2c = true;
     }
+  else if (streq (p[0], "multicast-snooping"))
+    {
+      VERIFY_PERMISSION (OPT_P_GENERAL);
+      options->mcast_snooping = true;
+      if (p[1])
+	{
+	  const int max_groups = atoi (p[1]);
+	  if (max_groups < 1)
+	    {
+	      msg (msglevel, "--multicast-snooping parameter must be at least 1");
+	      goto err;
+	    }
+	  options->mcast_max_groups = max_groups;
+	}
+    }
+  else if (streq (p[0], "neighbor-proxy"))
+    {
+      VERIFY_PERMISSION (OPT_P_GENERAL);
+      options->neighbor_proxy = true;
+      if (p[1])
+	{
+	  const int max_entries = atoi (p[1]);
+	  if (max_entries < 1)
+	    {
+	      msg (msglevel, "--neighbor-proxy parameter must be at least 1");
+	      goto err;
+	    }
+	  options->neighbor_proxy_max = max_entries;
+	}
+    }
+  else if (streq (p[0], "client-rate") && p[1] && p[2])
+    {
+      int down, up, burst = 0;
+
+      VERIFY_PERMISSION (OPT_P_INHERIT);
+      if (!option_rate (p[1], &down, msglevel)
+	  || !option_rate (p[2], &up, msglevel)
+	  || (p[3] && !option_rate (p[3], &burst, msglevel)))
+	goto err;
+      options->client_rate_down = down;
+      options->client_rate_up = up;
+      options->client_rate_burst = burst;
+    }
+  else if (streq (p[0], "client-rate-group") && p[1])
+    {
+      VERIFY_PERMISSION (OPT_P_INHERIT);
+      options->client_rate_group = p[1];
+    }
+  else if (streq (p[0], "hibernate") && p[1])
+    {
+      const int minutes = atoi (p[1]);
+
+      VERIFY_PERMISSION (OPT_P_INHERIT);
+      if (minutes < 0)
+	{
+	  msg (msglevel, "--hibernate parameter must be >= 0");
+	  goto err;
+	}
+      options->hibernate_seconds = minutes * 60;
+    }
+  else if (streq (p[0], "rate-group") && p[1] && p[2] && p[3])
+    {
+      struct rate_group_option *rg;
+      int down, up, burst = 0;
+
+      VERIFY_PERMISSION (OPT_P_GENERAL);
+      if (!option_rate (p[2], &down, msglevel)
+	  || !option_rate (p[3], &up, msglevel)
+	  || (p[4] && !option_rate (p[4], &burst, msglevel)))
+	goto err;
+      ALLOC_OBJ_CLEAR_GC (rg, struct rate_group_option, &options->gc);
+      rg->name = p[1];
+      rg->down = down;
+      rg->up = up;
+      rg->burst = burst;
+      rg->next = options->rate_groups;
+      options->rate_groups = rg;
+    }
   else if (streq (p[0], "duplicate-cn"))
     {
       VERIFY_PERMISSION (OPT_P_GENERAL);
@@ -166,6 +166,18 @@ struct remote_host_store
 };
 #endif
 
+#if P2MP_SERVER
+/* --rate-group */
+struct rate_group_option
+{
+  const char *name;
+  int down;
+  int up;
+  int burst;
+  struct rate_group_option *next;
+};
+#endif
+
 /* Command line options */
 struct options
 {
@@ -333,6 +345,9 @@ struct options
   /* optimize TUN/TAP/UDP writes */
   bool fast_io;
 
+  /* wait for I/O readiness with io_uring polls rather than epoll/poll/select */
+  bool io_uring_poll;
+
 #ifdef USE_LZO
   /* LZO_x flags from lzo.h */
   unsigned int lzo;
@@ -455,6 +470,16 @@ struct options
   int 		  push_ifconfig_ipv6_netbits;		/* IPv6 */
   struct in6_addr push_ifconfig_ipv6_remote;		/* IPv6 */
   bool enable_c2c;
+  bool mcast_snooping;
+  int mcast_max_groups;
+  bool neighbor_proxy;
+  int neighbor_proxy_max;
+  int client_rate_down;         /* bytes per second, 0 if unlimited */
+  int client_rate_up;
+  int client_rate_burst;
+  const char *client_rate_group;
+  struct rate_group_option *rate_groups;
+  int hibernate_seconds;        /* 0 to keep idle clients resident */
   bool duplicate_cn;
   int cf_max;
   int cf_per;
@@ -745,6 +770,14 @@ void options_server_import (struct options *o,
 			    unsigned int *option_types_found,
 			    struct env_set *es);
 
+void options_server_import_string (struct options *o,
+				   const char *filename,
+				   const char *config,
+				   int msglevel,
+				   unsigned int permission_mask,
+				   unsigned int *option_types_found,
+				   struct env_set *es);
+
 void pre_pull_default (struct options *o);
 
 void rol_check_alloc (struct options *options);
@@ -41,6 +41,8 @@ pf_destroy (struct pf_set *pfs)
     {
       if (pfs->cns.hash_table)
 	hash_free (pfs->cns.hash_table);
+      free (pfs->cns.cache);
+      free (pfs->sns.trie);
 
       {
 	struct pf_cn_elem *l = pfs->cns.list;
@@ -168,6 +170,79 @@ genhash (struct pf_cn_set *cns, const char *prefix, const int n_clients)
   return status;
 }
 
+static int
+subnet_netbits (const struct ipv4_subnet *rule)
+{
+  int netbits = 0;
+  while (netbits < 32 && (rule->netmask & (0x80000000u >> netbits)))
+    ++netbits;
+  return netbits;
+}
+
+/*
+ * Compile the subnet rules into a trie, so that finding
+ * the first matching rule takes at most 33 steps however
+ * many rules there are.
+ */
+static void
+compile_subnets (struct pf_subnet_set *sns)
+{
+  const struct pf_subnet *e;
+  int n_nodes = 1;
+  int order = 0;
+
+  for (e = sns->list; e != NULL; e = e->next)
+    n_nodes += subnet_netbits (&e->rule);
+  ALLOC_ARRAY_CLEAR (sns->trie, struct pf_subnet_node, n_nodes);
+
+  n_nodes = 1;
+  for (e = sns->list; e != NULL; e = e->next, ++order)
+    {
+      const int netbits = subnet_netbits (&e->rule);
+      int node = 0;
+      int i;
+
+      for (i = 0; i < netbits; ++i)
+	{
+	  const int bit = (e->rule.network >> (31 - i)) & 1;
+	  if (!sns->trie[node].child[bit])
+	    sns->trie[node].child[bit] = n_nodes++;
+	  node = sns->trie[node].child[bit];
+	}
+      if (!sns->trie[node].rule)
+	{
+	  sns->trie[node].rule = &e->rule;
+	  sns->trie[node].order = order;
+	}
+    }
+}
+
+static const struct ipv4_subnet *
+lookup_subnet_rule (const struct pf_subnet_set *sns, const in_addr_t addr)
+{
+  const struct ipv4_subnet *rule = NULL;
+  int order = 0;
+  int node = 0;
+  int i = 0;
+
+  while (true)
+    {
+      const struct pf_subnet_node *n = &sns->trie[node];
+      if (n->rule && (!rule || n->order < order))
+	{
+	  rule = n->rule;
+	  order = n->order;
+	}
+      if (i == 32)
+	break;
+      node = n->child[(addr >> (31 - i)) & 1];
+      if (!node)
+	break;
+      ++i;
+    }
+  return rule;
+}
+
 static struct pf_set *
 pf_init (const struct buffer_list *bl, const char *prefix, const bool allow_kill)
 {
@@ -281,6 +356,7 @@ pf_init (const struct buffer_list *bl, const char *prefix, const bool allow_kill
 	{
 	  if (!genhash (&pfs->cns, prefix, n_clients))
 	    ++n_errors;
+	  compile_subnets (&pfs->sns);
 	}
       if (n_errors)
 	msg (D_PF_INFO, "PF: %s rejected due to %d error(s)", prefix, n_errors);
@@ -409,7 +485,7 @@ lookup_cn_rule (struct hash *h, const char *cn, const uint32_t cn_hash)
 }
 
 bool
-pf_cn_test (struct pf_set *pfs, const struct tls_multi *tm, const int type, const char *prefix)
+pf_cn_test (struct pf_set *pfs, const unsigned int peer, const struct tls_multi *tm, const int type, const char *prefix)
 {
   if (!pfs->kill)
     {
@@ -417,17 +493,31 @@ pf_cn_test (struct pf_set *pfs, const struct tls_multi *tm, const int type, cons
       uint32_t cn_hash;
       if (tls_common_name_hash (tm, &cn, &cn_hash))
 	{
-	  const struct pf_cn *rule = lookup_cn_rule (pfs->cns.hash_table, cn, cn_hash);
+	  const struct pf_cn *rule;
+	  struct pf_cn_decision *d;
+
+	  if (!pfs->cns.cache)
+	    ALLOC_ARRAY_CLEAR (pfs->cns.cache, struct pf_cn_decision, PF_CN_CACHE_SIZE);
+	  d = &pfs->cns.cache[peer & (PF_CN_CACHE_SIZE - 1)];
+	  if (d->peer == peer && d->cn_hash == cn_hash)
+	    {
+#ifdef ENABLE_DEBUG
+	      if (check_debug_level (D_PF_DEBUG))
+		pf_cn_test_print ("PF_CN_CACHED", type, prefix, cn, d->allow, NULL);
+#endif
+	      return d->allow;
+	    }
+
+	  rule = lookup_cn_rule (pfs->cns.hash_table, cn, cn_hash);
+	  d->peer = peer;
+	  d->cn_hash = cn_hash;
 	  if (rule)
 	    {
 #ifdef ENABLE_DEBUG
 	      if (check_debug_level (D_PF_DEBUG))
 		pf_cn_test_print ("PF_CN_MATCH", type, prefix, cn, !rule->exclude, rule);
 #endif
-	      if (!rule->exclude)
-		return true;
-	      else
-		return false;
+	      d->allow = !rule->exclude;
 	    }
 	  else
 	    {
@@ -435,11 +525,9 @@ pf_cn_test (struct pf_set *pfs, const struct tls_multi *tm, const int type, cons
 	      if (check_debug_level (D_PF_DEBUG))
 		pf_cn_test_print ("PF_CN_DEFAULT", type, prefix, cn, pfs->cns.default_allow, NULL);
 #endif
-	      if (pfs->cns.default_allow)
-		return true;
-	      else
-		return false;
+	      d->allow = pfs->cns.default_allow;
 	    }
+	  return d->allow;
 	}
     }
 #ifdef ENABLE_DEBUG
@@ -456,18 +544,14 @@ pf_addr_test_dowork (const struct context *src, const struct mroute_addr *dest,
   if (pfs && !pfs->kill)
     {
       const in_addr_t addr = in_addr_t_from_mroute_addr (dest);
-      const struct pf_subnet *se = pfs->sns.list;
-      while (se)
+      const struct ipv4_subnet *rule = lookup_subnet_rule (&pfs->sns, addr);
+      if (rule)
 	{
-	  if ((addr & se->rule.netmask) == se->rule.network)
-	    {
 #ifdef ENABLE_DEBUG
-	      if (check_debug_level (D_PF_DEBUG))
-		pf_addr_test_print ("PF_ADDR_MATCH", prefix, src, dest, !se->rule.exclude, &se->rule);
+	  if (check_debug_level (D_PF_DEBUG))
+	    pf_addr_test_print ("PF_ADDR_MATCH", prefix, src, dest, !rule->exclude, rule);
 #endif
-	      return !se->rule.exclude;
-	    }
-	  se = se->next;
+	  return !rule->exclude;
 	}
 #ifdef ENABLE_DEBUG
       if (check_debug_level (D_PF_DEBUG))
@@ -498,12 +582,26 @@ pf_check_reload (struct context *c)
       && c->c2.pf.filename
       && event_timeout_trigger (&c->c2.pf.reload, &c->c2.timeval, ETT_DEFAULT))
     {
+      const struct file_watch_entry *fwe = NULL;
       struct stat s;
-      if (!stat (c->c2.pf.filename, &s))
+
+      /*
+       * If the file is watched, it can only have changed if
+       * its generation moved, and we don't need to stat it.
+       */
+      if (c->c2.pf.file_watch)
+	fwe = file_watch_get (c->c2.pf.file_watch, c->c2.pf.filename);
+      if (fwe && fwe->generation == c->c2.pf.file_generation)
+	;
+      else if (!stat (c->c2.pf.filename, &s))
 	{
-	  if (s.st_mtime > c->c2.pf.file_last_mod)
+	  if (fwe || s.st_mtime > c->c2.pf.file_last_mod)
 	    {
-	      struct pf_set *pfs = pf_init_from_file (c->c2.pf.filename);
+	      struct pf_set *pfs;
+
+	      if (fwe)
+		c->c2.pf.file_generation = fwe->generation;
+	      pfs = pf_init_from_file (c->c2.pf.filename);
 	      if (pfs)
 		{
 		  if (c->c2.pf.pfs)
@@ -555,7 +653,13 @@ pf_load_from_buffer_list (struct context *c, const struct buffer_list *config)
 void
 pf_init_context (struct context *c)
 {
+  static unsigned int next_id = 0;
   struct gc_arena gc = gc_new ();
+
+  /* 0 never matches a pf_cn_decision */
+  if (!++next_id)
+    ++next_id;
+  c->c2.pf.id = next_id;
 #ifdef PLUGIN_PF
   if (plugin_defined (c->plugins, OPENVPN_PLUGIN_ENABLE_PF))
     {
@@ -568,6 +672,8 @@ pf_init_context (struct context *c)
             event_timeout_init (&c->c2.pf.reload, 1, now);
             c->c2.pf.filename = string_alloc (pf_file, NULL);
             c->c2.pf.enabled = true;
+            if (c->c1.file_watch && file_watch_get (c->c1.file_watch, pf_file))
+              c->c2.pf.file_watch = c->c1.file_watch;
 #ifdef ENABLE_DEBUG
             if (check_debug_level (D_PF_DEBUG))
               pf_context_print (&c->c2.pf, "pf_init_context#1", D_PF_DEBUG);
@@ -599,6 +705,8 @@ pf_destroy_context (struct pf_context *pfc)
 #ifdef PLUGIN_PF
   if (pfc->filename)
     {
+      if (pfc->file_watch)
+	file_watch_forget (pfc->file_watch, pfc->filename);
       delete_file (pfc->filename);
       free (pfc->filename);
     }
@@ -29,6 +29,7 @@
 
 #include "list.h"
 #include "mroute.h"
+#include "fwatch.h"
 
 #define PF_MAX_LINE_LEN 256
 
@@ -45,9 +46,21 @@ struct pf_subnet {
   struct ipv4_subnet rule;
 };
 
+/*
+ * Binary trie over the subnet rules, one level per
+ * address bit.  A node holds the first rule of the list
+ * whose subnet is exactly the node's prefix.
+ */
+struct pf_subnet_node {
+  int child[2];                    /* 0 if none, the root is never a child */
+  const struct ipv4_subnet *rule;
+  int order;                       /* position of rule in the list */
+};
+
 struct pf_subnet_set {
   bool default_allow;
   struct pf_subnet *list;
+  struct pf_subnet_node *trie;     /* compiled from list */
 };
 
 struct pf_cn {
@@ -60,10 +73,22 @@ struct pf_cn_elem {
   struct pf_cn rule;
 };
 
+/*
+ * Decision of the [clients] rules for one peer, cached
+ * by the peer's pf_context id.
+ */
+#define PF_CN_CACHE_SIZE 256  /* power of 2 */
+struct pf_cn_decision {
+  unsigned int peer;
+  uint32_t cn_hash;
+  bool allow;
+};
+
 struct pf_cn_set {
   bool default_allow;
   struct pf_cn_elem *list;
   struct hash *hash_table;
+  struct pf_cn_decision *cache;    /* allocated on first lookup */
 };
 
 struct pf_set {
@@ -74,10 +99,13 @@ struct pf_set {
 
 struct pf_context {
   bool enabled;
+  unsigned int id;                 /* unique among client instances */
   struct pf_set *pfs;
 #ifdef PLUGIN_PF
   char *filename;
   time_t file_last_mod;
+  struct file_watch *file_watch;   /* NULL if not watched */
+  unsigned int file_generation;    /* of filename when last loaded */
   unsigned int n_check_reload;
   struct event_timeout reload;
 #endif
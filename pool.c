@@ -29,78 +29,187 @@
 #include "error.h"
 #include "socket.h"
 #include "otime.h"
+#include "integer.h"
 
 #include "memdbg.h"
 
 #if P2MP
 
 static void
-ifconfig_pool_entry_free (struct ifconfig_pool_entry *ipe, bool hard)
+ifconfig_pool_free_list_unlink (struct ifconfig_pool *pool, const int i)
 {
+  struct ifconfig_pool_entry *ipe = &pool->list[i];
+
+  if (!ipe->free_listed)
+    return;
+  if (ipe->free_prev >= 0)
+    pool->list[ipe->free_prev].free_next = ipe->free_next;
+  else
+    pool->free_head = ipe->free_next;
+  if (ipe->free_next >= 0)
+    pool->list[ipe->free_next].free_prev = ipe->free_prev;
+  else
+    pool->free_tail = ipe->free_prev;
+  ipe->free_listed = false;
+}
+
+/*
+ * Put an entry on the free list, at the head if it has never
+ * been used or was hard released, otherwise at the tail, which
+ * keeps the list ordered by release time.
+ */
+static void
+ifconfig_pool_free_list_link (struct ifconfig_pool *pool, const int i)
+{
+  struct ifconfig_pool_entry *ipe = &pool->list[i];
+
+  ASSERT (!ipe->free_listed);
+  if (!ipe->last_release)
+    {
+      ipe->free_prev = -1;
+      ipe->free_next = pool->free_head;
+      if (pool->free_head >= 0)
+	pool->list[pool->free_head].free_prev = i;
+      else
+	pool->free_tail = i;
+      pool->free_head = i;
+    }
+  else
+    {
+      ipe->free_next = -1;
+      ipe->free_prev = pool->free_tail;
+      if (pool->free_tail >= 0)
+	pool->list[pool->free_tail].free_next = i;
+      else
+	pool->free_head = i;
+      pool->free_tail = i;
+    }
+  ipe->free_listed = true;
+}
+
+static void
+ifconfig_pool_mark_dirty (struct ifconfig_pool *pool, const int i)
+{
+  struct ifconfig_pool_entry *ipe = &pool->list[i];
+
+  if (!ipe->dirty)
+    {
+      ipe->dirty = true;
+      ipe->dirty_next = pool->dirty_head;
+      pool->dirty_head = i;
+      ++pool->n_dirty;
+    }
+}
+
+static void
+ifconfig_pool_clear_dirty (struct ifconfig_pool *pool)
+{
+  while (pool->dirty_head >= 0)
+    {
+      struct ifconfig_pool_entry *ipe = &pool->list[pool->dirty_head];
+      ipe->dirty = false;
+      pool->dirty_head = ipe->dirty_next;
+    }
+  pool->n_dirty = 0;
+}
+
+static int *
+ifconfig_pool_cn_bucket (struct ifconfig_pool *pool, const char *common_name)
+{
+  /* FNV-1a */
+  uint32_t h = 2166136261u;
+  const unsigned char *c;
+
+  for (c = (const unsigned char *) common_name; *c; ++c)
+    h = (h ^ *c) * 16777619u;
+  return &pool->cn_hash[h & pool->cn_hash_mask];
+}
+
+static void
+ifconfig_pool_set_cn (struct ifconfig_pool *pool, const int i, const char *common_name)
+{
+  struct ifconfig_pool_entry *ipe = &pool->list[i];
+  int *bucket;
+
+  ASSERT (!ipe->common_name);
+  ipe->common_name = string_alloc (common_name, NULL);
+  bucket = ifconfig_pool_cn_bucket (pool, common_name);
+  ipe->cn_next = *bucket;
+  *bucket = i;
+  ifconfig_pool_mark_dirty (pool, i);
+}
+
+static void
+ifconfig_pool_entry_free (struct ifconfig_pool *pool, const int i, bool hard)
+{
+  struct ifconfig_pool_entry *ipe = &pool->list[i];
+
   ipe->in_use = false;
   if (hard && ipe->common_name)
     {
+      int *p = ifconfig_pool_cn_bucket (pool, ipe->common_name);
+      while (*p != i)
+	{
+	  ASSERT (*p >= 0);
+	  p = &pool->list[*p].cn_next;
+	}
+      *p = ipe->cn_next;
       free (ipe->common_name);
       ipe->common_name = NULL;
+      ifconfig_pool_mark_dirty (pool, i);
     }
   if (hard)
     ipe->last_release = 0;
   else
     ipe->last_release = now;
+
+  ifconfig_pool_free_list_unlink (pool, i);
+  if (!ipe->fixed)
+    ifconfig_pool_free_list_link (pool, i);
 }
 
 static int
 ifconfig_pool_find (struct ifconfig_pool *pool, const char *common_name)
 {
   int i;
-  time_t earliest_release = 0;
-  int previous_usage = -1;
-  int new_usage = -1;
 
-  for (i = 0; i < pool->size; ++i)
+  /*
+   * If duplicate_cn mode, take first available IP address
+   */
+  if (pool->duplicate_cn)
     {
-      struct ifconfig_pool_entry *ipe = &pool->list[i];
-      if (!ipe->in_use)
-	{
-	  /*
-	   * If duplicate_cn mode, take first available IP address
-	   */
-	  if (pool->duplicate_cn)
-	    {
-	      new_usage = i;
-	      break;
-	    }
-
-	  /*
-	   * Keep track of the unused IP address entry which
-	   * was released earliest.
-	   */
-	  if ((new_usage == -1 || ipe->last_release < earliest_release) && !ipe->fixed)
-	    {
-	      earliest_release = ipe->last_release;
-	      new_usage = i;
-	    }
+      if (pool->free_head >= 0)
+	return pool->free_head;
+      for (i = 0; i < pool->size; ++i)
+	if (!pool->list[i].in_use)
+	  return i;
+      return -1;
+    }
 
-	  /*
-	   * Keep track of a possible allocation to us
-	   * from an earlier session.
-	   */
-	  if (previous_usage < 0
-	      && common_name
-	      && ipe->common_name
+  /*
+   * Look for a possible allocation to us
+   * from an earlier session.
+   */
+  if (common_name)
+    {
+      int previous_usage = -1;
+      for (i = *ifconfig_pool_cn_bucket (pool, common_name); i >= 0; i = pool->list[i].cn_next)
+	{
+	  const struct ifconfig_pool_entry *ipe = &pool->list[i];
+	  if (!ipe->in_use
+	      && (previous_usage < 0 || i < previous_usage)
 	      && !strcmp (common_name, ipe->common_name))
 	    previous_usage = i;
-
 	}
+      if (previous_usage >= 0)
+	return previous_usage;
     }
 
-  if (previous_usage >= 0)
-    return previous_usage;
-
-  if (new_usage >= 0)
-    return new_usage;
-
-  return -1;
+  /*
+   * Otherwise take the unused IP address entry
+   * which was released earliest.
+   */
+  return pool->free_head;
 }
 
 /*
@@ -139,6 +248,7 @@ ifconfig_pool_init (int type, in_addr_t start, in_addr_t end,
 {
   struct gc_arena gc = gc_new ();
   struct ifconfig_pool *pool = NULL;
+  int i;
 
   ASSERT (start <= end && end - start < IFCONFIG_POOL_MAX);
   ALLOC_OBJ_CLEAR (pool, struct ifconfig_pool);
@@ -182,6 +292,19 @@ ifconfig_pool_init (int type, in_addr_t start, in_addr_t end,
 
   ALLOC_ARRAY_CLEAR (pool->list, struct ifconfig_pool_entry, pool->size);
 
+  pool->cn_hash_mask = 1;
+  while (pool->cn_hash_mask < pool->size)
+    pool->cn_hash_mask <<= 1;
+  ALLOC_ARRAY (pool->cn_hash, int, pool->cn_hash_mask);
+  for (i = 0; i < pool->cn_hash_mask; ++i)
+    pool->cn_hash[i] = -1;
+  --pool->cn_hash_mask;
+
+  pool->free_head = pool->free_tail = -1;
+  pool->dirty_head = -1;
+  for (i = pool->size - 1; i >= 0; --i)
+    ifconfig_pool_free_list_link (pool, i);
+
   msg (D_IFCONFIG_POOL, "IFCONFIG POOL: base=%s size=%d, ipv6=%d",
        print_in_addr_t (pool->base, 0, &gc),
        pool->size, pool->ipv6 );
@@ -197,7 +320,8 @@ ifconfig_pool_free (struct ifconfig_pool *pool)
     {
       int i;
       for (i = 0; i < pool->size; ++i)
-	ifconfig_pool_entry_free (&pool->list[i], true);
+	free (pool->list[i].common_name);
+      free (pool->cn_hash);
       free (pool->list);
       free (pool);
     }
@@ -213,10 +337,11 @@ ifconfig_pool_acquire (struct ifconfig_pool *pool, in_addr_t *local, in_addr_t *
     {
       struct ifconfig_pool_entry *ipe = &pool->list[i];
       ASSERT (!ipe->in_use);
-      ifconfig_pool_entry_free (ipe, true);
+      ifconfig_pool_entry_free (pool, i, true);
+      ifconfig_pool_free_list_unlink (pool, i);
       ipe->in_use = true;
       if (common_name)
-	ipe->common_name = string_alloc (common_name, NULL);
+	ifconfig_pool_set_cn (pool, i, common_name);
 
       switch (pool->type)
 	{
@@ -253,7 +378,7 @@ ifconfig_pool_release (struct ifconfig_pool* pool, ifconfig_pool_handle hand, co
   bool ret = false;
   if (pool && hand >= 0 && hand < pool->size)
     {
-      ifconfig_pool_entry_free (&pool->list[hand], hard);
+      ifconfig_pool_entry_free (pool, hand, hard);
       ret = true;
     }
   return ret;
@@ -337,17 +462,60 @@ ifconfig_pool_set (struct ifconfig_pool* pool, const char *cn, const in_addr_t a
   if (h >= 0)
     {
       struct ifconfig_pool_entry *e = &pool->list[h];
-      ifconfig_pool_entry_free (e, true);
-      e->in_use = false;
-      e->common_name = string_alloc (cn, NULL);
-      e->last_release = now;
-      e->fixed = fixed;
+      ifconfig_pool_entry_free (pool, h, true);
+
+      /* an empty name records a lease which was dropped */
+      if (*cn)
+	{
+	  ifconfig_pool_set_cn (pool, h, cn);
+	  e->fixed = fixed;
+	  e->last_release = now;
+	}
+      else
+	e->fixed = false;
+
+      /* requeue as released now */
+      ifconfig_pool_free_list_unlink (pool, h);
+      if (!e->fixed)
+	ifconfig_pool_free_list_link (pool, h);
     }
 }
 
+/*
+ * Write the lease held at handle i, or an empty
+ * name if there is none.
+ */
 static void
+ifconfig_pool_entry_print (const struct ifconfig_pool* pool, const int i, struct status_output *out, struct gc_arena *gc)
+{
+  const struct ifconfig_pool_entry *e = &pool->list[i];
+  const char *cn = e->common_name ? e->common_name : "";
+  const in_addr_t ip = ifconfig_pool_handle_to_ip_base (pool, i);
+
+  if ( pool->ipv6 )
+    {
+      struct in6_addr ip6 = ifconfig_pool_handle_to_ipv6_base (pool, i);
+      status_printf (out, "%s,%s,%s",
+		     cn,
+		     print_in_addr_t (ip, 0, gc),
+		     print_in6_addr (ip6, 0, gc));
+    }
+  else
+    {
+      status_printf (out, "%s,%s",
+		     cn,
+		     print_in_addr_t (ip, 0, gc));
+    }
+}
+
+/*
+ * Write all leases, returning their number.
+ */
+static int
 ifconfig_pool_list (const struct ifconfig_pool* pool, struct status_output *out)
 {
+  int n = 0;
+
   if (pool && out)
     {
       struct gc_arena gc = gc_new ();
@@ -355,28 +523,16 @@ ifconfig_pool_list (const struct ifconfig_pool* pool, struct status_output *out)
 
       for (i = 0; i < pool->size; ++i)
 	{
-	  const struct ifconfig_pool_entry *e = &pool->list[i];
-	  if (e->common_name)
+	  if (pool->list[i].common_name)
 	    {
-	      const in_addr_t ip = ifconfig_pool_handle_to_ip_base (pool, i);
-	      if ( pool->ipv6 )
-		{
-		  struct in6_addr ip6 = ifconfig_pool_handle_to_ipv6_base (pool, i);
-		  status_printf (out, "%s,%s,%s",
-				 e->common_name,
-				 print_in_addr_t (ip, 0, &gc),
-				 print_in6_addr (ip6, 0, &gc));
-		}
-	      else
-		{
-		  status_printf (out, "%s,%s",
-				 e->common_name,
-				 print_in_addr_t (ip, 0, &gc));
-		}
+	      ifconfig_pool_entry_print (pool, i, out, &gc);
+	      ++n;
 	    }
+	  gc_reset (&gc);
 	}
       gc_free (&gc);
     }
+  return n;
 }
 
 static void
@@ -401,6 +557,7 @@ ifconfig_pool_persist_init (const char *filename, int refresh_freq)
   ASSERT (filename);
 
   ALLOC_OBJ_CLEAR (ret, struct ifconfig_pool_persist);
+  ret->compact = true;
   if (refresh_freq > 0)
     {
       ret->fixed = false;
@@ -462,8 +619,8 @@ ifconfig_pool_read (struct ifconfig_pool_persist *persist, struct ifconfig_pool
 	      int c = *BSTR(&in);
 	      if (c == '#' || c == ';')
 		continue;
-	      msg( M_INFO, "ifconfig_pool_read(), in='%s', TODO: IPv6",
-				BSTR(&in) );
+	      dmsg (D_IFCONFIG_POOL, "ifconfig_pool_read(), in='%s', TODO: IPv6",
+		    BSTR(&in) );
 
 	      if (buf_parse (&in, ',', cn_buf, buf_size)
 		  && buf_parse (&in, ',', ip_buf, buf_size))
@@ -472,27 +629,59 @@ ifconfig_pool_read (struct ifconfig_pool_persist *persist, struct ifconfig_pool
 		  const in_addr_t addr = getaddr (GETADDR_HOST_ORDER, ip_buf, 0, &succeeded, NULL);
 		  if (succeeded)
 		    {
-		      msg( M_INFO, "succeeded -> ifconfig_pool_set()");
 		      ifconfig_pool_set (pool, cn_buf, addr, persist->fixed);
 		    }
 		}
 	    }
 	}
 
-      ifconfig_pool_msg (pool, D_IFCONFIG_POOL);
+      /* the file holds line leases, compact it once the
+	 appended changes outgrow that */
+      persist->n_snapshot = line;
+      persist->n_journal = 0;
+      ifconfig_pool_clear_dirty (pool);
+
+      if (check_debug_level (D_IFCONFIG_POOL))
+	ifconfig_pool_msg (pool, D_IFCONFIG_POOL);
   
       gc_free (&gc);
     }
 }
 
+/*
+ * Append the leases which changed since the last call to the
+ * persist file, rewriting the whole file instead once the
+ * appended changes outnumber the leases of the last rewrite.
+ * The first write after opening the file always rewrites it.
+ */
 void
-ifconfig_pool_write (struct ifconfig_pool_persist *persist, const struct ifconfig_pool *pool)
+ifconfig_pool_write (struct ifconfig_pool_persist *persist, struct ifconfig_pool *pool)
 {
   if (persist && persist->file && (status_rw_flags (persist->file) & STATUS_OUTPUT_WRITE) && pool)
     {
-      status_reset (persist->file);
-      ifconfig_pool_list (pool, persist->file);
-      status_flush (persist->file);
+      if (persist->compact
+	  || persist->n_journal + pool->n_dirty > max_int (persist->n_snapshot, IFCONFIG_POOL_JOURNAL_MIN))
+	{
+	  status_reset (persist->file);
+	  persist->n_snapshot = ifconfig_pool_list (pool, persist->file);
+	  persist->n_journal = 0;
+	  persist->compact = false;
+	  status_flush (persist->file);
+	}
+      else if (pool->n_dirty)
+	{
+	  struct gc_arena gc = gc_new ();
+	  int i;
+
+	  for (i = pool->dirty_head; i >= 0; i = pool->list[i].dirty_next)
+	    {
+	      ifconfig_pool_entry_print (pool, i, persist->file, &gc);
+	      gc_reset (&gc);
+	    }
+	  persist->n_journal += pool->n_dirty;
+	  gc_free (&gc);
+	}
+      ifconfig_pool_clear_dirty (pool);
     }
 }
 
@@ -44,6 +44,16 @@ struct ifconfig_pool_entry
   char *common_name;
   time_t last_release;
   bool fixed;
+
+  /* free list and common name hash chain links, -1 terminated */
+  bool free_listed;
+  int free_prev;
+  int free_next;
+  int cn_next;
+
+  /* common name changed since the last ifconfig_pool_write */
+  bool dirty;
+  int dirty_next;
 };
 
 struct ifconfig_pool
@@ -56,12 +66,45 @@ struct ifconfig_pool
   struct in6_addr base_ipv6;
   unsigned int size_ipv6;
   struct ifconfig_pool_entry *list;
+
+  /* unused entries which are not fixed, earliest released first */
+  int free_head;
+  int free_tail;
+
+  /* entries holding a common name, chained by hash of the name */
+  int *cn_hash;
+  int cn_hash_mask;
+
+  /* dirty entries, to be appended to the persist file */
+  int dirty_head;
+  int n_dirty;
 };
 
+/*
+ * Minimum number of lease changes appended to the persist
+ * file before it is compacted.
+ */
+#define IFCONFIG_POOL_JOURNAL_MIN 256
+
 struct ifconfig_pool_persist
 {
   struct status_output *file;
   bool fixed;
+
+  /*
+   * The file holds a snapshot of n_snapshot leases followed
+   * by n_journal lease changes, which override earlier lines
+   * for the same address.
+   */
+  int n_snapshot;
+  int n_journal;
+
+  /*
+   * Rewrite the whole file on the next write, rather than
+   * appending at a file offset which may not follow a
+   * complete line, such as after reading a hand-edited file.
+   */
+  bool compact;
 };
 
 typedef int ifconfig_pool_handle;
@@ -81,7 +124,7 @@ void ifconfig_pool_persist_close (struct ifconfig_pool_persist *persist);
 bool ifconfig_pool_write_trigger (struct ifconfig_pool_persist *persist);
 
 void ifconfig_pool_read (struct ifconfig_pool_persist *persist, struct ifconfig_pool *pool);
-void ifconfig_pool_write (struct ifconfig_pool_persist *persist, const struct ifconfig_pool *pool);
+void ifconfig_pool_write (struct ifconfig_pool_persist *persist, struct ifconfig_pool *pool);
 
 #ifdef IFCONFIG_POOL_TEST
 void ifconfig_pool_test (in_addr_t start, in_addr_t end);
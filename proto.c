@@ -68,6 +68,106 @@ is_ipv4 (int tunnel_type, struct buffer *buf)
     return false;
 }
 
+static void
+packet_classify_ipv4 (struct packet_info *pi)
+{
+  const struct openvpn_iphdr *ip = (const struct openvpn_iphdr *) (pi->data + pi->l3);
+  const int hlen = OPENVPN_IPH_GET_LEN (ip->version_len);
+  int end = pi->l3 + ntohs (ip->tot_len);
+
+  pi->flags |= PI_IPV4;
+  if (ip->protocol == OPENVPN_IPPROTO_IGMP)
+    pi->flags |= PI_IGMP;
+
+  /* only the first fragment carries the transport header */
+  if (ntohs (ip->frag_off) & OPENVPN_IP_OFFMASK)
+    {
+      pi->flags |= PI_FRAGMENT;
+      return;
+    }
+  if (hlen < (int) sizeof (struct openvpn_iphdr))
+    return;
+
+  /* ignore ethernet padding, and don't trust tot_len beyond the buffer */
+  if (end > pi->len)
+    end = pi->len;
+  pi->l4 = pi->l3 + hlen;
+  pi->l4_len = end - pi->l4;
+
+  if (ip->protocol == OPENVPN_IPPROTO_TCP)
+    {
+      if (pi->l4_len >= (int) sizeof (struct openvpn_tcphdr))
+	{
+	  const struct openvpn_tcphdr *tc = (const struct openvpn_tcphdr *) (pi->data + pi->l4);
+	  pi->flags |= PI_TCP;
+	  if (tc->flags & OPENVPN_TCPH_SYN_MASK)
+	    pi->flags |= PI_TCP_SYN;
+	}
+    }
+  else if (ip->protocol == OPENVPN_IPPROTO_UDP)
+    {
+      if (pi->l4_len >= (int) sizeof (struct openvpn_udphdr))
+	pi->flags |= PI_UDP;
+    }
+}
+
+void
+packet_classify (struct packet_info *pi, const struct buffer *buf, const int tunnel_type)
+{
+  pi->data = BPTR (buf);
+  pi->len = BLEN (buf);
+  pi->tunnel_type = tunnel_type;
+  pi->flags = 0;
+  pi->l3 = pi->l4 = pi->l4_len = 0;
+
+  verify_align_4 (buf);
+  if (tunnel_type == DEV_TYPE_TUN)
+    {
+      if (pi->len >= 1)
+	{
+	  switch (OPENVPN_IPH_GET_VER (*pi->data))
+	    {
+	    case 4:
+	      if (pi->len >= (int) sizeof (struct openvpn_iphdr))
+		packet_classify_ipv4 (pi);
+	      break;
+	    case 6:
+	      if (pi->len >= (int) sizeof (struct openvpn_ipv6hdr))
+		pi->flags |= PI_IPV6;
+	      break;
+	    }
+	}
+    }
+  else if (tunnel_type == DEV_TYPE_TAP)
+    {
+      if (pi->len >= (int) sizeof (struct openvpn_ethhdr))
+	{
+	  const struct openvpn_ethhdr *eh = (const struct openvpn_ethhdr *) pi->data;
+	  const int room = pi->len - (int) sizeof (struct openvpn_ethhdr);
+
+	  pi->flags |= PI_ETHER;
+	  pi->l3 = sizeof (struct openvpn_ethhdr);
+	  switch (ntohs (eh->proto))
+	    {
+	    case OPENVPN_ETH_P_IPV4:
+	      if (room >= (int) sizeof (struct openvpn_iphdr)
+		  && OPENVPN_IPH_GET_VER (pi->data[pi->l3]) == 4)
+		packet_classify_ipv4 (pi);
+	      break;
+	    case OPENVPN_ETH_P_IPV6:
+	      if (room >= (int) sizeof (struct openvpn_ipv6hdr)
+		  && OPENVPN_IPH_GET_VER (pi->data[pi->l3]) == 6)
+		pi->flags |= PI_IPV6;
+	      break;
+	    case OPENVPN_ETH_P_ARP:
+	      if (room >= (int) sizeof (struct openvpn_arp))
+		pi->flags |= PI_ARP;
+	      break;
+	    }
+	}
+    }
+}
+
 #ifdef PACKET_TRUNCATION_CHECK
 
 void
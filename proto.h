@@ -91,6 +91,7 @@ struct openvpn_iphdr {
   uint16_t   tot_len;
   uint16_t   id;
 
+# define OPENVPN_IP_MF      0x2000
 # define OPENVPN_IP_OFFMASK 0x1fff
   uint16_t   frag_off;
 
@@ -224,6 +225,58 @@ struct ip_tcp_udp_hdr {
  */
 bool is_ipv4 (int tunnel_type, struct buffer *buf);
 
+/*
+ * Headers of a tunnel packet, parsed once by packet_classify
+ * and then consulted by the stages which need them (routing,
+ * --mssfix, --passtos, --client-nat, DHCP router extraction),
+ * rather than each stage parsing the packet again.  Offsets
+ * are relative to BPTR of the classified buffer.
+ */
+struct packet_info
+{
+  const uint8_t *data;    /* BPTR of the classified buffer */
+  int len;                /* BLEN of the classified buffer, 0 if none */
+  int tunnel_type;
+
+# define PI_ETHER     (1<<0)  /* ethernet header at offset 0 */
+# define PI_IPV4      (1<<1)  /* IPv4 header at l3 */
+# define PI_IPV6      (1<<2)  /* IPv6 header at l3 */
+# define PI_ARP       (1<<3)  /* ARP packet at l3 */
+# define PI_FRAGMENT  (1<<4)  /* IPv4 fragment other than the first */
+# define PI_IGMP      (1<<5)
+# define PI_TCP       (1<<6)  /* complete TCP header at l4 */
+# define PI_TCP_SYN   (1<<7)
+# define PI_UDP       (1<<8)  /* complete UDP header at l4 */
+  unsigned int flags;
+
+  int l3;                 /* offset of the IP or ARP header */
+  int l4;                 /* offset of the TCP or UDP header */
+  int l4_len;             /* bytes from l4 to the end of the IP packet */
+};
+
+void packet_classify (struct packet_info *pi, const struct buffer *buf, const int tunnel_type);
+
+static inline void
+packet_info_reset (struct packet_info *pi)
+{
+  pi->len = 0;
+}
+
+/*
+ * Return the classification of buf, reusing pi if it
+ * describes buf and classifying buf into pi otherwise.
+ */
+static inline const struct packet_info *
+packet_info_get (struct packet_info *pi, const struct buffer *buf, const int tunnel_type)
+{
+  if (!pi->len
+      || pi->data != BPTR (buf)
+      || pi->len != BLEN (buf)
+      || pi->tunnel_type != tunnel_type)
+    packet_classify (pi, buf, tunnel_type);
+  return pi;
+}
+
 #ifdef PACKET_TRUNCATION_CHECK
 void ipv4_packet_size_verify (const uint8_t *data,
 			      const int size,
@@ -223,6 +223,39 @@ send_push_request (struct context *c)
 
 #if P2MP_SERVER
 
+/*
+ * Send the PUSH_REPLY bundle in buf, flagged as to be
+ * continued, and start the next one.
+ */
+static bool
+push_reply_continue (struct context *c, struct buffer *buf, const char *cmd)
+{
+  buf_printf (buf, ",push-continuation 2");
+  if (!send_control_channel_string (c, BSTR (buf), D_PUSH))
+    return false;
+  buf_reset_len (buf);
+  buf_printf (buf, "%s", cmd);
+  return true;
+}
+
+/*
+ * Length of the longest run of whole ",option" items at the
+ * start of text which fits into room bytes, 0 if not even
+ * the first one does.
+ */
+static int
+push_reply_fit (const char *text, const int len, const int room)
+{
+  int n;
+
+  if (len <= room)
+    return len;
+  for (n = room; n > 0; --n)
+    if (text[n] == ',')
+      return n;
+  return 0;
+}
+
 bool
 send_push_reply (struct context *c)
 {
@@ -255,6 +288,35 @@ send_push_reply (struct context *c)
 	}
     }
 
+  /* options common to all clients, rendered once by push_list_render */
+  if (c->options.push_list.cache)
+    {
+      const char *text = c->options.push_list.cache->text;
+      int len = c->options.push_list.cache->len;
+
+      while (len > 0)
+	{
+	  int n = push_reply_fit (text, len, safe_cap - BLEN (&buf));
+	  if (!n)
+	    {
+	      if (!push_reply_continue (c, &buf, cmd))
+		goto fail;
+	      push_sent = true;
+	      multi_push = true;
+	      n = push_reply_fit (text, len, safe_cap - BLEN (&buf));
+	      if (!n)
+		{
+		  msg (M_WARN, "--push option is too long");
+		  goto fail;
+		}
+	    }
+	  buf_printf (&buf, "%.*s", n, text);
+	  text += n;
+	  len -= n;
+	}
+      e = c->options.push_list.uncached;
+    }
+
   while (e)
     {
       if (e->enable)
@@ -262,16 +324,10 @@ send_push_reply (struct context *c)
 	  const int l = strlen (e->option);
 	  if (BLEN (&buf) + l >= safe_cap)
 	    {
-	      buf_printf (&buf, ",push-continuation 2");
-	      {
-		const bool status = send_control_channel_string (c, BSTR (&buf), D_PUSH);
-		if (!status)
-		  goto fail;
-		push_sent = true;
-		multi_push = true;
-		buf_reset_len (&buf);
-		buf_printf (&buf, "%s", cmd);
-	      }
+	      if (!push_reply_continue (c, &buf, cmd))
+		goto fail;
+	      push_sent = true;
+	      multi_push = true;
 	    }
 	  if (BLEN (&buf) + l >= safe_cap)
 	    {
@@ -337,9 +393,12 @@ push_option_ex (struct options *o, const char *opt, bool enable, int msglevel)
   else
     {
       struct push_entry *e;
+      push_list_own (o);
       ALLOC_OBJ_CLEAR_GC (e, struct push_entry, &o->gc);
-      e->enable = true;
+      e->enable = enable;
       e->option = opt;
+      if (o->push_list.cache && !o->push_list.uncached)
+	o->push_list.uncached = e;
       if (o->push_list.head)
 	{
 	  ASSERT(o->push_list.tail);
@@ -361,21 +420,63 @@ push_option (struct options *o, const char *opt, int msglevel)
   push_option_ex (o, opt, true, msglevel);
 }
 
+/*
+ * Replace a push list shared with the parent options by a
+ * private copy of its entries.  The option strings are owned
+ * by the parent and stay shared.
+ */
 void
-clone_push_list (struct options *o)
+push_list_own (struct options *o)
 {
-  if (o->push_list.head)
+  if (o->push_list.shared)
     {
-      const struct push_entry *e = o->push_list.head;
+      const struct push_list old = o->push_list;
+      const struct push_entry *e;
+
       push_reset (o);
-      while (e)
+      for (e = old.head; e; e = e->next)
 	{
-	  push_option_ex (o, string_alloc (e->option, &o->gc), true, M_FATAL);
-	  e = e->next;
+	  push_option_ex (o, e->option, e->enable, M_FATAL);
+	  if (e == old.uncached)
+	    o->push_list.uncached = o->push_list.tail;
 	}
+      o->push_list.cache = old.cache;
     }
 }
 
+/*
+ * Render the push list once, when the configuration is
+ * loaded, so that send_push_reply only needs to copy it.
+ * Entries pushed later by --client-config-dir files or
+ * client-connect scripts are formatted per client.
+ */
+void
+push_list_render (struct options *o)
+{
+  const struct push_entry *e;
+  struct push_cache *pc;
+  struct buffer buf;
+  int len = 0;
+
+  if (!o->push_list.head)
+    return;
+
+  for (e = o->push_list.head; e; e = e->next)
+    if (e->enable)
+      len += strlen (e->option) + 1;
+
+  ALLOC_OBJ_CLEAR_GC (pc, struct push_cache, &o->gc);
+  buf = alloc_buf_gc (len + 1, &o->gc);
+  for (e = o->push_list.head; e; e = e->next)
+    if (e->enable)
+      buf_printf (&buf, ",%s", e->option);
+  pc->text = BSTR (&buf);
+  pc->len = BLEN (&buf);
+
+  o->push_list.cache = pc;
+  o->push_list.uncached = NULL;
+}
+
 void
 push_options (struct options *o, char **p, int msglevel, struct gc_arena *gc)
 {
@@ -484,7 +585,10 @@ remove_iroutes_from_push_route_list (struct options *o)
   if (o && o->push_list.head && o->iroutes)
     {
       struct gc_arena gc = gc_new ();
-      struct push_entry *e = o->push_list.head;
+      struct push_entry *e;
+
+      push_list_own (o);
+      e = o->push_list.head;
 
       /* cycle through the push list */
       while (e)
@@ -525,7 +629,11 @@ remove_iroutes_from_push_route_list (struct options *o)
 	  /* should we copy the push item? */
 	  e->enable = enable;
 	  if (!enable)
-	    msg (D_PUSH, "REMOVE PUSH ROUTE: '%s'", e->option);
+	    {
+	      msg (D_PUSH, "REMOVE PUSH ROUTE: '%s'", e->option);
+	      o->push_list.cache = NULL;
+	      o->push_list.uncached = NULL;
+	    }
 
 	  e = e->next;
 	}
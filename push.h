@@ -54,7 +54,8 @@ void server_pushed_signal (struct context *c, const struct buffer *buffer, const
 
 #if P2MP_SERVER
 
-void clone_push_list (struct options *o);
+void push_list_own (struct options *o);
+void push_list_render (struct options *o);
 
 void push_option (struct options *o, const char *opt, int msglevel);
 void push_options (struct options *o, char **p, int msglevel, struct gc_arena *gc);
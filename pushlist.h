@@ -33,9 +33,24 @@ struct push_entry {
   const char *option;
 };
 
+/* the enabled entries of a push list, rendered as ",opt1,opt2..." */
+struct push_cache {
+  const char *text;
+  int len;
+};
+
 struct push_list {
   struct push_entry *head;
   struct push_entry *tail;
+
+  /* entries belong to the options we were detached
+     from, push_list_own copies them before a change */
+  bool shared;
+
+  /* rendering of the entries before uncached, which
+     is NULL if cache covers the whole list */
+  const struct push_cache *cache;
+  struct push_entry *uncached;
 };
 
 
@@ -271,32 +271,46 @@ reliable_ack_print (struct buffer *buf, bool verbose, struct gc_arena *gc)
 void
 reliable_init (struct reliable *rel, int buf_size, int offset, int array_size, bool hold)
 {
-  int i;
-
   CLEAR (*rel);
   ASSERT (array_size > 0 && array_size <= RELIABLE_CAPACITY);
   rel->hold = hold;
   rel->size = array_size;
   rel->offset = offset;
+  rel->buf_size = buf_size;
+}
+
+void
+reliable_free (struct reliable *rel)
+{
+  int i;
   for (i = 0; i < rel->size; ++i)
     {
       struct reliable_entry *e = &rel->array[i];
-      e->buf = alloc_buf (buf_size);
-      ASSERT (buf_init (&e->buf, offset));
+      free_buf (&e->buf);
     }
 }
 
 void
-reliable_free (struct reliable *rel)
+reliable_release_idle (struct reliable *rel)
 {
   int i;
   for (i = 0; i < rel->size; ++i)
     {
       struct reliable_entry *e = &rel->array[i];
-      free_buf (&e->buf);
+      if (!e->active)
+	free_buf (&e->buf);
     }
 }
 
+int
+reliable_footprint (const struct reliable *rel)
+{
+  int i, ret = 0;
+  for (i = 0; i < rel->size; ++i)
+    ret += rel->array[i].buf.capacity;
+  return ret;
+}
+
 /* no active buffers? */
 bool
 reliable_empty (const struct reliable *rel)
@@ -431,6 +445,8 @@ reliable_get_buf (struct reliable *rel)
       struct reliable_entry *e = &rel->array[i];
       if (!e->active)
 	{
+	  if (!e->buf.data)
+	    e->buf = alloc_buf (rel->buf_size);
 	  ASSERT (buf_init (&e->buf, rel->offset));
 	  return &e->buf;
 	}
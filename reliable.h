@@ -89,6 +89,7 @@ struct reliable
   interval_t initial_timeout;
   packet_id_type packet_id;
   int offset;
+  int buf_size; /* entry buffers are allocated on first use */
   bool hold; /* don't xmit until reliable_schedule_now is called */
   struct reliable_entry array[RELIABLE_CAPACITY];
 };
@@ -201,6 +202,22 @@ void reliable_init (struct reliable *rel, int buf_size, int offset, int array_si
  */
 void reliable_free (struct reliable *rel);
 
+/**
+ * Free the buffers of all entries which are not active.  They are
+ * allocated again when the entries are next used.
+ *
+ * @param rel The reliable structure to trim.
+ */
+void reliable_release_idle (struct reliable *rel);
+
+/**
+ * Return the number of bytes of packet buffer held by a reliable
+ * structure.
+ *
+ * @param rel The reliable structure to check.
+ */
+int reliable_footprint (const struct reliable *rel);
+
 /* add to extra_frame the maximum number of bytes we will need for reliable_ack_write */
 void reliable_ack_adjust_frame_parameters (struct frame* frame, int max);
 
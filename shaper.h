@@ -156,6 +156,86 @@ shaper_wrote_bytes (struct shaper* s, int nbytes)
     }
 }
 
+/*
+ * A token bucket, used to limit the rate of individual
+ * clients in server mode.  Tokens are bytes; the bucket
+ * fills at rate bytes per second up to a depth of burst
+ * bytes.  A packet may pass while the bucket holds at
+ * least one token, and its size is then taken from the
+ * bucket, which may leave it in debt.
+ */
+struct token_bucket
+{
+  int rate;                     /* bytes per second, 0 if unlimited */
+  int burst;
+  int tokens;
+  struct timeval last;          /* last time tokens were added */
+};
+
+/* default depth, as a fraction of one second at the rate */
+#define TOKEN_BUCKET_BURST_DIV  10
+#define TOKEN_BUCKET_BURST_MIN  3000
+
+static inline void
+token_bucket_init (struct token_bucket *tb, int rate, int burst)
+{
+  tb->rate = rate;
+  tb->burst = burst ? burst : max_int (rate / TOKEN_BUCKET_BURST_DIV, TOKEN_BUCKET_BURST_MIN);
+  tb->tokens = tb->burst;
+  tv_clear (&tb->last);
+}
+
+static inline bool
+token_bucket_defined (const struct token_bucket *tb)
+{
+  return tb->rate > 0;
+}
+
+static inline void
+token_bucket_refill (struct token_bucket *tb, const struct timeval *tv)
+{
+  if (tb->tokens < tb->burst)
+    {
+      const int usec = tv_subtract (tv, &tb->last, SHAPER_MAX_TIMEOUT);
+      const int add = (int) ((double) usec * tb->rate / 1000000.0);
+      if (add > 0)
+	{
+	  tb->tokens = min_int (tb->tokens + add, tb->burst);
+	  tb->last = *tv;
+	}
+    }
+  else
+    tb->last = *tv;
+}
+
+/*
+ * Return true if a packet may pass at time tv.
+ */
+static inline bool
+token_bucket_allow (struct token_bucket *tb, const struct timeval *tv)
+{
+  token_bucket_refill (tb, tv);
+  return tb->tokens > 0;
+}
+
+static inline void
+token_bucket_charge (struct token_bucket *tb, int nbytes)
+{
+  tb->tokens -= nbytes;
+}
+
+/*
+ * Microseconds until the bucket holds a token again.
+ */
+static inline int
+token_bucket_delay (const struct token_bucket *tb)
+{
+  if (tb->tokens > 0)
+    return 0;
+  return min_int ((int) ((double) (1 - tb->tokens) * 1000000.0 / tb->rate) + 1,
+		  SHAPER_MAX_TIMEOUT * 1000000);
+}
+
 #if 0
 /*
  * Increase/Decrease bandwidth by a percentage.
@@ -0,0 +1,113 @@
+/*
+ *  OpenVPN -- An application to securely tunnel IP networks
+ *             over a single TCP/UDP port, with support for SSL/TLS-based
+ *             session authentication and key exchange,
+ *             packet encryption, packet authentication, and
+ *             packet compression.
+ *
+ *  Copyright (C) 2002-2010 OpenVPN Technologies, Inc. <sales@openvpn.net>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2
+ *  as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program (see the file COPYING included with this
+ *  distribution); if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "syshead.h"
+#include "buffer.h"
+#include "integer.h"
+#include "error.h"
+#include "slab.h"
+
+#include "memdbg.h"
+
+struct slab *
+slab_init (size_t size, int per_block)
+{
+  struct slab *s;
+
+  ASSERT (per_block > 0);
+  ALLOC_OBJ_CLEAR (s, struct slab);
+  s->size = (max_int ((int) size, (int) sizeof (struct slab_object)) + SLAB_ALIGN - 1) & ~(SLAB_ALIGN - 1);
+  s->per_block = per_block;
+  return s;
+}
+
+void
+slab_free (struct slab *s)
+{
+  if (s)
+    {
+      struct slab_block *b = s->blocks;
+      while (b)
+	{
+	  struct slab_block *next = b->next;
+	  free (b);
+	  b = next;
+	}
+      free (s);
+    }
+}
+
+/*
+ * Add a block of objects to the free list.
+ */
+static void
+slab_grow (struct slab *s)
+{
+  struct slab_block *b;
+  uint8_t *p;
+  int i;
+
+  b = (struct slab_block *) malloc (sizeof (struct slab_block) + SLAB_ALIGN + s->per_block * s->size);
+  check_malloc_return (b);
+  p = (uint8_t *) (b + 1);
+  p += (SLAB_ALIGN - ((size_t) p & (SLAB_ALIGN - 1))) & (SLAB_ALIGN - 1);
+  b->storage = p;
+  b->next = s->blocks;
+  s->blocks = b;
+  ++s->n_blocks;
+
+  /* push in reverse, so that objects are handed out in address order */
+  for (i = s->per_block - 1; i >= 0; --i)
+    {
+      struct slab_object *o = (struct slab_object *) (p + i * s->size);
+      o->next = s->free_list;
+      s->free_list = o;
+    }
+}
+
+void *
+slab_alloc (struct slab *s)
+{
+  struct slab_object *o;
+
+  if (!s->free_list)
+    slab_grow (s);
+  o = s->free_list;
+  s->free_list = o->next;
+  ++s->n_used;
+  memset (o, 0, s->size);
+  return o;
+}
+
+void
+slab_release (struct slab *s, void *obj)
+{
+  if (obj)
+    {
+      struct slab_object *o = (struct slab_object *) obj;
+      o->next = s->free_list;
+      s->free_list = o;
+      --s->n_used;
+    }
+}
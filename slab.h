@@ -0,0 +1,86 @@
+/*
+ *  OpenVPN -- An application to securely tunnel IP networks
+ *             over a single TCP/UDP port, with support for SSL/TLS-based
+ *             session authentication and key exchange,
+ *             packet encryption, packet authentication, and
+ *             packet compression.
+ *
+ *  Copyright (C) 2002-2010 OpenVPN Technologies, Inc. <sales@openvpn.net>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2
+ *  as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program (see the file COPYING included with this
+ *  distribution); if not, write to the Free Software Foundation, Inc.,
+ *  59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef SLAB_H
+#define SLAB_H
+
+/*
+ * Allocator for many objects of the same type, such as
+ * the per-client instances of a server.
+ *
+ * Objects are carved from blocks of slab->per_block
+ * objects.  Each object starts on a cache line, so that
+ * its layout maps onto cache lines the same way for every
+ * object, and released objects are kept on a free list
+ * for reuse rather than returned to malloc.  Blocks are
+ * freed only by slab_free.
+ */
+
+#include "basic.h"
+
+#define SLAB_ALIGN 64
+
+struct slab_block
+{
+  struct slab_block *next;
+  void *storage;                /* per_block objects, SLAB_ALIGN aligned */
+};
+
+struct slab_object
+{
+  struct slab_object *next;     /* free list link, overlays a released object */
+};
+
+struct slab
+{
+  size_t size;                  /* object size, rounded up to SLAB_ALIGN */
+  int per_block;
+  struct slab_block *blocks;
+  struct slab_object *free_list;
+
+  /* statistics */
+  int n_blocks;
+  int n_used;
+};
+
+struct slab *slab_init (size_t size, int per_block);
+void slab_free (struct slab *s);
+
+/*
+ * Return a zeroed object.
+ */
+void *slab_alloc (struct slab *s);
+
+void slab_release (struct slab *s, void *obj);
+
+/*
+ * Bytes of memory held by the slab, in use or not.
+ */
+static inline size_t
+slab_footprint (const struct slab *s)
+{
+  return (size_t) s->n_blocks * (s->per_block * s->size + SLAB_ALIGN + sizeof (struct slab_block));
+}
+
+#endif
@@ -817,6 +817,40 @@ link_socket_update_buffer_sizes (struct link_socket *ls, int rcvbuf, int sndbuf)
     }
 }
 
+#ifdef ENABLE_UDP_OFFLOAD
+
+/*
+ * Set up --udp-offload.  Segmented sends need no socket option,
+ * they are requested per sendmsg with a UDP_SEGMENT cmsg.
+ */
+static void
+link_socket_offload_init (struct link_socket *sock)
+{
+  struct link_socket_offload *lo;
+  int on = 1;
+
+  ALLOC_OBJ_CLEAR (lo, struct link_socket_offload);
+  ALLOC_ARRAY (lo->gso_data, uint8_t, UDP_GSO_MAX_PAYLOAD);
+  ALLOC_ARRAY (lo->gro_data, uint8_t, UDP_OFFLOAD_BUF_SIZE);
+  lo->gso_enabled = true;
+
+  if (setsockopt (sock->sd, SOL_UDP, UDP_GRO, (void *) &on, sizeof (on)) < 0)
+    msg (M_WARN | M_ERRNO, "NOTE: UDP: setsockopt UDP_GRO failed, receive offload disabled");
+
+  sock->offload = lo;
+  msg (D_LOW, "UDP: segmentation offload enabled");
+}
+
+static void
+link_socket_offload_free (struct link_socket_offload *lo)
+{
+  free (lo->gso_data);
+  free (lo->gro_data);
+  free (lo);
+}
+
+#endif
+
 /*
  * SOCKET INITALIZATION CODE.
  * Create a TCP/UDP socket
@@ -1959,6 +1993,11 @@ link_socket_init_phase2 (struct link_socket *sock,
   /* set misc socket parameters */
   socket_set_flags (sock->sd, sock->sockflags);
 
+#ifdef ENABLE_UDP_OFFLOAD
+  if ((sock->sockflags & SF_UDP_OFFLOAD) && proto_is_udp (sock->info.proto) && !sock->offload)
+    link_socket_offload_init (sock);
+#endif
+
   /* set socket to non-blocking mode */
   set_nonblock (sock->sd);
 
@@ -2020,6 +2059,15 @@ link_socket_close (struct link_socket *sock)
       const int gremlin = 0;
 #endif
 
+#ifdef ENABLE_UDP_OFFLOAD
+      if (sock->offload)
+	{
+	  link_socket_write_flush (sock);
+	  link_socket_offload_free (sock->offload);
+	  sock->offload = NULL;
+	}
+#endif
+
       if (socket_defined (sock->sd))
 	{
 #ifdef WIN32
@@ -2957,6 +3005,110 @@ link_socket_read_udp_posix_recvmsg (struct link_socket *sock,
 }
 #endif
 
+#ifdef ENABLE_UDP_OFFLOAD
+
+/*
+ * Read one datagram with --udp-offload.  The kernel may hand us
+ * a train of equal-sized datagrams from the same peer at once
+ * (UDP_GRO), which we return one at a time.  The first lands
+ * directly in buf, the remainder spills over into gro_data.
+ */
+static socklen_t
+link_socket_read_udp_offload (struct link_socket *sock,
+			      struct buffer *buf,
+			      int maxsize,
+			      struct link_socket_actual *from)
+{
+  struct link_socket_offload *lo = sock->offload;
+
+  if (socket_read_gro_residual (sock))
+    {
+      const int len = min_int (lo->gro_size, lo->gro_len - lo->gro_offset);
+      memcpy (BPTR (buf), lo->gro_data + lo->gro_offset, len);
+      lo->gro_offset += len;
+      *from = lo->gro_from;
+      buf->len = len;
+      return lo->gro_fromlen;
+    }
+  else
+    {
+      union {
+	uint8_t data[CMSG_SPACE (sizeof (struct in6_pktinfo)) + CMSG_SPACE (sizeof (int))];
+	struct cmsghdr align;
+      } control;
+      struct iovec iov[2];
+      struct msghdr mesg;
+      struct cmsghdr *cmsg;
+      socklen_t fromlen = sizeof (from->dest.addr);
+      int gro_size = 0;
+
+      ASSERT (maxsize < UDP_OFFLOAD_BUF_SIZE);
+      iov[0].iov_base = BPTR (buf);
+      iov[0].iov_len = maxsize;
+      iov[1].iov_base = lo->gro_data + maxsize;
+      iov[1].iov_len = UDP_OFFLOAD_BUF_SIZE - maxsize;
+      CLEAR (mesg);
+      mesg.msg_iov = iov;
+      mesg.msg_iovlen = 2;
+      mesg.msg_name = &from->dest.addr;
+      mesg.msg_namelen = fromlen;
+      mesg.msg_control = control.data;
+      mesg.msg_controllen = sizeof (control.data);
+
+      buf->len = recvmsg (sock->sd, &mesg, 0);
+      if (buf->len < 0)
+	return fromlen;
+      fromlen = mesg.msg_namelen;
+
+      for (cmsg = CMSG_FIRSTHDR (&mesg); cmsg != NULL; cmsg = CMSG_NXTHDR (&mesg, cmsg))
+	{
+	  if (cmsg->cmsg_level == SOL_UDP
+	      && cmsg->cmsg_type == UDP_GRO
+	      && cmsg->cmsg_len >= CMSG_LEN (sizeof (int)))
+	    {
+	      memcpy (&gro_size, CMSG_DATA (cmsg), sizeof (int));
+	    }
+	  else if (cmsg->cmsg_level == SOL_IP
+		   && cmsg->cmsg_type == IP_PKTINFO
+		   && cmsg->cmsg_len >= CMSG_LEN (sizeof (struct in_pktinfo)))
+	    {
+	      struct in_pktinfo *pkti = (struct in_pktinfo *) CMSG_DATA (cmsg);
+	      from->pi.in4.ipi_ifindex = pkti->ipi_ifindex;
+	      from->pi.in4.ipi_spec_dst = pkti->ipi_spec_dst;
+	    }
+	  else if (cmsg->cmsg_level == IPPROTO_IPV6
+		   && cmsg->cmsg_type == IPV6_PKTINFO
+		   && cmsg->cmsg_len >= CMSG_LEN (sizeof (struct in6_pktinfo)))
+	    {
+	      struct in6_pktinfo *pkti6 = (struct in6_pktinfo *) CMSG_DATA (cmsg);
+	      from->pi.in6.ipi6_ifindex = pkti6->ipi6_ifindex;
+	      from->pi.in6.ipi6_addr = pkti6->ipi6_addr;
+	    }
+	}
+
+      if (gro_size > 0 && gro_size < buf->len && gro_size <= maxsize)
+	{
+	  /* move the part of the train which landed in buf next to the spill-over */
+	  memcpy (lo->gro_data + gro_size, BPTR (buf) + gro_size,
+		  min_int (buf->len, maxsize) - gro_size);
+	  lo->gro_offset = gro_size;
+	  lo->gro_len = buf->len;
+	  lo->gro_size = gro_size;
+	  lo->gro_from = *from;
+	  lo->gro_fromlen = fromlen;
+	  buf->len = gro_size;
+	}
+      else if (buf->len > maxsize)
+	{
+	  /* truncated, like recvfrom into a short buffer */
+	  buf->len = maxsize;
+	}
+      return fromlen;
+    }
+}
+
+#endif
+
 int
 link_socket_read_udp_posix (struct link_socket *sock,
 			    struct buffer *buf,
@@ -2967,6 +3119,11 @@ link_socket_read_udp_posix (struct link_socket *sock,
   socklen_t expectedlen = af_addr_size(proto_sa_family(sock->info.proto));
   addr_zero_host(&from->dest);
   ASSERT (buf_safe (buf, maxsize));
+#ifdef ENABLE_UDP_OFFLOAD
+  if (sock->offload)
+    fromlen = link_socket_read_udp_offload (sock, buf, maxsize, from);
+  else
+#endif
 #if ENABLE_IP_PKTINFO
   /* Both PROTO_UDPv4 and PROTO_UDPv6 */
   if (proto_is_udp(sock->info.proto) && sock->sockflags & SF_USE_IP_PKTINFO)
@@ -3074,6 +3231,217 @@ link_socket_write_udp_posix_sendmsg (struct link_socket *sock,
 
 #endif
 
+#ifdef ENABLE_UDP_OFFLOAD
+
+static inline bool
+link_socket_offload_same_peer (const struct link_socket *sock,
+			       const struct link_socket_actual *a1,
+			       const struct link_socket_actual *a2)
+{
+  return link_socket_actual_match (a1, a2)
+    && (!(sock->sockflags & SF_USE_IP_PKTINFO) || !memcmp (&a1->pi, &a2->pi, sizeof (a1->pi)));
+}
+
+/*
+ * Send len bytes at data to *to as one datagram or, if
+ * segment_size is nonzero, let the kernel cut them into
+ * datagrams of segment_size bytes (UDP_SEGMENT).
+ */
+static int
+link_socket_sendmsg_offload (struct link_socket *sock,
+			     uint8_t *data,
+			     int len,
+			     int segment_size,
+			     const struct link_socket_actual *to)
+{
+  union {
+    uint8_t data[CMSG_SPACE (sizeof (struct in6_pktinfo)) + CMSG_SPACE (sizeof (uint16_t))];
+    struct cmsghdr align;
+  } control;
+  struct iovec iov;
+  struct msghdr mesg;
+  struct cmsghdr *cmsg;
+  size_t controllen = 0;
+
+  iov.iov_base = data;
+  iov.iov_len = len;
+  CLEAR (mesg);
+  CLEAR (control);
+  mesg.msg_iov = &iov;
+  mesg.msg_iovlen = 1;
+  mesg.msg_name = (void *) &to->dest.addr.sa;
+  mesg.msg_namelen = af_addr_size (to->dest.addr.sa.sa_family);
+  mesg.msg_control = control.data;
+  mesg.msg_controllen = sizeof (control.data);
+  cmsg = CMSG_FIRSTHDR (&mesg);
+
+  if ((sock->sockflags & SF_USE_IP_PKTINFO) && addr_defined_ipi (to))
+    {
+      if (to->dest.addr.sa.sa_family == AF_INET)
+	{
+	  struct in_pktinfo *pkti;
+	  cmsg->cmsg_level = SOL_IP;
+	  cmsg->cmsg_type = IP_PKTINFO;
+	  cmsg->cmsg_len = CMSG_LEN (sizeof (struct in_pktinfo));
+	  pkti = (struct in_pktinfo *) CMSG_DATA (cmsg);
+	  pkti->ipi_ifindex = to->pi.in4.ipi_ifindex;
+	  pkti->ipi_spec_dst = to->pi.in4.ipi_spec_dst;
+	  pkti->ipi_addr.s_addr = 0;
+	  controllen += CMSG_SPACE (sizeof (struct in_pktinfo));
+	}
+      else
+	{
+	  struct in6_pktinfo *pkti6;
+	  cmsg->cmsg_level = IPPROTO_IPV6;
+	  cmsg->cmsg_type = IPV6_PKTINFO;
+	  cmsg->cmsg_len = CMSG_LEN (sizeof (struct in6_pktinfo));
+	  pkti6 = (struct in6_pktinfo *) CMSG_DATA (cmsg);
+	  pkti6->ipi6_ifindex = to->pi.in6.ipi6_ifindex;
+	  pkti6->ipi6_addr = to->pi.in6.ipi6_addr;
+	  controllen += CMSG_SPACE (sizeof (struct in6_pktinfo));
+	}
+      cmsg = CMSG_NXTHDR (&mesg, cmsg);
+    }
+
+  if (segment_size)
+    {
+      const uint16_t gso_size = segment_size;
+      cmsg->cmsg_level = SOL_UDP;
+      cmsg->cmsg_type = UDP_SEGMENT;
+      cmsg->cmsg_len = CMSG_LEN (sizeof (uint16_t));
+      memcpy (CMSG_DATA (cmsg), &gso_size, sizeof (gso_size));
+      controllen += CMSG_SPACE (sizeof (uint16_t));
+    }
+
+  mesg.msg_controllen = controllen;
+  if (!controllen)
+    mesg.msg_control = NULL;
+  return sendmsg (sock->sd, &mesg, 0);
+}
+
+/*
+ * Would a send which failed with errno succeed
+ * once the socket buffer has drained?
+ */
+static inline bool
+link_socket_send_would_block (void)
+{
+  return errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS;
+}
+
+/*
+ * Send the held datagrams.  If the socket buffer is full, those
+ * not yet sent stay held and the batch is marked blocked, so
+ * that io_wait waits for SOCKET_WRITE before trying again.
+ */
+void
+link_socket_write_flush (struct link_socket *sock)
+{
+  if (link_socket_write_pending (sock))
+    {
+      struct link_socket_offload *lo = sock->offload;
+      int offset;
+
+      lo->gso_blocked = false;
+      if (lo->gso_count > 1 && lo->gso_enabled)
+	{
+	  if (link_socket_sendmsg_offload (sock, lo->gso_data, lo->gso_len, lo->gso_size, &lo->gso_to) >= 0)
+	    {
+	      lo->gso_count = lo->gso_len = 0;
+	      return;
+	    }
+	  else if (link_socket_send_would_block ())
+	    {
+	      lo->gso_blocked = true;
+	      return;
+	    }
+	  else if (errno == EIO || errno == EINVAL || errno == EOPNOTSUPP || errno == ENOPROTOOPT)
+	    {
+	      /* no segmentation offload on this path, send the batch one by one */
+	      msg (M_WARN | M_ERRNO, "NOTE: UDP: segmented send failed, disabling segmentation offload");
+	      lo->gso_enabled = false;
+	    }
+	  else
+	    {
+	      msg (D_LINK_ERRORS | M_ERRNO, "UDP: segmented send of %d datagrams failed", lo->gso_count);
+	      lo->gso_count = lo->gso_len = 0;
+	      return;
+	    }
+	}
+
+      for (offset = 0; offset < lo->gso_len; offset += lo->gso_size)
+	{
+	  const int len = min_int (lo->gso_size, lo->gso_len - offset);
+	  if (link_socket_sendmsg_offload (sock, lo->gso_data + offset, len, 0, &lo->gso_to) != len)
+	    {
+	      if (link_socket_send_would_block ())
+		{
+		  /* keep the unsent tail for the next writable event */
+		  lo->gso_len -= offset;
+		  memmove (lo->gso_data, lo->gso_data + offset, lo->gso_len);
+		  lo->gso_count = (lo->gso_len + lo->gso_size - 1) / lo->gso_size;
+		  lo->gso_blocked = true;
+		  return;
+		}
+	      msg (D_LINK_ERRORS | M_ERRNO, "UDP: send of held datagram failed");
+	    }
+	}
+      lo->gso_count = lo->gso_len = 0;
+    }
+}
+
+/*
+ * Write one datagram with --udp-offload.  Consecutive datagrams
+ * of the same size to the same peer are held back and sent with
+ * a single sendmsg; a shorter one ends the batch.  The event loop
+ * calls link_socket_write_flush before it would block.
+ */
+int
+link_socket_write_udp_offload (struct link_socket *sock,
+			       struct buffer *buf,
+			       struct link_socket_actual *to)
+{
+  struct link_socket_offload *lo = sock->offload;
+  const int len = BLEN (buf);
+
+  if (lo->gso_count)
+    {
+      if (len > 0
+	  && len <= lo->gso_size
+	  && lo->gso_len + len <= UDP_GSO_MAX_PAYLOAD
+	  && link_socket_offload_same_peer (sock, &lo->gso_to, to))
+	{
+	  memcpy (lo->gso_data + lo->gso_len, BPTR (buf), len);
+	  lo->gso_len += len;
+	  ++lo->gso_count;
+	  if (len < lo->gso_size
+	      || lo->gso_count >= UDP_GSO_MAX_SEGMENTS
+	      || lo->gso_len + lo->gso_size > UDP_GSO_MAX_PAYLOAD)
+	    link_socket_write_flush (sock);
+	  return len;
+	}
+      link_socket_write_flush (sock);
+
+      /* the held datagrams still wait for the socket buffer to drain */
+      if (lo->gso_count)
+	{
+	  errno = EAGAIN;
+	  return -1;
+	}
+    }
+
+  if (!lo->gso_enabled || len <= 0 || len > UDP_GSO_MAX_PAYLOAD)
+    return link_socket_sendmsg_offload (sock, BPTR (buf), len, 0, to);
+
+  memcpy (lo->gso_data, BPTR (buf), len);
+  lo->gso_len = lo->gso_size = len;
+  lo->gso_count = 1;
+  lo->gso_to = *to;
+  return len;
+}
+
+#endif
+
 /*
  * Win32 overlapped socket I/O functions.
  */
@@ -138,6 +138,41 @@ struct stream_buf
 #endif
 };
 
+#ifdef ENABLE_UDP_OFFLOAD
+
+/*
+ * Largest datagram the kernel may coalesce on receive,
+ * and the most payload it accepts in one UDP_SEGMENT send.
+ */
+#define UDP_OFFLOAD_BUF_SIZE    65535
+#define UDP_GSO_MAX_PAYLOAD     (65535 - 40 - 8)
+#define UDP_GSO_MAX_SEGMENTS    64
+
+/*
+ * State for --udp-offload.
+ */
+struct link_socket_offload
+{
+  /* send side: equal-sized datagrams to one peer, held for a single sendmsg */
+  bool gso_enabled;
+  uint8_t *gso_data;
+  int gso_len;
+  int gso_size;
+  int gso_count;
+  struct link_socket_actual gso_to;
+  bool gso_blocked;           /* socket buffer was full, wait for SOCKET_WRITE */
+
+  /* receive side: rest of a datagram train coalesced by the kernel */
+  uint8_t *gro_data;
+  int gro_offset;
+  int gro_len;
+  int gro_size;
+  struct link_socket_actual gro_from;
+  socklen_t gro_fromlen;
+};
+
+#endif
+
 /*
  * Used to set socket buffer sizes
  */
@@ -211,8 +246,14 @@ struct link_socket
 # define SF_PORT_SHARE (1<<2)
 # define SF_HOST_RANDOMIZE (1<<3)
 # define SF_GETADDRINFO_DGRAM (1<<4)
+# define SF_UDP_OFFLOAD (1<<5)
   unsigned int sockflags;
 
+#ifdef ENABLE_UDP_OFFLOAD
+  /* defined if --udp-offload is active on a UDP socket */
+  struct link_socket_offload *offload;
+#endif
+
   /* for stream sockets */
   struct stream_buf stream_buf;
   struct buffer stream_buf_data;
@@ -947,6 +988,14 @@ link_socket_write_udp_posix (struct link_socket *sock,
 			     struct buffer *buf,
 			     struct link_socket_actual *to)
 {
+#ifdef ENABLE_UDP_OFFLOAD
+  int link_socket_write_udp_offload (struct link_socket *sock,
+				     struct buffer *buf,
+				     struct link_socket_actual *to);
+
+  if (sock->offload)
+    return link_socket_write_udp_offload (sock, buf, to);
+#endif
 #if ENABLE_IP_PKTINFO
   int link_socket_write_udp_posix_sendmsg (struct link_socket *sock,
 					   struct buffer *buf,
@@ -1044,6 +1093,80 @@ socket_read_residual (const struct link_socket *s)
   return s && s->stream_buf.residual_fully_formed;
 }
 
+/*
+ * With --udp-offload, a single recvmsg may return a train of
+ * datagrams coalesced by the kernel.  True if more of them
+ * can be read without waiting.
+ */
+static inline bool
+socket_read_gro_residual (const struct link_socket *s)
+{
+#ifdef ENABLE_UDP_OFFLOAD
+  return s && s->offload && s->offload->gro_offset < s->offload->gro_len;
+#else
+  return false;
+#endif
+}
+
+/*
+ * Take the next datagram of a UDP_GRO train without
+ * copying it.  buf points into the receive buffer and
+ * stays valid until the next read from the socket.
+ */
+static inline bool
+link_socket_read_gro_next (struct link_socket *s, struct buffer *buf)
+{
+#ifdef ENABLE_UDP_OFFLOAD
+  if (socket_read_gro_residual (s))
+    {
+      struct link_socket_offload *lo = s->offload;
+      const int len = min_int (lo->gro_size, lo->gro_len - lo->gro_offset);
+      buf_set_read (buf, lo->gro_data + lo->gro_offset, len);
+      lo->gro_offset += len;
+      return true;
+    }
+#endif
+  return false;
+}
+
+/*
+ * Are datagrams held back for a segmented send
+ * waiting to be written by link_socket_write_flush?
+ */
+static inline bool
+link_socket_write_pending (const struct link_socket *s)
+{
+#ifdef ENABLE_UDP_OFFLOAD
+  return s && s->offload && s->offload->gso_count > 0;
+#else
+  return false;
+#endif
+}
+
+/*
+ * Did the last attempt to send the held datagrams find the
+ * socket buffer full?  They are then kept until the socket
+ * becomes writable again.
+ */
+static inline bool
+link_socket_write_blocked (const struct link_socket *s)
+{
+#ifdef ENABLE_UDP_OFFLOAD
+  return link_socket_write_pending (s) && s->offload->gso_blocked;
+#else
+  return false;
+#endif
+}
+
+#ifdef ENABLE_UDP_OFFLOAD
+void link_socket_write_flush (struct link_socket *sock);
+#else
+static inline void
+link_socket_write_flush (struct link_socket *sock)
+{
+}
+#endif
+
 static inline event_t
 socket_event_handle (const struct link_socket *s)
 {
@@ -2108,6 +2108,10 @@ init_ssl (const struct options *options)
   /* Set SSL options */
   SSL_CTX_set_session_cache_mode (ctx, SSL_SESS_CACHE_OFF);
   SSL_CTX_set_options (ctx, SSL_OP_SINGLE_DH_USE);
+#ifdef SSL_MODE_RELEASE_BUFFERS
+  /* free the record buffers of sessions with no control channel traffic */
+  SSL_CTX_set_mode (ctx, SSL_MODE_RELEASE_BUFFERS);
+#endif
 
   /* Set callback for getting password from user to decrypt private key */
   SSL_CTX_set_default_passwd_cb (ctx, pem_password_callback);
@@ -2942,6 +2946,19 @@ key_state_read_plaintext (struct tls_multi *multi, struct key_state *ks, struct
   return ret;
 }
 
+/*
+ * Could the TLS object return plaintext?  Once the handshake
+ * is done it only can if ciphertext was fed to it, so that an
+ * idle session need not hold a plaintext buffer.
+ */
+static inline bool
+key_state_plaintext_pending (const struct key_state *ks)
+{
+  return ks->state < S_ACTIVE
+    || SSL_pending (ks->ssl) > 0
+    || BIO_ctrl_pending (ks->ct_in) > 0;
+}
+
 /** @} name Functions for packets received from a remote OpenVPN peer */
 
 /** @} addtogroup control_tls */
@@ -3484,6 +3501,126 @@ tls_multi_free (struct tls_multi *multi, bool clear)
   free(multi);
 }
 
+void
+tls_multi_release_idle (struct tls_multi *multi)
+{
+  const int before = tls_multi_footprint (multi);
+  int i, j, after;
+
+  for (i = 0; i < TM_SIZE; ++i)
+    for (j = 0; j < KS_SIZE; ++j)
+      {
+	struct key_state *ks = &multi->session[i].key[j];
+	if (ks->state >= S_ACTIVE)
+	  {
+	    reliable_release_idle (ks->send_reliable);
+	    reliable_release_idle (ks->rec_reliable);
+
+	    /* the key exchange is over, the plaintext write
+	       buffer and key source material are not used again */
+	    if (!ks->plaintext_write_buf.len)
+	      free_buf (&ks->plaintext_write_buf);
+	    if (ks->key_src)
+	      {
+		free (ks->key_src);
+		ks->key_src = NULL;
+	      }
+
+	    /* allocated again on the next control message */
+	    if (!ks->plaintext_read_buf.len)
+	      free_buf (&ks->plaintext_read_buf);
+	    free_buf (&ks->ack_write_buf);
+	  }
+      }
+
+  after = tls_multi_footprint (multi);
+  if (after < before)
+    dmsg (D_TLS_DEBUG_LOW, "TLS: released idle control channel buffers, %d -> %d bytes",
+	  before, after);
+}
+
+int
+tls_multi_footprint (const struct tls_multi *multi)
+{
+  int i, j, ret = sizeof (*multi);
+
+  for (i = 0; i < TM_SIZE; ++i)
+    for (j = 0; j < KS_SIZE; ++j)
+      {
+	const struct key_state *ks = &multi->session[i].key[j];
+	if (ks->state != S_UNDEF)
+	  {
+	    ret += ks->plaintext_read_buf.capacity
+	      + ks->plaintext_write_buf.capacity
+	      + ks->ack_write_buf.capacity;
+	    if (ks->key_src)
+	      ret += sizeof (struct key_source2);
+	    if (ks->send_reliable)
+	      ret += sizeof (struct reliable) + reliable_footprint (ks->send_reliable);
+	    if (ks->rec_reliable)
+	      ret += sizeof (struct reliable) + reliable_footprint (ks->rec_reliable);
+	  }
+      }
+  return ret;
+}
+
+static void key_state_soft_reset (struct tls_session *session);
+
+bool
+tls_multi_hibernate (struct tls_multi *multi)
+{
+  struct tls_session *session = &multi->session[TM_ACTIVE];
+  struct key_state *ks = &session->key[KS_PRIMARY];
+  const int before = tls_multi_footprint (multi);
+
+  if (ks->hibernated)
+    return true;
+
+  /* only a fully established key with nothing in flight */
+  if (ks->state < S_ACTIVE
+      || !ks->authenticated
+#ifdef ENABLE_DEF_AUTH
+      || ks->auth_deferred
+#endif
+      || session->key[KS_LAME_DUCK].state != S_UNDEF
+      || !reliable_empty (ks->send_reliable)
+      || !reliable_ack_empty (ks->rec_ack)
+      || buffer_list_peek (ks->paybuf)
+      || BLEN (&ks->plaintext_read_buf)
+      || BLEN (&ks->plaintext_write_buf)
+      || SSL_pending (ks->ssl) > 0
+      || BIO_ctrl_pending (ks->ct_in) > 0
+      || BIO_ctrl_pending (ks->ct_out) > 0)
+    return false;
+
+  /* SSL_free also frees ct_in and ct_out */
+  BIO_free_all (ks->ssl_bio);
+  SSL_free (ks->ssl);
+  ks->ssl = NULL;
+  ks->ssl_bio = ks->ct_in = ks->ct_out = NULL;
+  ks->hibernated = true;
+
+  tls_multi_release_idle (multi);
+
+  dmsg (D_TLS_DEBUG_LOW, "TLS: hibernated session, %d -> %d bytes",
+	before, tls_multi_footprint (multi));
+  return true;
+}
+
+void
+tls_multi_wake (struct tls_multi *multi)
+{
+  struct tls_session *session = &multi->session[TM_ACTIVE];
+
+  if (session->key[KS_PRIMARY].hibernated)
+    {
+      /* the hibernated key keeps carrying data as the lame duck
+	 while a new key is negotiated */
+      key_state_soft_reset (session);
+      dmsg (D_TLS_DEBUG_LOW, "TLS: waking hibernated session");
+    }
+}
+
 /** @} name Functions for initialization and cleanup of tls_multi structures */
 
 /** @} addtogroup control_processor */
@@ -4810,6 +4947,15 @@ tls_process (struct tls_multi *multi,
 	msg (D_TLS_DEBUG_LOW, "TLS: tls_process: killed expiring key");
   }
 
+  /* No TLS object to drive until the key is woken up */
+  if (ks->hibernated)
+    {
+      if (session->opt->renegotiate_seconds)
+	compute_earliest_wakeup (wakeup,
+	  ks->established + session->opt->renegotiate_seconds - now);
+      return false;
+    }
+
   do
     {
       update_time ();
@@ -4941,6 +5087,8 @@ tls_process (struct tls_multi *multi,
 	  if (!to_link->len && !reliable_ack_empty (ks->rec_ack))
 	    {
 	      buf = &ks->ack_write_buf;
+	      if (!buf->data)
+		*buf = alloc_buf (BUF_SIZE (&multi->opt.frame));
 	      ASSERT (buf_init (buf, FRAME_HEADROOM (&multi->opt.frame)));
 	      write_control_auth (session, ks, buf, to_link_addr, P_ACK_V1,
 				  RELIABLE_ACK_SIZE, false);
@@ -4981,10 +5129,12 @@ tls_process (struct tls_multi *multi,
 
 	  /* Read incoming plaintext from TLS object */
 	  buf = &ks->plaintext_read_buf;
-	  if (!buf->len)
+	  if (!buf->len && key_state_plaintext_pending (ks))
 	    {
 	      int status;
 
+	      if (!buf->data)
+		*buf = alloc_buf (TLS_CHANNEL_BUF_SIZE);
 	      ASSERT (buf_init (buf, 0));
 	      status = key_state_read_plaintext (multi, ks, buf, TLS_CHANNEL_BUF_SIZE);
 	      update_time ();
@@ -5106,6 +5256,8 @@ tls_process (struct tls_multi *multi,
   if (!to_link->len && !reliable_ack_empty (ks->rec_ack))
     {
       buf = &ks->ack_write_buf;
+      if (!buf->data)
+	*buf = alloc_buf (BUF_SIZE (&multi->opt.frame));
       ASSERT (buf_init (buf, FRAME_HEADROOM (&multi->opt.frame)));
       write_control_auth (session, ks, buf, to_link_addr, P_ACK_V1,
 			  RELIABLE_ACK_SIZE, false);
@@ -5670,6 +5822,35 @@ tls_pre_decrypt (struct tls_multi *multi,
 		  if (!read_control_auth (buf, &session->tls_auth, from))
 		    goto error;
 
+		  /*
+		   * A hibernated key has released its TLS object, so
+		   * the record in this packet can never be processed.
+		   * Reject it without acknowledging it, and start a
+		   * renegotiation.  The peer's retransmits reach the
+		   * old key as the lame duck and are rejected in the
+		   * same way, so the message is lost and has to be
+		   * sent again on the new key.  Bare ACKs can only
+		   * repeat earlier ones, as nothing was in flight when
+		   * the key hibernated, and don't wake it.
+		   */
+		  if (ks->hibernated && ks->key_id == key_id)
+		    {
+		      dmsg (D_TLS_DEBUG_LOW, "TLS: rejected %s for hibernated key %d",
+			    packet_opcode_name (op), key_id);
+		      if (op == P_ACK_V1)
+			goto error_lite;
+		      tls_multi_wake (multi);
+		      ret = true;
+		      goto done;
+		    }
+		  if (session->key[KS_LAME_DUCK].hibernated
+		      && session->key[KS_LAME_DUCK].key_id == key_id)
+		    {
+		      dmsg (D_TLS_DEBUG_LOW, "TLS: rejected %s for hibernated lame duck key %d",
+			    packet_opcode_name (op), key_id);
+		      goto error_lite;
+		    }
+
 		  dmsg (D_TLS_DEBUG,
 		       "TLS: received control channel packet s#=%d sid=%s",
 		       i, session_id_print (&sid, &gc));
@@ -5998,6 +6179,9 @@ tls_send_payload (struct tls_multi *multi,
 
   ASSERT (multi);
 
+  /* queued in paybuf until the renegotiated key is up */
+  tls_multi_wake (multi);
+
   session = &multi->session[TM_ACTIVE];
   ks = &session->key[KS_PRIMARY];
 
@@ -310,6 +310,8 @@ struct key_state
 
   struct buffer_list *paybuf;
 
+  bool hibernated;		 /* TLS object freed by tls_multi_hibernate */
+
   counter_type n_bytes;		 /* how many bytes sent/recvd since last key exchange */
   counter_type n_packets;	 /* how many packets sent/recvd since last key exchange */
 
@@ -686,6 +688,39 @@ int tls_multi_process (struct tls_multi *multi,
 
 void tls_multi_free (struct tls_multi *multi, bool clear);
 
+/*
+ * Free the control channel packet buffers and key exchange
+ * state of established key states which are not holding a
+ * packet.  Buffers are allocated again on the next control
+ * message.  The caller must not have a packet from the TLS
+ * layer pending in its to_link buffer.
+ */
+void tls_multi_release_idle (struct tls_multi *multi);
+
+/*
+ * Bytes of memory held by the TLS state of a tunnel,
+ * not counting what the SSL library itself allocates.
+ */
+int tls_multi_footprint (const struct tls_multi *multi);
+
+/*
+ * Free the TLS object of an established, quiet session so that
+ * only the data channel keys and packet IDs remain.  Data packets
+ * keep flowing on those keys; tls_multi_wake, a control packet
+ * from the peer or a scheduled renegotiation brings the session
+ * back through a soft reset.  Returns true if the session is
+ * hibernated.
+ */
+bool tls_multi_hibernate (struct tls_multi *multi);
+
+void tls_multi_wake (struct tls_multi *multi);
+
+static inline bool
+tls_multi_hibernated (const struct tls_multi *multi)
+{
+  return multi->session[TM_ACTIVE].key[KS_PRIMARY].hibernated;
+}
+
 
 /**************************************************************************/
 /**
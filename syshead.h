@@ -191,6 +191,18 @@
 #include <sys/epoll.h>
 #endif
 
+#ifdef HAVE_LINUX_IO_URING_H
+#include <linux/io_uring.h>
+#endif
+
+#ifdef HAVE_SYS_INOTIFY_H
+#include <sys/inotify.h>
+#endif
+
+#ifdef HAVE_SYS_SYSCALL_H
+#include <sys/syscall.h>
+#endif
+
 #ifdef HAVE_SETCON
 #include <selinux/selinux.h>
 #endif
@@ -223,6 +235,10 @@
 #include <linux/if_tun.h>
 #endif
 
+#ifdef HAVE_SYS_UIO_H
+#include <sys/uio.h>
+#endif
+
 #ifdef HAVE_NETINET_IP_H
 #include <netinet/ip.h>
 #endif
@@ -243,6 +259,10 @@
 #include <netinet/tcp.h>
 #endif
 
+#ifdef HAVE_NETINET_UDP_H
+#include <netinet/udp.h>
+#endif
+
 #endif /* TARGET_LINUX */
 
 #ifdef TARGET_SOLARIS
@@ -409,6 +429,15 @@
 #define ENABLE_IP_PKTINFO 0
 #endif
 
+/*
+ * Should we support UDP segmentation and receive offload
+ * on the link socket (--udp-offload)?  This builds on the
+ * sendmsg/recvmsg plumbing used for --multihome.
+ */
+#if ENABLE_IP_PKTINFO && defined(TARGET_LINUX) && defined(HAVE_IN_PKTINFO) && defined(SOL_UDP) && defined(UDP_SEGMENT) && defined(UDP_GRO)
+#define ENABLE_UDP_OFFLOAD
+#endif
+
 /*
  * Does this platform define SOL_IP
  * or only bsd-style IPPROTO_IP ?
@@ -647,6 +676,35 @@ socket_defined (const socket_descriptor_t sd)
 #define EPOLL 0
 #endif
 
+/*
+ * Is io_uring available on this platform?  We talk to the
+ * kernel directly through the raw system calls, so only the
+ * kernel headers are required, not liburing.
+ */
+#if defined(HAVE_LINUX_IO_URING_H) && defined(HAVE_SYS_MMAN_H) && defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter) && defined(IORING_FEAT_POLL_32BITS)
+#define IO_URING 1
+#else
+#define IO_URING 0
+#endif
+
+/*
+ * Can we learn about changes to --client-config-dir
+ * and pf files from the kernel, rather than polling?
+ */
+#if defined(TARGET_LINUX) && defined(HAVE_SYS_INOTIFY_H) && defined(IN_Q_OVERFLOW)
+#define ENABLE_FILE_WATCH
+#endif
+
+/*
+ * Should we support TUN segmentation offload (--tun-offload)?
+ * The Linux tun driver prepends a virtio-net header to each
+ * packet, which lets it pass TCP super-packets in both
+ * directions.
+ */
+#if defined(TARGET_LINUX) && defined(HAVE_LINUX_IF_TUN_H) && defined(IFF_VNET_HDR) && defined(TUNSETVNETHDRSZ) && defined(TUNSETOFFLOAD) && defined(TUN_F_TSO4) && defined(HAVE_IOVEC) && defined(HAVE_READV) && defined(HAVE_WRITEV)
+#define ENABLE_TUN_OFFLOAD
+#endif
+
 /*
  * Should we allow ca/cert/key files to be
  * included inline, in the configuration file?
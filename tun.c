@@ -1336,6 +1336,189 @@ close_tun_generic (struct tuntap *tt)
 /* #warning IPv6 OFF */
 #endif
 
+#ifdef ENABLE_TUN_OFFLOAD
+
+/*
+ * The device was opened with IFF_VNET_HDR, so every packet
+ * now carries a virtio-net header.  Ask the kernel to hand
+ * us TCP super-packets and partially checksummed packets,
+ * which read_tun segments and completes.
+ */
+static void
+open_tun_offload (struct tuntap *tt, const char *name)
+{
+  int hdr_size = sizeof (struct openvpn_vnet_hdr);
+  const unsigned long offloads = TUN_F_CSUM|TUN_F_TSO4|TUN_F_TSO6;
+
+  tt->gso = gso_state_new ();
+
+  if (ioctl (tt->fd, TUNSETVNETHDRSZ, (void *) &hdr_size) < 0)
+    msg (M_WARN | M_ERRNO, "Note: Cannot set virtio-net header size on %s", name);
+
+  if (ioctl (tt->fd, TUNSETOFFLOAD, offloads) >= 0)
+    msg (M_INFO, "TUN/TAP segmentation offload enabled on %s", name);
+  else
+    msg (M_WARN | M_ERRNO, "Note: Cannot enable segmentation offload on %s", name);
+}
+
+static void
+close_tun_offload (struct tuntap *tt)
+{
+  if (tt->gso)
+    {
+      tun_write_flush (tt);
+      gso_state_free (tt->gso);
+      tt->gso = NULL;
+    }
+}
+
+/*
+ * Write one packet preceded by a virtio-net header
+ * (and a tun_pi header with --tun-ipv6).
+ */
+static int
+write_tun_vnet (struct tuntap *tt, const struct openvpn_vnet_hdr *vh, uint8_t *buf, int len)
+{
+  struct iovec vect[3];
+  struct tun_pi pi;
+  int n = 0;
+  int hlen = 0;
+  int ret;
+
+  if (tt->ipv6)
+    {
+      pi.flags = 0;
+      pi.proto = htons (OPENVPN_IPH_GET_VER (buf[0]) == 6 ? ETH_P_IPV6 : ETH_P_IP);
+      vect[n].iov_len = sizeof (pi);
+      vect[n++].iov_base = &pi;
+      hlen += sizeof (pi);
+    }
+  vect[n].iov_len = sizeof (*vh);
+  vect[n++].iov_base = (void *) vh;
+  hlen += sizeof (*vh);
+  vect[n].iov_len = len;
+  vect[n++].iov_base = buf;
+
+  ret = writev (tt->fd, vect, n);
+  return ret < hlen ? ret : ret - hlen;
+}
+
+void
+tun_write_flush (struct tuntap *tt)
+{
+  if (tun_write_pending (tt))
+    {
+      struct gso_coalescer *co = &tt->gso->coalescer;
+      struct openvpn_vnet_hdr vh;
+      const int count = co->count;
+      const int len = gso_coalesce_finish (co, &vh);
+
+      if (write_tun_vnet (tt, &vh, co->data, len) != len)
+	msg (D_LINK_ERRORS | M_ERRNO, "TUN/TAP: write of %d coalesced packets failed", count);
+      else
+	dmsg (D_TUN_RW, "TUN WRITE coalesced %d packets into %d bytes", count, len);
+      gso_coalesce_reset (co);
+    }
+}
+
+/*
+ * Hold TCP segments back so that runs of them can be written
+ * as a single super-packet.  The event loop calls
+ * tun_write_flush before it would block.
+ */
+static int
+write_tun_offload (struct tuntap *tt, uint8_t *buf, int len)
+{
+  struct gso_coalescer *co = &tt->gso->coalescer;
+  struct openvpn_vnet_hdr vh;
+
+  if (gso_coalesce_pending (co))
+    {
+      if (gso_coalesce (co, buf, len))
+	{
+	  if (gso_coalesce_full (co))
+	    tun_write_flush (tt);
+	  return len;
+	}
+      tun_write_flush (tt);
+    }
+
+  if (gso_coalesce_start (co, buf, len))
+    return len;
+
+  CLEAR (vh);
+  return write_tun_vnet (tt, &vh, buf, len);
+}
+
+/*
+ * Return the next packet from the device, cutting TCP
+ * super-packets into segments of at most len bytes.  Small
+ * packets are read directly into buf, large ones spill over
+ * into the segmenter's buffer.
+ */
+static int
+read_tun_offload (struct tuntap *tt, uint8_t *buf, int len)
+{
+  struct gso_segmenter *s = &tt->gso->segmenter;
+  int ret;
+
+  if (!gso_segmenter_pending (s))
+    {
+      struct openvpn_vnet_hdr vh;
+      struct iovec vect[4];
+      struct tun_pi pi;
+      int n = 0;
+      int hlen = 0;
+
+      if (tt->ipv6)
+	{
+	  vect[n].iov_len = sizeof (pi);
+	  vect[n++].iov_base = &pi;
+	  hlen += sizeof (pi);
+	}
+      vect[n].iov_len = sizeof (vh);
+      vect[n++].iov_base = &vh;
+      hlen += sizeof (vh);
+      vect[n].iov_len = len;
+      vect[n++].iov_base = buf;
+      if (len < GSO_MAX_PACKET)
+	{
+	  vect[n].iov_len = GSO_MAX_PACKET - len;
+	  vect[n++].iov_base = s->data + len;
+	}
+
+      ret = readv (tt->fd, vect, n);
+      if (ret < hlen)
+	return ret < 0 ? ret : 0;
+      ret -= hlen;
+
+      if (vh.gso_type == OPENVPN_VNET_HDR_GSO_NONE && ret <= len)
+	{
+	  gso_checksum_complete (buf, ret, &vh);
+	  return ret;
+	}
+
+      /* reassemble the super-packet in the segmenter's buffer */
+      memcpy (s->data, buf, min_int (ret, len));
+      if (!gso_segmenter_load (s, &vh, ret))
+	{
+	  msg (D_LINK_ERRORS, "TUN/TAP: dropping %d byte packet which cannot be segmented (gso_type=%d)",
+	       ret, vh.gso_type);
+	  return 0;
+	}
+    }
+
+  ret = gso_segmenter_next (s, buf, len);
+  if (ret < 0)
+    {
+      msg (D_LINK_ERRORS, "TUN/TAP: segment size exceeds %d bytes, dropping super-packet", len);
+      return 0;
+    }
+  return ret;
+}
+
+#endif /* ENABLE_TUN_OFFLOAD */
+
 #if !PEDANTIC
 
 void
@@ -1392,6 +1575,10 @@ open_tun (const char *dev, const char *dev_type, const char *dev_node, struct tu
       if (tt->type == DEV_TYPE_TUN)
 	{
 	  ifr.ifr_flags |= IFF_TUN;
+#ifdef ENABLE_TUN_OFFLOAD
+	  if (tt->options.offload)
+	    ifr.ifr_flags |= IFF_VNET_HDR;
+#endif
 	}
       else if (tt->type == DEV_TYPE_TAP)
 	{
@@ -1421,6 +1608,16 @@ open_tun (const char *dev, const char *dev_type, const char *dev_node, struct tu
 
       msg (M_INFO, "TUN/TAP device %s opened", ifr.ifr_name);
 
+#ifdef ENABLE_TUN_OFFLOAD
+      /*
+       * Process --tun-offload
+       */
+      if (ifr.ifr_flags & IFF_VNET_HDR)
+	open_tun_offload (tt, ifr.ifr_name);
+      else if (tt->options.offload)
+	msg (M_WARN, "NOTE: --tun-offload is only supported with --dev tun, ignoring");
+#endif
+
       /*
        * Try making the TX send queue bigger
        */
@@ -1572,6 +1769,9 @@ close_tun (struct tuntap *tt)
 	    argv_reset (&argv);
 	    gc_free (&gc);
 	  }
+#ifdef ENABLE_TUN_OFFLOAD
+      close_tun_offload (tt);
+#endif
       close_tun_generic (tt);
       free (tt);
     }
@@ -1580,6 +1780,10 @@ close_tun (struct tuntap *tt)
 int
 write_tun (struct tuntap* tt, uint8_t *buf, int len)
 {
+#ifdef ENABLE_TUN_OFFLOAD
+  if (tt->gso)
+    return write_tun_offload (tt, buf, len);
+#endif
 #if LINUX_IPV6
   if (tt->ipv6)
     {
@@ -1613,6 +1817,10 @@ write_tun (struct tuntap* tt, uint8_t *buf, int len)
 int
 read_tun (struct tuntap* tt, uint8_t *buf, int len)
 {
+#ifdef ENABLE_TUN_OFFLOAD
+  if (tt->gso)
+    return read_tun_offload (tt, buf, len);
+#endif
 #if LINUX_IPV6
   if (tt->ipv6)
     {
@@ -37,6 +37,7 @@
 #include "event.h"
 #include "proto.h"
 #include "misc.h"
+#include "gso.h"
 
 #ifdef WIN32
 
@@ -107,6 +108,7 @@ struct tuntap_options {
 
 struct tuntap_options {
   int txqueuelen;
+  bool offload; /* --tun-offload */
 };
 
 #else
@@ -183,6 +185,12 @@ struct tuntap
   /* Some TUN/TAP drivers like to be ioctled for mtu
      after open */
   int post_open_mtu;
+
+#ifdef ENABLE_TUN_OFFLOAD
+  /* segmentation/coalescing state, defined
+     if the device was opened with IFF_VNET_HDR */
+  struct gso_state *gso;
+#endif
 };
 
 static inline bool
@@ -461,6 +469,45 @@ tun_set (struct tuntap *tt,
   return rwflags;
 }
 
+/*
+ * With --tun-offload, a single read from the device may
+ * return several packets.  Like socket_read_residual, this
+ * tells the event loop that another packet can be read
+ * without waiting.
+ */
+static inline bool
+tun_read_residual (const struct tuntap *tt)
+{
+#ifdef ENABLE_TUN_OFFLOAD
+  return tt && tt->gso && gso_segmenter_pending (&tt->gso->segmenter);
+#else
+  return false;
+#endif
+}
+
+/*
+ * Are coalesced packets waiting to be written
+ * to the device by tun_write_flush?
+ */
+static inline bool
+tun_write_pending (const struct tuntap *tt)
+{
+#ifdef ENABLE_TUN_OFFLOAD
+  return tt && tt->gso && gso_coalesce_pending (&tt->gso->coalescer);
+#else
+  return false;
+#endif
+}
+
+#ifdef ENABLE_TUN_OFFLOAD
+void tun_write_flush (struct tuntap *tt);
+#else
+static inline void
+tun_write_flush (struct tuntap *tt)
+{
+}
+#endif
+
 const char *tun_stat (const struct tuntap *tt, unsigned int rwflags, struct gc_arena *gc);
 
 #endif /* TUN_H */